@@ -0,0 +1,1086 @@
+
+// <summary>Contains a generic benchmark harness for the sparse set containers</summary>
+
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <memory>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <set>
+#include <unordered_map>
+#include <bitset>
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+#include "perf_counters.h"
+#include "workload_generators.h"
+
+namespace benchmark
+{
+    typedef std::chrono::steady_clock clock;
+    typedef std::chrono::duration<double, std::milli> time_in_msec;
+
+    ///------------------------------------
+    /// Command line options
+    ///------------------------------------
+
+    struct options
+    {
+        std::vector<unsigned> lengths;
+        std::vector<unsigned> selections;
+        std::vector<double> densities;       // percentages of the length; when given, they replace the selections
+        std::vector<distribution_type> distributions;
+        std::string probes;                  // the distribution of the probes, or "same" as the population
+        distribution_parameters parameters;
+        unsigned seed;
+        std::vector<unsigned> repeats;       // the numbers of scans in the summation phase
+        unsigned steps;                      // the number of probes in the random access phase
+        unsigned batch;                      // the keys per test_batch call in the batched random access phase; 0: no such phase
+        unsigned samples;
+        unsigned warmup;
+        int cpu;                             // -1: no pinning
+        std::string format;                  // text, csv or json
+        std::string output;                  // empty: standard output
+        std::vector<std::string> containers; // empty: the default list
+        bool counters;                       // read the hardware counters around each phase
+        bool extras;                         // the sieve, snapshot and stream tests
+        bool help;
+
+        options() : lengths{ 100000, 1000000, 10000000, 50000000 }, selections{ 100000 }, densities(), distributions{ uniform_ids },
+            probes("uniform"), parameters(), seed(0x11111111), repeats{ 1 }, steps(100000000), batch(1024), samples(5), warmup(1), cpu(-1), format("text"), output(), containers(), counters(true), extras(false), help(false)
+        {
+        }
+    };
+
+    inline void print_usage(std::ostream& out, const char* program)
+    {
+        options defaults;
+        out << "Usage: " << program << " [options]" << std::endl
+            << "  --lengths=N,N,...     interval lengths (default 100000,1000000,10000000,50000000)" << std::endl
+            << "  --selections=N,N,...  numbers of elements selected in each interval (default 100000)" << std::endl
+            << "  --densities=P,P,...   selections as percentages of each length, e.g. 0.001,0.1,1,10,50 (replaces --selections)" << std::endl
+            << "  --distributions=a,b,... population distributions: uniform, zipf, clustered, runs, monotonic (default uniform)" << std::endl
+            << "  --probes=D            distribution of the random access probes, or 'same' as the population (default uniform)" << std::endl
+            << "  --zipf-exponent=X     skew of the zipf distribution (default " << defaults.parameters.zipf_exponent << ")" << std::endl
+            << "  --block-size=N        width of the clustered blocks (default " << defaults.parameters.block_size << ")" << std::endl
+            << "  --mean-run=N          mean length of the runs (default " << defaults.parameters.mean_run << ")" << std::endl
+            << "  --seed=N              seed of the population; the probes use a seed derived from it (default " << defaults.seed << ")" << std::endl
+            << "  --repeats=N,N,...     numbers of scans in the summation phase (default 1)" << std::endl
+            << "  --steps=N             probes in the random access phase (default " << defaults.steps << ")" << std::endl
+            << "  --batch=N             keys per batch in the batched random access phase, 0 to skip it (default " << defaults.batch << ")" << std::endl
+            << "  --samples=N           measured samples of each phase (default " << defaults.samples << ")" << std::endl
+            << "  --warmup=N            unmeasured runs before the samples (default " << defaults.warmup << ")" << std::endl
+            << "  --cpu=N               pin the process to CPU N" << std::endl
+            << "  --containers=a,b,...  containers to run, or 'all' (default: all but set and bitset)" << std::endl
+            << "  --format=text|csv|json" << std::endl
+            << "  --output=FILE         write the results to FILE instead of the standard output" << std::endl
+            << "  --no-counters         do not read the hardware performance counters" << std::endl
+            << "  --extras              also run the Eratosthenes sieve, snapshot, statistics, stream and range tests" << std::endl;
+    }
+
+    inline std::vector<std::string> split(const std::string& s, char separator)
+    {
+        std::vector<std::string> parts;
+        std::stringstream ss(s);
+        std::string part;
+        while (std::getline(ss, part, separator))
+        {
+            if (!part.empty())
+                parts.push_back(part);
+        }
+        return parts;
+    }
+
+    inline bool parse_unsigned(const std::string& s, unsigned& value)
+    {
+        char* end = nullptr;
+        unsigned long v = std::strtoul(s.c_str(), &end, 10);
+        if (s.empty() || *end != '\0' || v > 0xFFFFFFFFul)
+            return false;
+        value = static_cast<unsigned>(v);
+        return true;
+    }
+
+    inline bool parse_list(const std::string& s, std::vector<unsigned>& values)
+    {
+        values.clear();
+        for (auto& part : split(s, ','))
+        {
+            unsigned v;
+            if (!parse_unsigned(part, v))
+                return false;
+            values.push_back(v);
+        }
+        return !values.empty();
+    }
+
+    inline bool parse_double(const std::string& s, double& value)
+    {
+        char* end = nullptr;
+        value = std::strtod(s.c_str(), &end);
+        return !s.empty() && *end == '\0';
+    }
+
+    inline bool parse_densities(const std::string& s, std::vector<double>& values)
+    {
+        values.clear();
+        for (auto& part : split(s, ','))
+        {
+            double v;
+            if (!parse_double(part, v) || !(v > 0 && v <= 100))
+                return false;
+            values.push_back(v);
+        }
+        return !values.empty();
+    }
+
+    inline bool parse_distributions(const std::string& s, std::vector<distribution_type>& values)
+    {
+        values.clear();
+        for (auto& part : split(s, ','))
+        {
+            distribution_type d;
+            if (!parse_distribution(part, d))
+                return false;
+            values.push_back(d);
+        }
+        return !values.empty();
+    }
+
+    // returns false on an unknown or malformed option, after reporting it to err
+    inline bool parse_options(int argc, char* argv[], options& opt, std::ostream& err)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            std::string arg = argv[i];
+            std::string name = arg.substr(0, arg.find('='));
+            std::string value = arg.find('=') == std::string::npos ? std::string() : arg.substr(arg.find('=') + 1);
+            unsigned number = 0;
+            bool ok = true;
+
+            if (name == "--help" || name == "-h")
+                opt.help = true;
+            else if (name == "--lengths")
+                ok = parse_list(value, opt.lengths);
+            else if (name == "--selections")
+                ok = parse_list(value, opt.selections);
+            else if (name == "--densities")
+                ok = parse_densities(value, opt.densities);
+            else if (name == "--distributions")
+                ok = parse_distributions(value, opt.distributions);
+            else if (name == "--probes")
+            {
+                distribution_type d;
+                ok = (value == "same" || parse_distribution(value, d)) && (opt.probes = value, true);
+            }
+            else if (name == "--zipf-exponent")
+                ok = parse_double(value, opt.parameters.zipf_exponent) && opt.parameters.zipf_exponent > 0;
+            else if (name == "--block-size")
+                ok = parse_unsigned(value, opt.parameters.block_size) && opt.parameters.block_size != 0;
+            else if (name == "--mean-run")
+                ok = parse_unsigned(value, opt.parameters.mean_run) && opt.parameters.mean_run != 0;
+            else if (name == "--seed")
+                ok = parse_unsigned(value, opt.seed);
+            else if (name == "--repeats")
+                ok = parse_list(value, opt.repeats);
+            else if (name == "--steps")
+                ok = parse_unsigned(value, opt.steps);
+            else if (name == "--batch")
+                ok = parse_unsigned(value, opt.batch);
+            else if (name == "--samples")
+                ok = parse_unsigned(value, opt.samples) && opt.samples != 0;
+            else if (name == "--warmup")
+                ok = parse_unsigned(value, opt.warmup);
+            else if (name == "--cpu")
+            {
+                ok = parse_unsigned(value, number);
+                opt.cpu = static_cast<int>(number);
+            }
+            else if (name == "--containers")
+                opt.containers = split(value, ',');
+            else if (name == "--format")
+                ok = (value == "text" || value == "csv" || value == "json") && (opt.format = value, true);
+            else if (name == "--output")
+                ok = !(opt.output = value).empty();
+            else if (name == "--no-counters")
+                opt.counters = false;
+            else if (name == "--extras")
+                opt.extras = true;
+            else
+            {
+                err << "Unknown option: " << arg << std::endl;
+                return false;
+            }
+
+            if (!ok)
+            {
+                err << "Invalid value: " << arg << std::endl;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // the selections to run for a length: the given densities, or else the given selections that fit
+    inline std::vector<unsigned> selections_for(const options& opt, unsigned length)
+    {
+        std::vector<unsigned> selections;
+        if (!opt.densities.empty())
+        {
+            for (auto d : opt.densities)
+            {
+                selections.push_back(std::max(1u, static_cast<unsigned>(length * d / 100.0)));
+            }
+            return selections;
+        }
+
+        for (auto s : opt.selections)
+        {
+            if (s <= length)
+                selections.push_back(s);
+        }
+        return selections;
+    }
+
+    // the distribution of the probes when the population has the given distribution
+    inline distribution_type probe_distribution(const options& opt, distribution_type population)
+    {
+        distribution_type d = population;
+        if (opt.probes != "same")
+            parse_distribution(opt.probes, d);
+        return d;
+    }
+
+    // returns false if pinning is not supported or fails
+    inline bool pin_to_cpu(int cpu)
+    {
+#if defined(__linux__)
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(cpu, &cpus);
+        return sched_setaffinity(0, sizeof(cpus), &cpus) == 0;
+#else
+        (void)cpu;
+        return false;
+#endif
+    }
+
+    ///------------------------------------
+    /// Statistics and results
+    ///------------------------------------
+
+    struct statistics
+    {
+        double mean;
+        double median;
+        double p99;
+        double stddev;
+        double min;
+        double max;
+
+        static statistics of(std::vector<double> samples)
+        {
+            statistics s = { 0, 0, 0, 0, 0, 0 };
+            if (samples.empty())
+                return s;
+
+            std::sort(samples.begin(), samples.end());
+            std::size_t n = samples.size();
+
+            for (auto x : samples)
+            {
+                s.mean += x;
+            }
+            s.mean /= n;
+
+            for (auto x : samples)
+            {
+                s.stddev += (x - s.mean) * (x - s.mean);
+            }
+            s.stddev = n > 1 ? std::sqrt(s.stddev / (n - 1)) : 0.0;
+
+            s.median = n % 2 ? samples[n / 2] : (samples[n / 2 - 1] + samples[n / 2]) / 2;
+            s.p99 = samples[static_cast<std::size_t>(std::ceil(0.99 * n)) - 1]; // nearest rank
+            s.min = samples.front();
+            s.max = samples.back();
+            return s;
+        }
+    };
+
+    enum phase_type { generation, random_access, batched_random_access, summation, deletion, phase_count };
+
+    inline const char* phase_name(int phase)
+    {
+        static const char* names[] = { "generation", "random_access", "batched_random_access", "summation", "deletion" };
+        return names[phase];
+    }
+
+    // one measurement of one phase
+    struct phase_sample
+    {
+        double ms;
+        counter_values counters;
+    };
+
+    struct result
+    {
+        std::string container;
+        std::string distribution;
+        std::string probes;
+        unsigned length;
+        unsigned selection;
+        unsigned repeat;
+        std::string phase;
+        unsigned samples;
+        statistics ms;             // per phase run; a summation run is one scan
+        double operations;         // elements or probes handled by one run, for the per element figures
+        unsigned long long checksum;
+        double counters[counter_count]; // medians per element; only where counters_valid
+        bool counters_valid[counter_count];
+    };
+
+    ///
+    /// Formats the numbers of a report as a fresh stream would (general notation, 6 digits, right aligned), whatever
+    /// the caller has set on the stream, for example the std::setprecision(15) of the extras; the stream's own
+    /// format is restored when the guard goes out of scope
+    ///
+    class format_guard
+    {
+        std::ostream& m_out;
+        std::ios_base::fmtflags m_flags;
+        std::streamsize m_precision;
+        char m_fill;
+
+    public:
+        format_guard(std::ostream& out) : m_out(out), m_flags(out.flags()), m_precision(out.precision()), m_fill(out.fill())
+        {
+            m_out.flags(std::ios_base::dec | std::ios_base::skipws);
+            m_out.precision(6);
+            m_out.fill(' ');
+        }
+
+        ~format_guard()
+        {
+            m_out.flags(m_flags);
+            m_out.precision(m_precision);
+            m_out.fill(m_fill);
+        }
+    };
+
+    class report
+    {
+        std::vector<result> m_results;
+
+        static std::string escape(const std::string& s)
+        {
+            std::string r;
+            for (char c : s)
+            {
+                if (c == '"' || c == '\\')
+                    r += '\\';
+                r += c;
+            }
+            return r;
+        }
+
+        static double per_element_ns(const result& r)
+        {
+            return r.operations > 0 ? r.ms.median * 1000000.0 / r.operations : 0.0;
+        }
+
+    public:
+        void add(const result& r)
+        {
+            m_results.push_back(r);
+        }
+
+        const std::vector<result>& results() const
+        {
+            return m_results;
+        }
+
+        static void write_text(std::ostream& out, const result& r)
+        {
+            format_guard guard(out);
+            out << "  " << std::left << std::setw(21) << r.phase << std::right;
+            if (r.phase == phase_name(summation))
+                out << " x" << std::setw(3) << std::left << r.repeat << std::right;
+            else
+                out << "     ";
+            out << " median " << std::setw(10) << r.ms.median << " ms"
+                << "  p99 " << std::setw(10) << r.ms.p99 << " ms"
+                << "  stddev " << std::setw(8) << r.ms.stddev << " ms"
+                << "  " << std::setw(8) << per_element_ns(r) << " ns per element"
+                << "  counter: " << r.checksum << std::endl;
+
+            bool any = false;
+            for (int c = 0; c < counter_count; c++)
+            {
+                if (r.counters_valid[c])
+                {
+                    out << (any ? "  " : "                             per element:  ") << counter_name(c) << " " << r.counters[c];
+                    any = true;
+                }
+            }
+            if (any)
+                out << std::endl;
+        }
+
+        static bool same_configuration(const result& a, const result& b)
+        {
+            return a.distribution == b.distribution && a.probes == b.probes && a.length == b.length && a.selection == b.selection
+                && a.phase == b.phase && a.repeat == b.repeat;
+        }
+
+        // for every configuration and phase: how the given container compares with the fastest one
+        void write_comparison(std::ostream& out, const std::string& container) const
+        {
+            format_guard guard(out);
+            out << "_____________________________________________________" << std::endl;
+            out << "COMPARISON of " << container << " with the fastest container" << std::endl;
+
+            double log_sum = 0;
+            unsigned n = 0;
+            for (auto& r : m_results)
+            {
+                if (r.container != container)
+                    continue;
+
+                const result* best = &r;
+                for (auto& b : m_results)
+                {
+                    if (same_configuration(b, r) && b.ms.median < best->ms.median)
+                        best = &b;
+                }
+
+                double ratio = best->ms.median > 0 ? r.ms.median / best->ms.median : 1.0;
+                log_sum += std::log(ratio);
+                n++;
+
+                out << "  " << r.distribution << " length: " << r.length << " selection: " << r.selection << " " << r.phase;
+                if (r.phase == phase_name(summation))
+                    out << " x" << r.repeat;
+                out << ": " << r.ms.median << " ms, fastest: " << best->container << " " << best->ms.median << " ms (x" << ratio << ")" << std::endl;
+            }
+            if (n != 0)
+                out << "  geometric mean of the ratios: x" << std::exp(log_sum / n) << std::endl;
+        }
+
+        void write_csv(std::ostream& out) const
+        {
+            format_guard guard(out);
+            out << "container,distribution,probes,length,selection,density,repeat,phase,samples,mean_ms,median_ms,p99_ms,stddev_ms,min_ms,max_ms,ns_per_element,checksum";
+            for (int c = 0; c < counter_count; c++)
+            {
+                out << ',' << counter_name(c) << "_per_element";
+            }
+            out << std::endl;
+            for (auto& r : m_results)
+            {
+                out << r.container << ',' << r.distribution << ',' << r.probes << ',' << r.length << ',' << r.selection << ',' << (r.selection / (double)r.length) << ','
+                    << r.repeat << ',' << r.phase << ',' << r.samples << ','
+                    << r.ms.mean << ',' << r.ms.median << ',' << r.ms.p99 << ',' << r.ms.stddev << ',' << r.ms.min << ',' << r.ms.max << ','
+                    << per_element_ns(r) << ',' << r.checksum;
+                for (int c = 0; c < counter_count; c++)
+                {
+                    out << ',';
+                    if (r.counters_valid[c])
+                        out << r.counters[c];
+                }
+                out << std::endl;
+            }
+        }
+
+        void write_json(std::ostream& out) const
+        {
+            format_guard guard(out);
+            out << "[" << std::endl;
+            for (std::size_t i = 0; i < m_results.size(); i++)
+            {
+                const result& r = m_results[i];
+                out << "  { \"container\": \"" << escape(r.container) << "\", \"distribution\": \"" << r.distribution
+                    << "\", \"probes\": \"" << r.probes << "\", \"length\": " << r.length
+                    << ", \"selection\": " << r.selection << ", \"density\": " << (r.selection / (double)r.length)
+                    << ", \"repeat\": " << r.repeat << ", \"phase\": \"" << r.phase << "\", \"samples\": " << r.samples
+                    << ", \"mean_ms\": " << r.ms.mean << ", \"median_ms\": " << r.ms.median << ", \"p99_ms\": " << r.ms.p99
+                    << ", \"stddev_ms\": " << r.ms.stddev << ", \"min_ms\": " << r.ms.min << ", \"max_ms\": " << r.ms.max
+                    << ", \"ns_per_element\": " << per_element_ns(r) << ", \"checksum\": " << r.checksum;
+                for (int c = 0; c < counter_count; c++)
+                {
+                    out << ", \"" << counter_name(c) << "_per_element\": ";
+                    if (r.counters_valid[c])
+                        out << r.counters[c];
+                    else
+                        out << "null";
+                }
+                out << " }"
+                    << (i + 1 < m_results.size() ? "," : "") << std::endl;
+            }
+            out << "]" << std::endl;
+        }
+    };
+
+    ///------------------------------------
+    /// Container adapters
+    ///------------------------------------
+
+    ///
+    /// The operations the harness needs from a container. The primary template covers the sparse set interface
+    /// (insert, test, erase, count and ordered or unordered iteration); the other containers are specialised below.
+    ///
+    template <class Container>
+    struct container_traits
+    {
+        static unsigned max_length()
+        {
+            return 0xFFFFFFFF;
+        }
+
+        static void construct(std::unique_ptr<Container>& c, unsigned length)
+        {
+            c.reset(new Container(length));
+        }
+
+        static void insert(Container& c, unsigned x)
+        {
+            c.insert(x);
+        }
+
+        static bool test(const Container& c, unsigned x)
+        {
+            return c.test(x);
+        }
+
+        template <class F>
+        static void for_each(const Container& c, unsigned, F f)
+        {
+            for (typename Container::const_iterator it = c.begin(), itStop = c.end(); it != itStop; ++it)
+            {
+                f(*it);
+            }
+        }
+
+        static void erase(Container& c, unsigned x)
+        {
+            c.erase(x);
+        }
+
+        static std::size_t count(const Container& c, unsigned)
+        {
+            return c.count();
+        }
+    };
+
+    template <class T>
+    struct std_set_traits
+    {
+        typedef std::set<T> Container;
+
+        static unsigned max_length()
+        {
+            return 0xFFFFFFFF;
+        }
+
+        static void construct(std::unique_ptr<Container>& c, unsigned)
+        {
+            c.reset(new Container());
+        }
+
+        static void insert(Container& c, unsigned x)
+        {
+            c.insert(x);
+        }
+
+        static bool test(const Container& c, unsigned x)
+        {
+            return c.find(x) != c.end();
+        }
+
+        template <class F>
+        static void for_each(const Container& c, unsigned, F f)
+        {
+            for (auto p : c)
+            {
+                f(p);
+            }
+        }
+
+        static void erase(Container& c, unsigned x)
+        {
+            c.erase(x);
+        }
+
+        static std::size_t count(const Container& c, unsigned)
+        {
+            return c.size();
+        }
+    };
+
+    // a sequence of flags indexed by value: std::vector<bool>, std::vector<char>
+    template <class Container, typename Container::value_type Set, typename Container::value_type Unset>
+    struct flag_vector_traits
+    {
+        static unsigned max_length()
+        {
+            return 0xFFFFFFFF;
+        }
+
+        static void construct(std::unique_ptr<Container>& c, unsigned length)
+        {
+            c.reset(new Container(length));
+        }
+
+        static void insert(Container& c, unsigned x)
+        {
+            c[x] = Set;
+        }
+
+        static bool test(const Container& c, unsigned x)
+        {
+            return c[x] == Set;
+        }
+
+        template <class F>
+        static void for_each(const Container& c, unsigned, F f)
+        {
+            unsigned p = 0;
+            for (typename Container::const_iterator it = c.cbegin(), itStop = c.cend(); it != itStop; ++it)
+            {
+                if (*it == Set)
+                {
+                    f(p);
+                }
+                p++;
+            }
+        }
+
+        static void erase(Container& c, unsigned x)
+        {
+            c[x] = Unset;
+        }
+
+        static std::size_t count(const Container& c, unsigned)
+        {
+            std::size_t counter = 0;
+            for (auto x : c)
+            {
+                if (x == Set)
+                    counter++;
+            }
+            return counter;
+        }
+    };
+
+    template <std::size_t N>
+    struct bitset_traits
+    {
+        typedef std::bitset<N> Container;
+
+        static unsigned max_length()
+        {
+            return N;
+        }
+
+        static void construct(std::unique_ptr<Container>& c, unsigned)
+        {
+            c.reset(new Container());
+        }
+
+        static void insert(Container& c, unsigned x)
+        {
+            c[x] = true;
+        }
+
+        static bool test(const Container& c, unsigned x)
+        {
+            return c[x];
+        }
+
+        template <class F>
+        static void for_each(const Container& c, unsigned length, F f)
+        {
+            for (unsigned p = 0; p < length; p++)
+            {
+                if (c[p])
+                {
+                    f(p);
+                }
+            }
+        }
+
+        static void erase(Container& c, unsigned x)
+        {
+            c[x] = false;
+        }
+
+        static std::size_t count(const Container& c, unsigned)
+        {
+            return c.count();
+        }
+    };
+
+    ///
+    /// Maps from the elements to a payload of type T, which holds the element itself, so that the summation phase
+    /// (a scan of the payloads) gives the same checksum as for the sets: sparse_map<T> and std::unordered_map<unsigned, T>
+    ///
+    template <class Map>
+    struct sparse_map_traits : container_traits<Map>
+    {
+        typedef typename Map::mapped_type T;
+
+        static void insert(Map& c, unsigned x)
+        {
+            c[x] = T(x);
+        }
+
+        template <class F>
+        static void for_each(const Map& c, unsigned, F f)
+        {
+            for (const T& v : c.values())
+            {
+                f(static_cast<std::size_t>(v));
+            }
+        }
+    };
+
+    template <class T>
+    struct unordered_map_traits
+    {
+        typedef std::unordered_map<unsigned, T> Container;
+
+        static unsigned max_length()
+        {
+            return 0xFFFFFFFF;
+        }
+
+        static void construct(std::unique_ptr<Container>& c, unsigned)
+        {
+            c.reset(new Container());
+        }
+
+        static void insert(Container& c, unsigned x)
+        {
+            c[x] = T(x);
+        }
+
+        static bool test(const Container& c, unsigned x)
+        {
+            return c.find(x) != c.end();
+        }
+
+        template <class F>
+        static void for_each(const Container& c, unsigned, F f)
+        {
+            for (const auto& p : c)
+            {
+                f(static_cast<std::size_t>(p.second));
+            }
+        }
+
+        static void erase(Container& c, unsigned x)
+        {
+            c.erase(x);
+        }
+
+        static std::size_t count(const Container& c, unsigned)
+        {
+            return c.size();
+        }
+    };
+
+    ///------------------------------------
+    /// The benchmark
+    ///------------------------------------
+
+    ///
+    /// The input of one benchmark: the elements to insert, in insertion order, and the stream of probes
+    /// that the random access phase cycles through
+    ///
+    struct workload
+    {
+        std::string distribution;
+        std::string probe_distribution;
+        std::vector<unsigned> values;
+        std::vector<unsigned> probes;
+    };
+
+    // at most 4M probes are stored (16MB); longer random access phases go through them again
+    inline workload make_workload(const options& opt, distribution_type population, unsigned length, unsigned selection)
+    {
+        workload w;
+        distribution_type probes = probe_distribution(opt, population);
+        w.distribution = distribution_name(population);
+        w.probe_distribution = distribution_name(probes);
+
+        id_generator values(population, length, selection, opt.seed, opt.parameters);
+        w.values = populate(values, length, selection);
+
+        id_generator probe_ids(probes, length, selection, opt.seed ^ 0x9E3779B9u, opt.parameters);
+        w.probes = probe_stream(probe_ids, std::max<std::size_t>(1, std::min<std::size_t>(opt.steps, std::size_t(1) << 22)));
+        return w;
+    }
+
+    // the batched probes go to the container's test_batch if it has one, and to Traits::test one by one otherwise
+    template <class Traits, class Container>
+    auto test_batch(const Container& c, const unsigned* keys, std::size_t n, std::uint64_t* out_mask, int)
+        -> decltype(c.test_batch(keys, n, out_mask))
+    {
+        return c.test_batch(keys, n, out_mask);
+    }
+
+    template <class Traits, class Container>
+    std::size_t test_batch(const Container& c, const unsigned* keys, std::size_t n, std::uint64_t* out_mask, long)
+    {
+        std::size_t count = 0;
+        std::fill(out_mask, out_mask + (n + 63) / 64, std::uint64_t(0));
+        for (std::size_t j = 0; j < n; j++)
+        {
+            if (Traits::test(c, keys[j]))
+            {
+                out_mask[j / 64] |= std::uint64_t(1) << (j % 64);
+                count++;
+            }
+        }
+        return count;
+    }
+
+    template <class F>
+    phase_sample measure(F f, bool counters)
+    {
+        perf_counters& hw = hardware_counters();
+        if (counters)
+            hw.start();
+        clock::time_point t1 = clock::now();
+        f();
+        clock::time_point t2 = clock::now();
+
+        phase_sample s;
+        if (counters)
+        {
+            s.counters = hw.stop();
+        }
+        else
+        {
+            std::fill(s.counters.valid, s.counters.valid + counter_count, false);
+        }
+        s.ms = time_in_msec(t2 - t1).count();
+        return s;
+    }
+
+    inline double median(std::vector<double> values)
+    {
+        std::sort(values.begin(), values.end());
+        std::size_t n = values.size();
+        return n % 2 ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) / 2;
+    }
+
+    struct sample_set
+    {
+        std::vector<phase_sample> phases[phase_count];   // summation: one entry per sample and repeat
+        unsigned long long checksums[phase_count];
+        std::vector<unsigned long long> summation_checksums;
+        double summation_elements;
+        unsigned batch_mismatches = 0;                   // samples whose batched probes found another count of hits
+    };
+
+    // runs all the phases once; the summation phase is run for every repeat count in turn
+    template <class Traits, class Container>
+    void run_sample(const workload& w, unsigned length, const options& opt, sample_set& out)
+    {
+        const std::vector<unsigned>& values = w.values;
+        random_source random_uint;
+        std::unique_ptr<Container> test_set;
+
+        out.phases[generation].push_back(measure([&]()
+        {
+            Traits::construct(test_set, length);
+            for (auto x : values)
+            {
+                Traits::insert(*test_set, x);
+            }
+        }, opt.counters));
+        out.checksums[generation] = Traits::count(*test_set, length);
+
+        unsigned counter = 0;
+        out.phases[random_access].push_back(measure([&]()
+        {
+            const unsigned* probes = w.probes.data();
+            std::size_t probe_count = w.probes.size();
+            std::size_t j = 0;
+            for (unsigned i = 0; i < opt.steps; ++i)
+            {
+                if (Traits::test(*test_set, probes[j]))
+                {
+                    counter++;
+                }
+                if (++j == probe_count)
+                    j = 0;
+            }
+        }, opt.counters));
+        out.checksums[random_access] = counter;
+
+        if (opt.batch != 0)
+        {
+            // the same probes as the random access phase, in batches that do not wrap around the probe stream
+            std::vector<std::uint64_t> mask((opt.batch + 63) / 64);
+            unsigned long long batched_counter = 0;
+            out.phases[batched_random_access].push_back(measure([&]()
+            {
+                const unsigned* probes = w.probes.data();
+                std::size_t probe_count = w.probes.size();
+                std::size_t j = 0;
+                for (std::size_t i = 0; i < opt.steps; )
+                {
+                    std::size_t n = std::min<std::size_t>(std::min<std::size_t>(opt.batch, opt.steps - i), probe_count - j);
+                    batched_counter += test_batch<Traits>(*test_set, probes + j, n, mask.data(), 0);
+                    i += n;
+                    j += n;
+                    if (j == probe_count)
+                        j = 0;
+                }
+            }, opt.counters));
+            out.checksums[batched_random_access] = batched_counter;
+            out.batch_mismatches += batched_counter != counter;
+        }
+
+        out.summation_checksums.clear();
+        for (auto repeat : opt.repeats)
+        {
+            random_uint.reset();
+            double sum = 0;
+            unsigned long long counter2 = 0;
+            phase_sample s = measure([&]()
+            {
+                for (unsigned k = 0; k < repeat; k++)
+                {
+                    Traits::for_each(*test_set, length, [&](std::size_t p)
+                    {
+                        double coeff = random_uint();
+                        sum += p * coeff;
+                        counter2++;
+                    });
+                }
+            }, opt.counters);
+            s.ms /= repeat != 0 ? repeat : 1;
+            for (int c = 0; c < counter_count; c++)
+            {
+                s.counters.value[c] /= repeat != 0 ? repeat : 1;
+            }
+            out.phases[summation].push_back(s);
+            out.summation_checksums.push_back(repeat != 0 ? counter2 / repeat : 0);
+            out.summation_elements = static_cast<double>(repeat != 0 ? counter2 / repeat : 0);
+        }
+
+        out.phases[deletion].push_back(measure([&]()
+        {
+            for (auto x : values)
+            {
+                Traits::erase(*test_set, x);
+            }
+        }, opt.counters));
+        out.checksums[deletion] = Traits::count(*test_set, length);
+    }
+
+    template <class Container, class Traits = container_traits<Container> >
+    void run(const std::string& name, const workload& w, unsigned length, const options& opt, report& rep, std::ostream* text)
+    {
+        const std::vector<unsigned>& values = w.values;
+        if (length > Traits::max_length())
+            return;
+
+        if (text != nullptr)
+        {
+            *text << "_____________________________________________________" << std::endl;
+            *text << name << ". length: " << length << " selection: " << values.size()
+                << " density: " << (values.size() / (double)length * 100.0) << "%"
+                << " distribution: " << w.distribution << " probes: " << w.probe_distribution << std::endl;
+        }
+
+        sample_set discarded;
+        for (unsigned i = 0; i < opt.warmup; i++)
+        {
+            run_sample<Traits, Container>(w, length, opt, discarded);
+        }
+
+        sample_set samples;
+        for (unsigned i = 0; i < opt.samples; i++)
+        {
+            run_sample<Traits, Container>(w, length, opt, samples);
+        }
+        if (samples.batch_mismatches != 0)
+        {
+            std::cerr << name << ": the batched probes found " << samples.checksums[batched_random_access]
+                << " elements, against " << samples.checksums[random_access] << " one at a time, in "
+                << samples.batch_mismatches << " of " << opt.samples << " samples" << std::endl;
+        }
+
+        for (int phase = 0; phase < phase_count; phase++)
+        {
+            if (phase == batched_random_access && opt.batch == 0)
+                continue;
+
+            std::size_t runs = phase == summation ? opt.repeats.size() : 1;
+            for (std::size_t k = 0; k < runs; k++)
+            {
+                std::vector<double> ms;
+                std::vector<double> counts[counter_count];
+                for (std::size_t i = k; i < samples.phases[phase].size(); i += runs)
+                {
+                    const phase_sample& s = samples.phases[phase][i];
+                    ms.push_back(s.ms);
+                    for (int c = 0; c < counter_count; c++)
+                    {
+                        if (s.counters.valid[c])
+                            counts[c].push_back(s.counters.value[c]);
+                    }
+                }
+
+                result r;
+                r.container = name;
+                r.distribution = w.distribution;
+                r.probes = w.probe_distribution;
+                r.length = length;
+                r.selection = static_cast<unsigned>(values.size());
+                r.repeat = phase == summation ? opt.repeats[k] : 1;
+                r.phase = phase_name(phase);
+                r.samples = opt.samples;
+                r.ms = statistics::of(ms);
+                r.operations = phase == random_access || phase == batched_random_access ? opt.steps : phase == summation ? samples.summation_elements : values.size();
+                r.checksum = phase == summation ? samples.summation_checksums[k] : samples.checksums[phase];
+                for (int c = 0; c < counter_count; c++)
+                {
+                    // a counter is only reported if it was read in every sample
+                    r.counters_valid[c] = counts[c].size() == ms.size() && r.operations > 0;
+                    r.counters[c] = r.counters_valid[c] ? median(counts[c]) / r.operations : 0.0;
+                }
+                rep.add(r);
+
+                if (text != nullptr)
+                    report::write_text(*text, r);
+            }
+        }
+    }
+
+    ///
+    /// An entry in the table of containers that can be selected from the command line
+    ///
+    struct container_entry
+    {
+        const char* name;
+        bool run_by_default;
+        void(*run)(const std::string& name, const workload& w, unsigned length, const options& opt, report& rep, std::ostream* text);
+    };
+} // benchmark
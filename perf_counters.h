@@ -0,0 +1,195 @@
+
+// <summary>Contains access to the hardware performance counters (Linux perf_event_open) for the benchmarks</summary>
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#endif
+
+namespace benchmark
+{
+    enum counter_type
+    {
+        counter_cycles,
+        counter_instructions,
+        counter_l1d_misses,
+        counter_llc_misses,
+        counter_dtlb_misses,
+        counter_branch_misses,
+        counter_count
+    };
+
+    inline const char* counter_name(int counter)
+    {
+        static const char* names[] = { "cycles", "instructions", "l1d_misses", "llc_misses", "dtlb_misses", "branch_misses" };
+        return names[counter];
+    }
+
+    struct counter_values
+    {
+        double value[counter_count];
+        bool valid[counter_count];
+    };
+
+    ///
+    /// A set of counters for the calling thread, each opened on its own so that the ones the CPU, the kernel or
+    /// the virtual machine does not provide (or perf_event_paranoid forbids) are simply reported as invalid.
+    /// When the kernel has to multiplex the counters, the values are scaled by the time each one was running.
+    ///
+    class perf_counters
+    {
+        struct reading
+        {
+            std::uint64_t value;
+            std::uint64_t time_enabled;
+            std::uint64_t time_running;
+        };
+
+        int m_fd[counter_count];
+        reading m_start[counter_count];
+
+#if defined(__linux__)
+        static int open_counter(std::uint32_t type, std::uint64_t config)
+        {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = type;
+            attr.config = config;
+            attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            return static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+        }
+
+        static std::uint64_t cache_event(std::uint64_t cache, std::uint64_t op, std::uint64_t result)
+        {
+            return cache | (op << 8) | (result << 16);
+        }
+#endif
+
+        bool read_counter(int counter, reading& r) const
+        {
+#if defined(__linux__)
+            return m_fd[counter] >= 0 && ::read(m_fd[counter], &r, sizeof(r)) == static_cast<ssize_t>(sizeof(r));
+#else
+            (void)counter;
+            (void)r;
+            return false;
+#endif
+        }
+
+    public:
+        perf_counters()
+        {
+            for (int c = 0; c < counter_count; c++)
+            {
+                m_fd[c] = -1;
+                m_start[c] = reading{ 0, 0, 0 };
+            }
+        }
+
+        perf_counters(const perf_counters&) = delete;
+        perf_counters& operator=(const perf_counters&) = delete;
+
+        ~perf_counters()
+        {
+            close();
+        }
+
+        // returns true if at least one counter could be opened
+        bool open()
+        {
+            close();
+#if defined(__linux__)
+            m_fd[counter_cycles] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+            m_fd[counter_instructions] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+            m_fd[counter_l1d_misses] = open_counter(PERF_TYPE_HW_CACHE,
+                cache_event(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS));
+            m_fd[counter_llc_misses] = open_counter(PERF_TYPE_HW_CACHE,
+                cache_event(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS));
+            m_fd[counter_dtlb_misses] = open_counter(PERF_TYPE_HW_CACHE,
+                cache_event(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS));
+            m_fd[counter_branch_misses] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+#endif
+            return any_available();
+        }
+
+        void close()
+        {
+            for (int c = 0; c < counter_count; c++)
+            {
+#if defined(__linux__)
+                if (m_fd[c] >= 0)
+                    ::close(m_fd[c]);
+#endif
+                m_fd[c] = -1;
+            }
+        }
+
+        bool available(int counter) const
+        {
+            return m_fd[counter] >= 0;
+        }
+
+        bool any_available() const
+        {
+            for (int c = 0; c < counter_count; c++)
+            {
+                if (available(c))
+                    return true;
+            }
+            return false;
+        }
+
+        void start()
+        {
+            for (int c = 0; c < counter_count; c++)
+            {
+                if (!read_counter(c, m_start[c]))
+                    m_start[c] = reading{ 0, 0, 0 };
+            }
+        }
+
+        // the counts since start()
+        counter_values stop() const
+        {
+            counter_values v;
+            for (int c = 0; c < counter_count; c++)
+            {
+                reading r;
+                v.value[c] = 0;
+                v.valid[c] = false;
+                if (!read_counter(c, r))
+                    continue;
+
+                std::uint64_t enabled = r.time_enabled - m_start[c].time_enabled;
+                std::uint64_t running = r.time_running - m_start[c].time_running;
+                if (running == 0)
+                    continue;
+
+                v.value[c] = static_cast<double>(r.value - m_start[c].value);
+                if (running < enabled)
+                    v.value[c] *= static_cast<double>(enabled) / running;
+                v.valid[c] = true;
+            }
+            return v;
+        }
+    };
+
+    // the counters shared by all the measurements; opened on first use
+    inline perf_counters& hardware_counters()
+    {
+        static perf_counters counters;
+        static bool opened = counters.open();
+        (void)opened;
+        return counters;
+    }
+} // benchmark
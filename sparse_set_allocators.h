@@ -0,0 +1,310 @@
+
+// <summary>Contains cache-line aligned, huge page and arena allocators for the sparse set containers</summary>
+
+#pragma once
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstdint>
+#include <new>
+#include <vector>
+#include <algorithm>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+#if defined(_WIN32)
+#include <malloc.h>
+#endif
+
+namespace memory
+{
+    static constexpr std::size_t cache_line_size = 64;
+    static constexpr std::size_t huge_page_size = 2 * 1024 * 1024;
+
+    inline bool uses_huge_pages(std::size_t bytes, bool huge_pages)
+    {
+#if defined(__linux__)
+        return huge_pages && bytes >= huge_page_size;
+#else
+        (void)bytes;
+        (void)huge_pages;
+        return false;
+#endif
+    }
+
+    inline std::size_t round_up(std::size_t bytes, std::size_t alignment)
+    {
+        return (bytes + alignment - 1) & ~(alignment - 1);
+    }
+
+    ///
+    /// Allocates a block aligned to a cache line. When huge_pages is set, blocks of at least huge_page_size
+    /// are mapped separately, aligned to a huge page and advised to use transparent huge pages (Linux only;
+    /// elsewhere they are ordinary aligned blocks). Returns nullptr on failure.
+    ///
+    inline void* allocate_aligned(std::size_t bytes, bool huge_pages)
+    {
+        if (bytes == 0)
+            bytes = 1;
+
+#if defined(__linux__)
+        if (uses_huge_pages(bytes, huge_pages))
+        {
+            std::size_t size = round_up(bytes, huge_page_size);
+            void* p = mmap(nullptr, size + huge_page_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (p == MAP_FAILED)
+                return nullptr;
+
+            // trim the mapping so that it starts and ends on a huge page boundary
+            std::uintptr_t start = reinterpret_cast<std::uintptr_t>(p);
+            std::uintptr_t aligned = round_up(start, huge_page_size);
+            if (aligned != start)
+                munmap(p, aligned - start);
+            if (huge_page_size - (aligned - start) != 0)
+                munmap(reinterpret_cast<void*>(aligned + size), huge_page_size - (aligned - start));
+
+            madvise(reinterpret_cast<void*>(aligned), size, MADV_HUGEPAGE);
+            return reinterpret_cast<void*>(aligned);
+        }
+#endif
+
+#if defined(_WIN32)
+        return _aligned_malloc(round_up(bytes, cache_line_size), cache_line_size);
+#else
+        void* p = nullptr;
+        if (posix_memalign(&p, cache_line_size, round_up(bytes, cache_line_size)) != 0)
+            return nullptr;
+        return p;
+#endif
+    }
+
+    // bytes and huge_pages must be the same as in the allocate_aligned call
+    inline void deallocate_aligned(void* p, std::size_t bytes, bool huge_pages)
+    {
+        if (p == nullptr)
+            return;
+
+#if defined(__linux__)
+        if (uses_huge_pages(bytes == 0 ? 1 : bytes, huge_pages))
+        {
+            munmap(p, round_up(bytes, huge_page_size));
+            return;
+        }
+#else
+        (void)bytes;
+        (void)huge_pages;
+#endif
+
+#if defined(_WIN32)
+        _aligned_free(p);
+#else
+        std::free(p);
+#endif
+    }
+} // memory
+
+///
+/// A stateless allocator that aligns every block to a cache line (64 bytes), so that word arrays can be
+/// used with aligned SIMD loads. With HugePages set, large arrays (2MB or more) are backed by transparent huge pages,
+/// which reduces TLB misses in random access over long intervals.
+///
+template <class T, bool HugePages = false>
+class cache_aligned_allocator
+{
+public:
+    typedef T value_type;
+    typedef std::size_t size_type;
+    typedef std::ptrdiff_t difference_type;
+
+    template <class U>
+    struct rebind
+    {
+        typedef cache_aligned_allocator<U, HugePages> other;
+    };
+
+    cache_aligned_allocator() {}
+
+    template <class U>
+    cache_aligned_allocator(const cache_aligned_allocator<U, HugePages>&) {}
+
+    T* allocate(std::size_t n)
+    {
+        void* p = memory::allocate_aligned(n * sizeof(T), HugePages);
+        if (p == nullptr)
+            throw std::bad_alloc();
+        return static_cast<T*>(p);
+    }
+
+    void deallocate(T* p, std::size_t n)
+    {
+        memory::deallocate_aligned(p, n * sizeof(T), HugePages);
+    }
+
+    template <class U>
+    bool operator==(const cache_aligned_allocator<U, HugePages>&) const
+    {
+        return true;
+    }
+
+    template <class U>
+    bool operator!=(const cache_aligned_allocator<U, HugePages>&) const
+    {
+        return false;
+    }
+};
+
+template <class T>
+using huge_page_allocator = cache_aligned_allocator<T, true>;
+
+///
+/// A pool of memory for many small containers: blocks are carved out of large chunks with cache-line alignment
+/// and are only returned to the system when the arena is reset or destroyed. Blocks larger than half a chunk
+/// are allocated individually (on huge pages if requested) and released as soon as they are deallocated.
+/// The arena is not thread safe.
+///
+class arena
+{
+    struct block
+    {
+        void* address;
+        std::size_t bytes;
+    };
+
+    std::size_t m_chunk_size;
+    bool m_huge_pages;
+    std::vector<block> m_chunks;
+    std::vector<block> m_large_blocks;
+    char* m_current;
+    std::size_t m_remaining;
+
+    void release()
+    {
+        for (auto& b : m_chunks)
+        {
+            memory::deallocate_aligned(b.address, b.bytes, m_huge_pages);
+        }
+        for (auto& b : m_large_blocks)
+        {
+            memory::deallocate_aligned(b.address, b.bytes, m_huge_pages);
+        }
+        m_chunks.clear();
+        m_large_blocks.clear();
+        m_current = nullptr;
+        m_remaining = 0;
+    }
+
+public:
+    arena(std::size_t chunk_size = memory::huge_page_size, bool huge_pages = true)
+        : m_chunk_size(memory::round_up(std::max(chunk_size, memory::cache_line_size), memory::cache_line_size)),
+        m_huge_pages(huge_pages), m_chunks(), m_large_blocks(), m_current(nullptr), m_remaining(0)
+    {
+    }
+
+    arena(const arena&) = delete;
+    arena& operator=(const arena&) = delete;
+
+    ~arena()
+    {
+        release();
+    }
+
+    void* allocate(std::size_t bytes)
+    {
+        bytes = memory::round_up(bytes == 0 ? 1 : bytes, memory::cache_line_size);
+
+        if (bytes > m_chunk_size / 2)
+        {
+            void* p = memory::allocate_aligned(bytes, m_huge_pages);
+            if (p == nullptr)
+                throw std::bad_alloc();
+            m_large_blocks.push_back(block{ p, bytes });
+            return p;
+        }
+
+        if (bytes > m_remaining)
+        {
+            void* p = memory::allocate_aligned(m_chunk_size, m_huge_pages);
+            if (p == nullptr)
+                throw std::bad_alloc();
+            m_chunks.push_back(block{ p, m_chunk_size });
+            m_current = static_cast<char*>(p);
+            m_remaining = m_chunk_size;
+        }
+
+        void* p = m_current;
+        m_current += bytes;
+        m_remaining -= bytes;
+        return p;
+    }
+
+    void deallocate(void* p, std::size_t bytes)
+    {
+        bytes = memory::round_up(bytes == 0 ? 1 : bytes, memory::cache_line_size);
+        if (bytes <= m_chunk_size / 2)
+            return;
+
+        for (auto it = m_large_blocks.begin(); it != m_large_blocks.end(); ++it)
+        {
+            if (it->address == p)
+            {
+                memory::deallocate_aligned(it->address, it->bytes, m_huge_pages);
+                *it = m_large_blocks.back();
+                m_large_blocks.pop_back();
+                return;
+            }
+        }
+    }
+
+    // releases all the memory; every container using the arena must have been destroyed
+    void reset()
+    {
+        release();
+    }
+
+    std::size_t chunk_count() const
+    {
+        return m_chunks.size();
+    }
+};
+
+template <class T>
+class arena_allocator
+{
+    template <class U> friend class arena_allocator;
+
+    arena* m_arena;
+
+public:
+    typedef T value_type;
+    typedef std::size_t size_type;
+    typedef std::ptrdiff_t difference_type;
+
+    arena_allocator(arena& a) : m_arena(&a) {}
+
+    template <class U>
+    arena_allocator(const arena_allocator<U>& a) : m_arena(a.m_arena) {}
+
+    T* allocate(std::size_t n)
+    {
+        return static_cast<T*>(m_arena->allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, std::size_t n)
+    {
+        m_arena->deallocate(p, n * sizeof(T));
+    }
+
+    template <class U>
+    bool operator==(const arena_allocator<U>& y) const
+    {
+        return m_arena == y.m_arena;
+    }
+
+    template <class U>
+    bool operator!=(const arena_allocator<U>& y) const
+    {
+        return m_arena != y.m_arena;
+    }
+};
@@ -0,0 +1,441 @@
+
+// <summary>Contains an immutable, compact snapshot of a set for read-only serving, with freeze and thaw</summary>
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+#include "sparse_sets.h"
+
+///
+/// Frozen format: a sequence of 64-bit words in host byte order, which can be written to a file as it is and used
+/// from a memory mapping.
+///
+///   word 0:  frozen_format::magic
+///   word 1:  the representation: frozen_format::bitmap or frozen_format::sorted_array
+///   word 2:  the universe size
+///   word 3:  the number of elements
+///   then the payload:
+///     bitmap        (size + 63) / 64 words of bits, followed by the rank index: for every block of 8 words,
+///                   the number of elements before the block as a 32-bit count, two counts per word
+///     sorted_array  the elements in increasing order as 32-bit values, two values per word
+///
+/// freeze() picks the smaller representation; the sorted array needs a universe of at most 2^32.
+///
+struct frozen_format
+{
+    typedef std::uint64_t word_type;
+
+    static constexpr word_type magic = 0x315A4F5246535053; // "SPSFROZ1"
+    static constexpr word_type bitmap = 0;
+    static constexpr word_type sorted_array = 1;
+    static constexpr std::size_t header_words = 4;
+    static constexpr unsigned word_bits = 64;
+    static constexpr std::size_t rank_block_words = 8;
+
+    static std::size_t bitmap_words(std::size_t size)
+    {
+        return (size + word_bits - 1) / word_bits;
+    }
+
+    static std::size_t rank_counts(std::size_t size)
+    {
+        return (bitmap_words(size) + rank_block_words - 1) / rank_block_words;
+    }
+
+    // the payload words of each representation
+    static std::size_t bitmap_payload(std::size_t size)
+    {
+        return bitmap_words(size) + (rank_counts(size) + 1) / 2;
+    }
+
+    static std::size_t sorted_array_payload(std::size_t count)
+    {
+        return (count + 1) / 2;
+    }
+};
+
+namespace bits
+{
+    inline unsigned popcount64(std::uint64_t x)
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        return static_cast<unsigned>(__builtin_popcountll(x));
+#else
+        return count_bits(x);
+#endif
+    }
+} // bits
+
+///
+/// Frozen set: an immutable set, either a bitmap with a rank index or a sorted array of 32-bit values, held in one
+/// contiguous buffer in the frozen format. The set owns its buffer (when built by freeze() or from a buffer) or views
+/// memory it does not own (for example a memory-mapped file), which must outlive it. Nothing is modified by the
+/// const methods, so a frozen set can be shared between threads without locking. test() has no data-dependent
+/// branches: a bit extraction for the bitmap, a binary search with conditional moves for the sorted array.
+///
+template <class Allocator = std::allocator<std::size_t> >
+class basic_frozen_set
+{
+public:
+    typedef frozen_format::word_type word_type;
+    typedef std::size_t value_type;
+    typedef std::size_t size_type;
+    typedef Allocator allocator_type;
+    typedef bits::value_range_iterator<word_type, std::uint32_t> iterator;
+    typedef iterator const_iterator;
+    typedef std::vector<word_type, typename std::allocator_traits<Allocator>::template rebind_alloc<word_type> > buffer_type;
+
+    enum representation_type { bitmap, sorted_array };
+
+private:
+    buffer_type m_buffer;          // empty for a view
+    const word_type* m_data;
+    std::size_t m_data_size;
+
+    representation_type m_representation;
+    std::size_t m_size;
+    std::size_t m_count;
+    const word_type* m_words;      // bitmap
+    const std::uint32_t* m_rank;
+    const std::uint32_t* m_values; // sorted array
+
+    void reset_header()
+    {
+        m_data = nullptr;
+        m_data_size = 0;
+        m_representation = bitmap;
+        m_size = 0;
+        m_count = 0;
+        m_words = nullptr;
+        m_rank = nullptr;
+        m_values = nullptr;
+    }
+
+    // reads the header; an invalid buffer leaves an empty set
+    bool attach(const word_type* data, std::size_t size)
+    {
+        reset_header();
+        if (data == nullptr || size < frozen_format::header_words || data[0] != frozen_format::magic)
+            return false;
+
+        std::size_t universe = static_cast<std::size_t>(data[2]);
+        std::size_t count = static_cast<std::size_t>(data[3]);
+        const word_type* payload = data + frozen_format::header_words;
+        std::size_t payload_size = size - frozen_format::header_words;
+
+        if (data[1] == frozen_format::bitmap && payload_size >= frozen_format::bitmap_payload(universe) && count <= universe)
+        {
+            m_representation = bitmap;
+            m_words = payload;
+            m_rank = reinterpret_cast<const std::uint32_t*>(payload + frozen_format::bitmap_words(universe));
+        }
+        else if (data[1] == frozen_format::sorted_array && payload_size >= frozen_format::sorted_array_payload(count) && count <= universe)
+        {
+            m_representation = sorted_array;
+            m_values = reinterpret_cast<const std::uint32_t*>(payload);
+        }
+        else
+        {
+            return false;
+        }
+
+        m_data = data;
+        m_data_size = size;
+        m_size = universe;
+        m_count = count;
+        return true;
+    }
+
+    // the last element <= i in the sorted array, or the first element if all are greater; the array must not be empty
+    const std::uint32_t* search(std::size_t i) const
+    {
+        const std::uint32_t* base = m_values;
+        std::size_t n = m_count;
+        while (n > 1)
+        {
+            std::size_t half = n / 2;
+            base = base[half] <= i ? base + half : base;
+            n -= half;
+        }
+        return base;
+    }
+
+    // the position of the first element >= i in the sorted array
+    std::size_t lower_bound_index(std::size_t i) const
+    {
+        if (m_count == 0)
+            return 0;
+        const std::uint32_t* base = search(i);
+        return static_cast<std::size_t>(base - m_values) + (*base < i);
+    }
+
+public:
+    basic_frozen_set(const Allocator& alloc = Allocator()) : m_buffer(typename buffer_type::allocator_type(alloc))
+    {
+        reset_header();
+    }
+
+    // a view over a buffer in the frozen format, which is not copied; valid() tells if it was recognised
+    basic_frozen_set(const word_type* data, std::size_t size, const Allocator& alloc = Allocator())
+        : m_buffer(typename buffer_type::allocator_type(alloc))
+    {
+        attach(data, size);
+    }
+
+    // takes over a buffer in the frozen format
+    explicit basic_frozen_set(buffer_type&& buffer) : m_buffer(std::move(buffer))
+    {
+        if (!attach(m_buffer.data(), m_buffer.size()))
+            m_buffer.clear();
+    }
+
+    ///
+    /// Builds a frozen set of the given universe size from count elements in increasing order, in the smaller
+    /// representation. Throws std::length_error if the elements cannot be counted in 32 bits.
+    ///
+    basic_frozen_set(std::size_t size, const std::size_t* sorted_values, std::size_t count, const Allocator& alloc = Allocator())
+        : m_buffer(typename buffer_type::allocator_type(alloc))
+    {
+        reset_header();
+        if (count > 0xFFFFFFFFu)
+            throw std::length_error("frozen_set: too many elements");
+
+        std::size_t bitmap_payload = frozen_format::bitmap_payload(size);
+        bool sorted = size <= 0x100000000ull && frozen_format::sorted_array_payload(count) < bitmap_payload;
+        m_buffer.assign(frozen_format::header_words + (sorted ? frozen_format::sorted_array_payload(count) : bitmap_payload), word_type(0));
+
+        m_buffer[0] = frozen_format::magic;
+        m_buffer[1] = sorted ? frozen_format::sorted_array : frozen_format::bitmap;
+        m_buffer[2] = size;
+        m_buffer[3] = count;
+        word_type* payload = m_buffer.data() + frozen_format::header_words;
+
+        if (sorted)
+        {
+            std::uint32_t* values = reinterpret_cast<std::uint32_t*>(payload);
+            for (std::size_t k = 0; k < count; k++)
+            {
+                values[k] = static_cast<std::uint32_t>(sorted_values[k]);
+            }
+        }
+        else
+        {
+            for (std::size_t k = 0; k < count; k++)
+            {
+                payload[sorted_values[k] / frozen_format::word_bits] |= word_type(1) << (sorted_values[k] % frozen_format::word_bits);
+            }
+
+            std::uint32_t* rank = reinterpret_cast<std::uint32_t*>(payload + frozen_format::bitmap_words(size));
+            std::uint32_t ones = 0;
+            for (std::size_t w = 0, wStop = frozen_format::bitmap_words(size); w < wStop; w++)
+            {
+                if (w % frozen_format::rank_block_words == 0)
+                    rank[w / frozen_format::rank_block_words] = ones;
+                ones += bits::popcount64(payload[w]);
+            }
+        }
+        attach(m_buffer.data(), m_buffer.size());
+    }
+
+    basic_frozen_set(const basic_frozen_set& s) : m_buffer(s.m_buffer)
+    {
+        if (m_buffer.empty())
+            attach(s.m_data, s.m_data_size);
+        else
+            attach(m_buffer.data(), m_buffer.size());
+    }
+
+    basic_frozen_set(basic_frozen_set&& s) : m_buffer(std::move(s.m_buffer))
+    {
+        if (m_buffer.empty())
+            attach(s.m_data, s.m_data_size);
+        else
+            attach(m_buffer.data(), m_buffer.size());
+        s.reset_header();
+    }
+
+    basic_frozen_set& operator=(basic_frozen_set s)
+    {
+        swap(s);
+        return *this;
+    }
+
+    void swap(basic_frozen_set& s)
+    {
+        bool owned = !m_buffer.empty();
+        bool s_owned = !s.m_buffer.empty();
+        const word_type* data = m_data;
+        std::size_t data_size = m_data_size;
+
+        m_buffer.swap(s.m_buffer);
+        if (s_owned)
+            attach(m_buffer.data(), m_buffer.size());
+        else
+            attach(s.m_data, s.m_data_size);
+        if (owned)
+            s.attach(s.m_buffer.data(), s.m_buffer.size());
+        else
+            s.attach(data, data_size);
+    }
+
+    // false if the set was made from a buffer that is not in the frozen format
+    bool valid() const
+    {
+        return m_data != nullptr;
+    }
+
+    bool test(std::size_t i) const
+    {
+        if (m_representation == bitmap)
+            return ((m_words[i / frozen_format::word_bits] >> (i % frozen_format::word_bits)) & 1) != 0;
+
+        return m_count != 0 && *search(i) == i;
+    }
+
+    // the number of elements less than i
+    std::size_t rank(std::size_t i) const
+    {
+        if (m_representation == sorted_array)
+            return lower_bound_index(i);
+        if (i >= m_size)
+            return m_count;
+
+        std::size_t w = i / frozen_format::word_bits;
+        std::size_t r = m_rank[w / frozen_format::rank_block_words];
+        for (std::size_t k = w - w % frozen_format::rank_block_words; k < w; k++)
+        {
+            r += bits::popcount64(m_words[k]);
+        }
+        word_type below = (word_type(1) << (i % frozen_format::word_bits)) - 1;
+        return r + bits::popcount64(m_words[w] & below);
+    }
+
+    // the number of elements in [first, last)
+    std::size_t count(std::size_t first, std::size_t last) const
+    {
+        return first < last ? rank(last) - rank(first) : 0;
+    }
+
+    std::size_t size() const
+    {
+        return m_size;
+    }
+
+    std::size_t count() const
+    {
+        return m_count;
+    }
+
+    bool empty() const
+    {
+        return m_count == 0;
+    }
+
+    iterator begin() const
+    {
+        if (m_representation == sorted_array)
+            return iterator(m_values, m_values + m_count);
+        return iterator(m_words, 0, m_size);
+    }
+
+    iterator end() const
+    {
+        return iterator();
+    }
+
+    iterator lower_bound(std::size_t i) const
+    {
+        if (m_representation == sorted_array)
+            return iterator(m_values + lower_bound_index(i), m_values + m_count);
+        return iterator(m_words, i, m_size);
+    }
+
+    iterator upper_bound(std::size_t i) const
+    {
+        return lower_bound(i + 1);
+    }
+
+    ///------------------------------------
+    /// Buffer
+    ///------------------------------------
+
+    representation_type representation() const
+    {
+        return m_representation;
+    }
+
+    // the bit array of the bitmap representation (size() bits), or nullptr
+    const word_type* words() const
+    {
+        return m_words;
+    }
+
+    // the values of the sorted array representation (count() of them), or nullptr
+    const std::uint32_t* values() const
+    {
+        return m_values;
+    }
+
+    // the buffer in the frozen format, to be written out as it is
+    const word_type* data() const
+    {
+        return m_data;
+    }
+
+    std::size_t data_size() const
+    {
+        return m_data_size;
+    }
+
+    std::size_t memory_usage() const
+    {
+        return m_data_size * sizeof(word_type);
+    }
+};
+
+typedef basic_frozen_set<> frozen_set;
+
+///
+/// Builds a frozen set from any set with size() and forward iteration; unordered sets are sorted first
+///
+template <class Set>
+frozen_set freeze(const Set& s)
+{
+    std::vector<std::size_t> values;
+    values.reserve(s.count());
+    for (auto x : s)
+    {
+        values.push_back(x);
+    }
+    if (!std::is_sorted(values.begin(), values.end()))
+        std::sort(values.begin(), values.end());
+    return frozen_set(s.size(), values.data(), values.size());
+}
+
+// replaces the contents of s with those of the frozen set
+template <class Set, class Allocator>
+void thaw(const basic_frozen_set<Allocator>& f, Set& s)
+{
+    s.resize(f.size());
+    s.clear();
+    for (auto x : f)
+    {
+        s.insert(x);
+    }
+}
+
+template <class Set, class Allocator>
+Set thaw(const basic_frozen_set<Allocator>& f)
+{
+    Set s(f.size());
+    for (auto x : f)
+    {
+        s.insert(x);
+    }
+    return s;
+}
@@ -0,0 +1,150 @@
+
+// <summary>Contains hashed_set, a set that keeps the hash of its elements up to date, for hash-consing and dedup caches</summary>
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+
+#include "sparse_sets.h"
+
+///
+/// A bounded set or sparse set with its hash (see basic_bounded_set::hash) kept up to date: an insertion or an erasure
+/// that takes effect replaces the share of one word in the hash, so hash() is O(1) rather than O(size() / 64). Two
+/// hashed sets are compared by hash first and by words only if the hashes agree, so sets that differ are usually told
+/// apart in O(1); as keys of an std::unordered_set or map they deduplicate equal sets (hash-consing).
+///
+template <class Set = bounded_set>
+class hashed_set
+{
+public:
+    typedef Set set_type;
+    typedef std::size_t value_type;
+    typedef std::size_t key_type;
+    typedef typename Set::const_iterator iterator;
+    typedef iterator const_iterator;
+
+private:
+    Set m_set;
+    std::uint64_t m_hash;
+
+    // the share of the word holding x is replaced after a change to x
+    void update(std::size_t x, typename Set::word_type before)
+    {
+        std::size_t k = x / Set::word_bits;
+        m_hash ^= bits::hash_word(k, before) ^ bits::hash_word(k, m_set.words()[k]);
+    }
+
+public:
+    hashed_set(std::size_t size) : m_set(size), m_hash(0)
+    {
+    }
+
+    // a copy of s, whose hash is computed once
+    explicit hashed_set(const Set& s) : m_set(s), m_hash(s.hash())
+    {
+    }
+
+    bool insert(std::size_t x)
+    {
+        typename Set::word_type before = m_set.words()[x / Set::word_bits];
+        if (!m_set.insert(x))
+            return false;
+        update(x, before);
+        return true;
+    }
+
+    void erase(std::size_t x)
+    {
+        typename Set::word_type before = m_set.words()[x / Set::word_bits];
+        if (before == 0)
+            return;
+        m_set.erase(x);
+        update(x, before);
+    }
+
+    bool test(std::size_t x) const
+    {
+        return m_set.test(x);
+    }
+
+    void clear()
+    {
+        m_set.clear();
+        m_hash = 0;
+    }
+
+    std::size_t size() const
+    {
+        return m_set.size();
+    }
+
+    std::size_t count() const
+    {
+        return m_set.count();
+    }
+
+    iterator begin() const
+    {
+        return m_set.begin();
+    }
+
+    iterator end() const
+    {
+        return m_set.end();
+    }
+
+    // the set itself, for reading
+    const Set& set() const
+    {
+        return m_set;
+    }
+
+    // the hash of the elements, equal to set().hash()
+    std::uint64_t hash() const
+    {
+        return m_hash;
+    }
+
+    template <class OtherSet>
+    bool equals(const hashed_set<OtherSet>& s) const
+    {
+        return m_hash == s.hash() && m_set.equals(s.set());
+    }
+
+    template <class OtherSet>
+    bool is_subset_of(const hashed_set<OtherSet>& s) const
+    {
+        return m_set.is_subset_of(s.set());
+    }
+
+    template <class OtherSet>
+    bool intersects(const hashed_set<OtherSet>& s) const
+    {
+        return m_set.intersects(s.set());
+    }
+};
+
+template <class Set1, class Set2>
+bool operator==(const hashed_set<Set1>& a, const hashed_set<Set2>& b)
+{
+    return a.equals(b);
+}
+
+template <class Set1, class Set2>
+bool operator!=(const hashed_set<Set1>& a, const hashed_set<Set2>& b)
+{
+    return !a.equals(b);
+}
+
+namespace std
+{
+    template <class Set>
+    struct hash<hashed_set<Set> >
+    {
+        std::size_t operator()(const hashed_set<Set>& s) const
+        {
+            return static_cast<std::size_t>(s.hash());
+        }
+    };
+} // std
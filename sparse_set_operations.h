@@ -0,0 +1,554 @@
+
+// <summary>Contains intersection, union and difference kernels across sorted arrays and bitmaps, with a cost-based choice</summary>
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include <limits>
+
+#include "sparse_sets.h"
+#include "sparse_set_frozen.h"
+
+// in sparse_set_static.h, which needs C++14: bitmap() for it is instantiated only where that header is included
+template <std::size_t N>
+class static_bounded_set;
+
+///
+/// Set operations across representations. A sorted array (a posting list, the sequence of a sparse set, a frozen
+/// set in the sorted array representation) is a sorted_view; a bit array (bounded_set, sparse_set, static_bounded_set,
+/// a frozen set in the bitmap representation) is a bitmap_view. The kernels work on the raw representations:
+///
+///   sorted x sorted   merge (no data-dependent branches), block (all-pairs compares of 8 x 8 32-bit or 4 x 4 64-bit
+///                     values with AVX2, rotating one block by permutes), scan (each value of the smaller array compared
+///                     with a block of the larger one with AVX2, the blocks skipped linearly) and galloping
+///                     (exponential search in the larger array)
+///   sorted x bitmap   probing: a bit test per value of the array, with the words of later values prefetched
+///   bitmap x bitmap   word by word
+///
+/// intersect, unite and subtract pick the kernel: for two sorted arrays from the ratio of their sizes
+/// (choose_kernel), and for a sorted array and a bitmap by probing, which costs a test per value of the array whatever
+/// the size of the bitmap. Sorted results are written to a vector; bitmap results to a set with resize() and
+/// assign_word(). All the values of a sorted array must be distinct and increasing.
+///
+namespace set_operations
+{
+    template <class T>
+    struct sorted_view
+    {
+        const T* data;
+        std::size_t count;
+    };
+
+    template <class Word>
+    struct bitmap_view
+    {
+        const Word* words;
+        std::size_t size;   // the universe: the values are in [0, size)
+    };
+
+    template <class T>
+    sorted_view<T> sorted(const T* data, std::size_t count)
+    {
+        return sorted_view<T>{ data, count };
+    }
+
+    template <class T, class Allocator>
+    sorted_view<T> sorted(const std::vector<T, Allocator>& v)
+    {
+        return sorted_view<T>{ v.data(), v.size() };
+    }
+
+    // the iteration sequence of a sparse set, built if it is not there yet
+    template <class Allocator, class Stats, std::size_t InlineWords>
+    sorted_view<std::size_t> sorted(const basic_sparse_set<Allocator, Stats, InlineWords>& s)
+    {
+        auto first = s.begin();
+        auto last = s.end();
+        return sorted_view<std::size_t>{ first == last ? nullptr : &*first, static_cast<std::size_t>(last - first) };
+    }
+
+    // a frozen set in the sorted array representation
+    template <class Allocator>
+    sorted_view<std::uint32_t> sorted(const basic_frozen_set<Allocator>& s)
+    {
+        return sorted_view<std::uint32_t>{ s.values(), s.values() != nullptr ? s.count() : 0 };
+    }
+
+    template <class Allocator, class Stats, std::size_t InlineWords>
+    bitmap_view<std::size_t> bitmap(const basic_bounded_set<Allocator, Stats, InlineWords>& s)
+    {
+        return bitmap_view<std::size_t>{ s.words(), s.size() };
+    }
+
+    template <class Allocator, class Stats, std::size_t InlineWords>
+    bitmap_view<std::size_t> bitmap(const basic_sparse_set<Allocator, Stats, InlineWords>& s)
+    {
+        return bitmap_view<std::size_t>{ s.words(), s.size() };
+    }
+
+    template <std::size_t N>
+    bitmap_view<std::uint64_t> bitmap(const static_bounded_set<N>& s)
+    {
+        return bitmap_view<std::uint64_t>{ s.words(), s.size() };
+    }
+
+    // a frozen set in the bitmap representation
+    template <class Allocator>
+    bitmap_view<std::uint64_t> bitmap(const basic_frozen_set<Allocator>& s)
+    {
+        return bitmap_view<std::uint64_t>{ s.words(), s.words() != nullptr ? s.size() : 0 };
+    }
+
+    ///------------------------------------
+    /// Sorted x sorted kernels: each writes to out, which must have room for the result, and returns its length
+    ///------------------------------------
+
+    template <class T>
+    std::size_t intersect_merge(const T* a, std::size_t na, const T* b, std::size_t nb, T* out)
+    {
+        std::size_t i = 0, j = 0, k = 0;
+        while (i < na && j < nb)
+        {
+            T x = a[i];
+            T y = b[j];
+            out[k] = x;
+            k += x == y;
+            i += x <= y;
+            j += y <= x;
+        }
+        return k;
+    }
+
+    // the position of the first value >= x in a[first, n), found by doubling steps from first
+    template <class T>
+    std::size_t gallop(const T* a, std::size_t first, std::size_t n, T x)
+    {
+        if (first >= n || a[first] >= x)
+            return first;
+
+        // a[low] < x; the result is in (low, high]
+        std::size_t step = 1;
+        std::size_t low = first;
+        std::size_t high = first + 1;
+        while (high < n && a[high] < x)
+        {
+            low = high;
+            step *= 2;
+            high = low + step;
+        }
+        if (high > n)
+            high = n;
+        return static_cast<std::size_t>(std::lower_bound(a + low + 1, a + high, x) - a);
+    }
+
+    // small is searched for in large
+    template <class T>
+    std::size_t intersect_galloping(const T* small, std::size_t ns, const T* large, std::size_t nl, T* out)
+    {
+        std::size_t j = 0, k = 0;
+        for (std::size_t i = 0; i < ns && j < nl; i++)
+        {
+            j = gallop(large, j, nl, small[i]);
+            if (j < nl && large[j] == small[i])
+                out[k++] = small[i];
+        }
+        return k;
+    }
+
+#if defined(__AVX2__)
+    template <std::size_t Bytes>
+    struct avx2_lanes;
+
+    template <>
+    struct avx2_lanes<4>
+    {
+        static constexpr std::size_t count = 8;
+
+        static __m256i load(const void* p) { return _mm256_loadu_si256(static_cast<const __m256i*>(p)); }
+        static __m256i broadcast(std::uint64_t x) { return _mm256_set1_epi32(static_cast<int>(x)); }
+        static __m256i equal(__m256i a, __m256i b) { return _mm256_cmpeq_epi32(a, b); }
+        static unsigned mask(__m256i m) { return static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(m))); }
+        static __m256i rotate(__m256i v) { return _mm256_permutevar8x32_epi32(v, _mm256_setr_epi32(1, 2, 3, 4, 5, 6, 7, 0)); }
+    };
+
+    template <>
+    struct avx2_lanes<8>
+    {
+        static constexpr std::size_t count = 4;
+
+        static __m256i load(const void* p) { return _mm256_loadu_si256(static_cast<const __m256i*>(p)); }
+        static __m256i broadcast(std::uint64_t x) { return _mm256_set1_epi64x(static_cast<long long>(x)); }
+        static __m256i equal(__m256i a, __m256i b) { return _mm256_cmpeq_epi64(a, b); }
+        static unsigned mask(__m256i m) { return static_cast<unsigned>(_mm256_movemask_pd(_mm256_castsi256_pd(m))); }
+        static __m256i rotate(__m256i v) { return _mm256_permute4x64_epi64(v, _MM_SHUFFLE(0, 3, 2, 1)); }
+    };
+#endif
+
+    ///
+    /// Arrays of about the same size: a block of each array is compared with every rotation of the other block, and the
+    /// block with the smaller last value is replaced. The values of a that are found are the set bits of one mask.
+    /// Without AVX2 (or for values of other widths) it is intersect_merge.
+    ///
+    template <class T>
+    std::size_t intersect_block(const T* a, std::size_t na, const T* b, std::size_t nb, T* out)
+    {
+        std::size_t i = 0, j = 0, k = 0;
+#if defined(__AVX2__)
+        if (sizeof(T) == 4 || sizeof(T) == 8)
+        {
+            typedef avx2_lanes<sizeof(T) == 4 ? 4 : 8> lanes;
+            const std::size_t n = lanes::count;
+            while (i + n <= na && j + n <= nb)
+            {
+                __m256i va = lanes::load(a + i);
+                __m256i vb = lanes::load(b + j);
+                __m256i m = lanes::equal(va, vb);
+                for (std::size_t r = 1; r < n; r++)
+                {
+                    vb = lanes::rotate(vb);
+                    m = _mm256_or_si256(m, lanes::equal(va, vb));
+                }
+
+                unsigned found = lanes::mask(m);
+                while (found != 0)
+                {
+                    out[k++] = a[i + bits::trailing_zeros64(found)];
+                    found &= found - 1;
+                }
+
+                T last_a = a[i + n - 1];
+                T last_b = b[j + n - 1];
+                i += last_a <= last_b ? n : 0;
+                j += last_b <= last_a ? n : 0;
+            }
+        }
+#endif
+        return k + intersect_merge(a + i, na - i, b + j, nb - j, out + k);
+    }
+
+    ///
+    /// A small array against a larger one: every value of small is compared with a whole block of large at once, after
+    /// skipping the blocks that end below it. Without AVX2 it is intersect_galloping.
+    ///
+    template <class T>
+    std::size_t intersect_scan(const T* small, std::size_t ns, const T* large, std::size_t nl, T* out)
+    {
+        std::size_t i = 0, j = 0, k = 0;
+#if defined(__AVX2__)
+        if (sizeof(T) == 4 || sizeof(T) == 8)
+        {
+            typedef avx2_lanes<sizeof(T) == 4 ? 4 : 8> lanes;
+            const std::size_t n = lanes::count;
+            for (; i < ns; i++)
+            {
+                T x = small[i];
+                while (j + n <= nl && large[j + n - 1] < x)
+                {
+                    j += n;
+                }
+                if (j + n > nl)
+                    break;
+                out[k] = x;
+                k += lanes::mask(lanes::equal(lanes::broadcast(x), lanes::load(large + j))) != 0;
+            }
+        }
+#endif
+        return k + intersect_galloping(small + i, ns - i, large + j, nl - j, out + k);
+    }
+
+    template <class T>
+    std::size_t unite_merge(const T* a, std::size_t na, const T* b, std::size_t nb, T* out)
+    {
+        std::size_t i = 0, j = 0, k = 0;
+        while (i < na && j < nb)
+        {
+            T x = a[i];
+            T y = b[j];
+            out[k++] = x <= y ? x : y;
+            i += x <= y;
+            j += y <= x;
+        }
+        k = static_cast<std::size_t>(std::copy(a + i, a + na, out + k) - out);
+        return static_cast<std::size_t>(std::copy(b + j, b + nb, out + k) - out);
+    }
+
+    // small is merged into large, whose runs between the values of small are found by galloping and copied whole
+    template <class T>
+    std::size_t unite_galloping(const T* small, std::size_t ns, const T* large, std::size_t nl, T* out)
+    {
+        std::size_t j = 0, k = 0;
+        for (std::size_t i = 0; i < ns; i++)
+        {
+            std::size_t p = gallop(large, j, nl, small[i]);
+            k = static_cast<std::size_t>(std::copy(large + j, large + p, out + k) - out);
+            out[k++] = small[i];
+            j = p < nl && large[p] == small[i] ? p + 1 : p;
+        }
+        return static_cast<std::size_t>(std::copy(large + j, large + nl, out + k) - out);
+    }
+
+    // a \ b
+    template <class T>
+    std::size_t subtract_merge(const T* a, std::size_t na, const T* b, std::size_t nb, T* out)
+    {
+        std::size_t i = 0, j = 0, k = 0;
+        while (i < na && j < nb)
+        {
+            T x = a[i];
+            T y = b[j];
+            out[k] = x;
+            k += x < y;
+            i += x <= y;
+            j += y <= x;
+        }
+        return static_cast<std::size_t>(std::copy(a + i, a + na, out + k) - out);
+    }
+
+    // a \ b for an a much smaller than b: the values of a are searched for in b
+    template <class T>
+    std::size_t subtract_galloping(const T* a, std::size_t na, const T* b, std::size_t nb, T* out)
+    {
+        std::size_t j = 0, k = 0;
+        for (std::size_t i = 0; i < na; i++)
+        {
+            j = gallop(b, j, nb, a[i]);
+            out[k] = a[i];
+            k += j >= nb || b[j] != a[i];
+        }
+        return k;
+    }
+
+    ///------------------------------------
+    /// Sorted x bitmap kernels
+    ///------------------------------------
+
+    // the values of a present in the bit array (if in) or absent from it (if not)
+    template <class T, class Word>
+    std::size_t probe(const T* a, std::size_t na, const bitmap_view<Word>& b, T* out, bool in)
+    {
+        static constexpr unsigned word_bits = std::numeric_limits<Word>::digits;
+        // the values beyond the universe are not in the bit array
+        std::size_t n = static_cast<std::size_t>(std::lower_bound(a, a + na, b.size,
+            [](T x, std::size_t size) { return static_cast<std::size_t>(x) < size; }) - a);
+        std::size_t k = 0;
+        for (std::size_t i = 0; i < n; i++)
+        {
+            if (i + bits::prefetch_distance < n)
+                bits::prefetch(b.words + a[i + bits::prefetch_distance] / word_bits);
+            T x = a[i];
+            bool present = ((b.words[x / word_bits] >> (x % word_bits)) & 1) != 0;
+            out[k] = x;
+            k += present == in;
+        }
+        if (!in)
+            k = static_cast<std::size_t>(std::copy(a + n, a + na, out + k) - out);
+        return k;
+    }
+
+    ///------------------------------------
+    /// The choice of a kernel for two sorted arrays
+    ///------------------------------------
+
+    enum kernel_type { merge_kernel, block_kernel, scan_kernel, galloping_kernel, probe_kernel, bitmap_kernel };
+
+    inline const char* kernel_name(kernel_type kernel)
+    {
+        static const char* names[] = { "merge", "block", "scan", "galloping", "probe", "bitmap" };
+        return names[kernel];
+    }
+
+    // the thresholds of choose_kernel, measured with the set operations extras test
+    static constexpr std::size_t block_ratio = 2;             // 32-bit values up to this size ratio: block
+    static constexpr std::size_t galloping_bytes = 2048;      // scan reads at least this much per value: galloping
+    static constexpr std::size_t merge_galloping_ratio = 16;  // without SIMD: galloping from this size ratio
+
+    ///
+    /// The intersection kernel for arrays of na and nb values of value_size bytes. Merging reads both arrays, galloping
+    /// reads about log2(ratio) values of the larger array per value of the smaller one, and scan reads the larger array
+    /// a block at a time: galloping wins once that is more than a few cache lines per value. The block kernel only
+    /// pays for 32-bit values of arrays of about the same size.
+    ///
+    inline kernel_type choose_kernel(std::size_t na, std::size_t nb, std::size_t value_size = 4)
+    {
+        std::size_t small = std::min(na, nb);
+        std::size_t large = std::max(na, nb);
+        if (small == 0)
+            return galloping_kernel;
+        std::size_t ratio = large / small;
+#if defined(__AVX2__)
+        if (ratio * value_size >= galloping_bytes)
+            return galloping_kernel;
+        if (value_size == 4 && ratio < block_ratio)
+            return block_kernel;
+        return scan_kernel;
+#else
+        (void)value_size;
+        return ratio >= merge_galloping_ratio ? galloping_kernel : merge_kernel;
+#endif
+    }
+
+    template <class T>
+    std::size_t intersect(const T* a, std::size_t na, const T* b, std::size_t nb, T* out, kernel_type kernel)
+    {
+        if (na > nb && (kernel == galloping_kernel || kernel == scan_kernel))
+        {
+            std::swap(a, b);
+            std::swap(na, nb);
+        }
+        switch (kernel)
+        {
+        case galloping_kernel:
+            return intersect_galloping(a, na, b, nb, out);
+        case scan_kernel:
+            return intersect_scan(a, na, b, nb, out);
+        case block_kernel:
+            return intersect_block(a, na, b, nb, out);
+        default:
+            return intersect_merge(a, na, b, nb, out);
+        }
+    }
+
+    ///------------------------------------
+    /// Intersection, union and difference with the kernel chosen by the representations and the sizes
+    ///------------------------------------
+
+    template <class T, class Allocator>
+    void intersect(const sorted_view<T>& a, const sorted_view<T>& b, std::vector<T, Allocator>& out)
+    {
+        out.resize(std::min(a.count, b.count));
+        out.resize(intersect(a.data, a.count, b.data, b.count, out.data(), choose_kernel(a.count, b.count, sizeof(T))));
+    }
+
+    template <class T, class Word, class Allocator>
+    void intersect(const sorted_view<T>& a, const bitmap_view<Word>& b, std::vector<T, Allocator>& out)
+    {
+        out.resize(a.count);
+        out.resize(probe(a.data, a.count, b, out.data(), true));
+    }
+
+    template <class T, class Word, class Allocator>
+    void intersect(const bitmap_view<Word>& a, const sorted_view<T>& b, std::vector<T, Allocator>& out)
+    {
+        intersect(b, a, out);
+    }
+
+    template <class T, class Allocator>
+    void unite(const sorted_view<T>& a, const sorted_view<T>& b, std::vector<T, Allocator>& out)
+    {
+        out.resize(a.count + b.count);
+        std::size_t small = std::min(a.count, b.count);
+        std::size_t large = std::max(a.count, b.count);
+        std::size_t k;
+        if (small != 0 && large / small >= merge_galloping_ratio)
+            k = a.count < b.count ? unite_galloping(a.data, a.count, b.data, b.count, out.data()) : unite_galloping(b.data, b.count, a.data, a.count, out.data());
+        else
+            k = unite_merge(a.data, a.count, b.data, b.count, out.data());
+        out.resize(k);
+    }
+
+    // a \ b
+    template <class T, class Allocator>
+    void subtract(const sorted_view<T>& a, const sorted_view<T>& b, std::vector<T, Allocator>& out)
+    {
+        out.resize(a.count);
+        if (a.count != 0 && b.count / a.count >= merge_galloping_ratio)
+            out.resize(subtract_galloping(a.data, a.count, b.data, b.count, out.data()));
+        else
+            out.resize(subtract_merge(a.data, a.count, b.data, b.count, out.data()));
+    }
+
+    // a \ b
+    template <class T, class Word, class Allocator>
+    void subtract(const sorted_view<T>& a, const bitmap_view<Word>& b, std::vector<T, Allocator>& out)
+    {
+        out.resize(a.count);
+        out.resize(probe(a.data, a.count, b, out.data(), false));
+    }
+
+    ///
+    /// Bitmap results go to a set with word access (bounded_set, sparse_set): it is resized to the universe of the
+    /// result (the smaller one for an intersection, the larger one for a union, that of a for a difference) and its
+    /// words are overwritten. It must not be one of the operands.
+    ///
+    template <class Word, class Set>
+    void intersect(const bitmap_view<Word>& a, const bitmap_view<Word>& b, Set& out)
+    {
+        static constexpr unsigned word_bits = std::numeric_limits<Word>::digits;
+        std::size_t size = std::min(a.size, b.size);
+        out.resize(size);
+        for (std::size_t w = 0, n = (size + word_bits - 1) / word_bits; w < n; w++)
+        {
+            out.assign_word(w, a.words[w] & b.words[w]);
+        }
+    }
+
+    template <class Word, class Set>
+    void unite(const bitmap_view<Word>& a, const bitmap_view<Word>& b, Set& out)
+    {
+        static constexpr unsigned word_bits = std::numeric_limits<Word>::digits;
+        std::size_t na = (a.size + word_bits - 1) / word_bits;
+        std::size_t nb = (b.size + word_bits - 1) / word_bits;
+        out.resize(std::max(a.size, b.size));
+        for (std::size_t w = 0, n = std::max(na, nb); w < n; w++)
+        {
+            out.assign_word(w, (w < na ? a.words[w] : 0) | (w < nb ? b.words[w] : 0));
+        }
+    }
+
+    // a \ b
+    template <class Word, class Set>
+    void subtract(const bitmap_view<Word>& a, const bitmap_view<Word>& b, Set& out)
+    {
+        static constexpr unsigned word_bits = std::numeric_limits<Word>::digits;
+        std::size_t na = (a.size + word_bits - 1) / word_bits;
+        std::size_t nb = (b.size + word_bits - 1) / word_bits;
+        out.resize(a.size);
+        for (std::size_t w = 0; w < na; w++)
+        {
+            out.assign_word(w, a.words[w] & ~(w < nb ? b.words[w] : 0));
+        }
+    }
+
+    // the union of a bitmap and a sorted array: the words of a with the values of b set
+    template <class T, class Word, class Set>
+    void unite(const bitmap_view<Word>& a, const sorted_view<T>& b, Set& out)
+    {
+        static constexpr unsigned word_bits = std::numeric_limits<Word>::digits;
+        std::size_t size = b.count != 0 ? std::max<std::size_t>(a.size, static_cast<std::size_t>(b.data[b.count - 1]) + 1) : a.size;
+        std::size_t na = (a.size + word_bits - 1) / word_bits;
+        out.resize(size);
+        for (std::size_t w = 0, n = (size + word_bits - 1) / word_bits; w < n; w++)
+        {
+            out.assign_word(w, w < na ? a.words[w] : 0);
+        }
+        for (std::size_t i = 0; i < b.count; i++)
+        {
+            out.insert(static_cast<std::size_t>(b.data[i]));
+        }
+    }
+
+    template <class T, class Word, class Set>
+    void unite(const sorted_view<T>& a, const bitmap_view<Word>& b, Set& out)
+    {
+        unite(b, a, out);
+    }
+
+    // a \ b: the words of a with the values of b cleared
+    template <class T, class Word, class Set>
+    void subtract(const bitmap_view<Word>& a, const sorted_view<T>& b, Set& out)
+    {
+        static constexpr unsigned word_bits = std::numeric_limits<Word>::digits;
+        out.resize(a.size);
+        for (std::size_t w = 0, n = (a.size + word_bits - 1) / word_bits; w < n; w++)
+        {
+            out.assign_word(w, a.words[w]);
+        }
+        for (std::size_t i = 0; i < b.count && b.data[i] < a.size; i++)
+        {
+            out.erase(static_cast<std::size_t>(b.data[i]));
+        }
+    }
+} // set_operations
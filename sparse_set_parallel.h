@@ -0,0 +1,492 @@
+
+// <summary>Contains a work-stealing thread pool and parallel iteration over the sets, with partitions balanced by element count</summary>
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <exception>
+#include <algorithm>
+#include <memory>
+#include <limits>
+
+#include "sparse_sets.h"
+#include "sparse_set_frozen.h"
+
+// declared only, so that this header builds with C++11: the definition is in sparse_set_static.h
+template <std::size_t N>
+class static_bounded_set;
+
+namespace parallel
+{
+    ///
+    /// A pool of threads that runs the tasks [0, n) of a job. Every participant (the calling thread is one of them)
+    /// starts with a contiguous range of tasks, takes them from the front of its own range and, when it runs out,
+    /// steals from the back of the ranges of the others, so that an unlucky partition does not leave the other
+    /// cores idle. A range is a pair of 32-bit bounds in one atomic word: taking a task is a single compare-and-swap.
+    /// One job runs at a time; a task must not start another job on the same pool.
+    ///
+    class work_stealing_pool
+    {
+        struct task_range
+        {
+            std::atomic<std::uint64_t> bounds; // front in the low half, back in the high half
+            char padding[64 - sizeof(std::atomic<std::uint64_t>)];
+        };
+
+        std::vector<std::thread> m_workers;
+        std::unique_ptr<task_range[]> m_ranges;
+        std::mutex m_run_mutex;
+        std::mutex m_mutex;
+        std::condition_variable m_start;
+        std::condition_variable m_done;
+        const std::function<void(std::size_t)>* m_body;
+        unsigned m_participants;
+        unsigned m_pending;
+        std::uint64_t m_generation;
+        bool m_stop;
+        std::exception_ptr m_error;
+
+        static bool take_front(task_range& r, std::size_t& task)
+        {
+            std::uint64_t b = r.bounds.load(std::memory_order_relaxed);
+            for (;;)
+            {
+                std::uint32_t front = static_cast<std::uint32_t>(b);
+                std::uint32_t back = static_cast<std::uint32_t>(b >> 32);
+                if (front >= back)
+                    return false;
+                if (r.bounds.compare_exchange_weak(b, b + 1, std::memory_order_acq_rel, std::memory_order_relaxed))
+                {
+                    task = front;
+                    return true;
+                }
+            }
+        }
+
+        static bool take_back(task_range& r, std::size_t& task)
+        {
+            std::uint64_t b = r.bounds.load(std::memory_order_relaxed);
+            for (;;)
+            {
+                std::uint32_t front = static_cast<std::uint32_t>(b);
+                std::uint32_t back = static_cast<std::uint32_t>(b >> 32);
+                if (front >= back)
+                    return false;
+                if (r.bounds.compare_exchange_weak(b, b - (std::uint64_t(1) << 32), std::memory_order_acq_rel, std::memory_order_relaxed))
+                {
+                    task = back - 1;
+                    return true;
+                }
+            }
+        }
+
+        // runs the tasks of participant p, then steals until no range has any left
+        void execute(unsigned p)
+        {
+            try
+            {
+                std::size_t task;
+                while (take_front(m_ranges[p], task))
+                {
+                    (*m_body)(task);
+                }
+
+                bool stolen = true;
+                while (stolen)
+                {
+                    stolen = false;
+                    for (unsigned k = 1; k < m_participants; k++)
+                    {
+                        if (take_back(m_ranges[(p + k) % m_participants], task))
+                        {
+                            (*m_body)(task);
+                            stolen = true;
+                            break;
+                        }
+                    }
+                }
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (!m_error)
+                    m_error = std::current_exception();
+            }
+        }
+
+        void work(unsigned index)
+        {
+            std::uint64_t seen = 0;
+            for (;;)
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_start.wait(lock, [&]() { return m_stop || m_generation != seen; });
+                if (m_stop)
+                    return;
+                seen = m_generation;
+                if (index >= m_participants)
+                    continue;
+
+                lock.unlock();
+                execute(index);
+                lock.lock();
+                if (--m_pending == 0)
+                    m_done.notify_one();
+            }
+        }
+
+    public:
+        // threads is the number of participants, the calling thread included; 0 means one per hardware thread
+        explicit work_stealing_pool(unsigned threads = 0)
+            : m_body(nullptr), m_participants(0), m_pending(0), m_generation(0), m_stop(false)
+        {
+            if (threads == 0)
+                threads = std::max(1u, std::thread::hardware_concurrency());
+            m_ranges.reset(new task_range[threads]);
+            for (unsigned p = 1; p < threads; p++)
+            {
+                m_workers.emplace_back(&work_stealing_pool::work, this, p);
+            }
+        }
+
+        work_stealing_pool(const work_stealing_pool&) = delete;
+        work_stealing_pool& operator=(const work_stealing_pool&) = delete;
+
+        ~work_stealing_pool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_stop = true;
+            }
+            m_start.notify_all();
+            for (auto& t : m_workers)
+            {
+                t.join();
+            }
+        }
+
+        unsigned thread_count() const
+        {
+            return static_cast<unsigned>(m_workers.size()) + 1;
+        }
+
+        ///
+        /// Calls body(k) for every k in [0, tasks) on up to threads participants (0: all of them) and returns when all
+        /// the calls have returned. The first exception thrown by a task is rethrown here, once the others are done.
+        ///
+        void run(std::size_t tasks, const std::function<void(std::size_t)>& body, unsigned threads = 0)
+        {
+            if (tasks == 0)
+                return;
+
+            unsigned participants = threads == 0 ? thread_count() : std::min(threads, thread_count());
+            participants = static_cast<unsigned>(std::min<std::size_t>(participants, tasks));
+            if (participants <= 1)
+            {
+                for (std::size_t k = 0; k < tasks; k++)
+                {
+                    body(k);
+                }
+                return;
+            }
+
+            std::lock_guard<std::mutex> run_lock(m_run_mutex);
+            for (unsigned p = 0; p < participants; p++)
+            {
+                std::uint64_t front = tasks * p / participants;
+                std::uint64_t back = tasks * (p + 1) / participants;
+                m_ranges[p].bounds.store(front | (back << 32), std::memory_order_relaxed);
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_body = &body;
+                m_participants = participants;
+                m_pending = participants - 1;
+                m_error = nullptr;
+                m_generation++;
+            }
+            m_start.notify_all();
+
+            execute(0);
+
+            std::exception_ptr error;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_done.wait(lock, [&]() { return m_pending == 0; });
+                m_body = nullptr;
+                std::swap(error, m_error);
+            }
+            if (error)
+                std::rethrow_exception(error);
+        }
+    };
+
+    // the pool used by parallel_for_each and parallel_reduce unless another one is given; started on first use
+    inline work_stealing_pool& default_pool()
+    {
+        static work_stealing_pool pool;
+        return pool;
+    }
+
+    // a part of a set: a range of words, of dense positions or of values depending on the container
+    struct piece
+    {
+        std::size_t first;
+        std::size_t last;
+    };
+
+    // the number of pieces per participant: enough for stealing to even out what the counts do not predict
+    static constexpr std::size_t pieces_per_thread = 8;
+
+    // the words of a bit array are counted in blocks of this many words; a piece boundary is a block boundary
+    static constexpr std::size_t count_block_words = 64;
+
+    ///
+    /// Cuts a bit array into at most pieces ranges of words holding about the same number of elements, from the
+    /// popcounts of blocks of count_block_words words (counted in parallel). Clustered data gives some pieces
+    /// that are a few words long and others that span most of the universe.
+    ///
+    template <class Word>
+    std::vector<piece> partition_words(const Word* words, std::size_t word_count, std::size_t pieces,
+        work_stealing_pool& pool, unsigned threads)
+    {
+        std::size_t blocks = (word_count + count_block_words - 1) / count_block_words;
+        std::vector<std::size_t> counts(blocks);
+        std::size_t groups = std::min<std::size_t>(blocks, pool.thread_count() * pieces_per_thread);
+        pool.run(groups, [&](std::size_t g)
+        {
+            for (std::size_t b = blocks * g / groups; b < blocks * (g + 1) / groups; b++)
+            {
+                std::size_t last = std::min(word_count, (b + 1) * count_block_words);
+                std::size_t count = 0;
+                for (std::size_t w = b * count_block_words; w < last; w++)
+                {
+                    count += bits::popcount64(words[w]);
+                }
+                counts[b] = count;
+            }
+        }, threads);
+
+        std::size_t total = 0;
+        for (auto c : counts)
+        {
+            total += c;
+        }
+
+        std::vector<piece> result;
+        if (total == 0)
+            return result;
+
+        pieces = std::max<std::size_t>(1, std::min(pieces, total));
+        std::size_t first_block = 0;
+        std::size_t seen = 0;
+        for (std::size_t b = 0; b < blocks; b++)
+        {
+            seen += counts[b];
+            // close the piece once it reaches its share of the elements
+            if (seen * pieces >= total * (result.size() + 1) || b + 1 == blocks)
+            {
+                result.push_back(piece{ first_block * count_block_words, std::min(word_count, (b + 1) * count_block_words) });
+                first_block = b + 1;
+            }
+        }
+        return result;
+    }
+
+    template <class Word, class F>
+    void for_each_in_words(const Word* words, const piece& p, F& f)
+    {
+        for (std::size_t w = p.first; w < p.last; w++)
+        {
+            std::uint64_t x = words[w];
+            while (x != 0)
+            {
+                f(w * std::numeric_limits<Word>::digits + bits::trailing_zeros64(x));
+                x &= x - 1;
+            }
+        }
+    }
+
+    // equal ranges of positions: every element costs the same to reach
+    inline std::vector<piece> partition_positions(std::size_t count, std::size_t pieces)
+    {
+        std::vector<piece> result;
+        pieces = std::min(pieces, count);
+        for (std::size_t k = 0; k < pieces; k++)
+        {
+            result.push_back(piece{ count * k / pieces, count * (k + 1) / pieces });
+        }
+        return result;
+    }
+
+    ///------------------------------------
+    /// The pieces of every container (partition) and the scan of a piece (for_each_in)
+    ///------------------------------------
+
+    template <class Allocator, class Stats, std::size_t InlineWords>
+    std::vector<piece> partition(const basic_bounded_set<Allocator, Stats, InlineWords>& s, std::size_t pieces,
+        work_stealing_pool& pool, unsigned threads)
+    {
+        return partition_words(s.words(), s.word_count(), pieces, pool, threads);
+    }
+
+    template <class Allocator, class Stats, std::size_t InlineWords, class F>
+    void for_each_in(const basic_bounded_set<Allocator, Stats, InlineWords>& s, const piece& p, F& f)
+    {
+        for_each_in_words(s.words(), p, f);
+    }
+
+    template <class Allocator, class Stats, std::size_t InlineWords>
+    std::vector<piece> partition(const basic_sparse_set<Allocator, Stats, InlineWords>& s, std::size_t pieces,
+        work_stealing_pool& pool, unsigned threads)
+    {
+        return partition_words(s.words(), s.word_count(), pieces, pool, threads);
+    }
+
+    template <class Allocator, class Stats, std::size_t InlineWords, class F>
+    void for_each_in(const basic_sparse_set<Allocator, Stats, InlineWords>& s, const piece& p, F& f)
+    {
+        for_each_in_words(s.words(), p, f);
+    }
+
+    template <std::size_t N>
+    std::vector<piece> partition(const static_bounded_set<N>& s, std::size_t pieces, work_stealing_pool& pool, unsigned threads)
+    {
+        return partition_words(s.words(), s.word_count(), pieces, pool, threads);
+    }
+
+    template <std::size_t N, class F>
+    void for_each_in(const static_bounded_set<N>& s, const piece& p, F& f)
+    {
+        for_each_in_words(s.words(), p, f);
+    }
+
+    template <class Allocator, class Stats>
+    std::vector<piece> partition(const basic_unordered_sparse_set<Allocator, Stats>& s, std::size_t pieces,
+        work_stealing_pool&, unsigned)
+    {
+        return partition_positions(s.count(), pieces);
+    }
+
+    template <class Allocator, class Stats, class F>
+    void for_each_in(const basic_unordered_sparse_set<Allocator, Stats>& s, const piece& p, F& f)
+    {
+        auto last = s.begin() + p.last;
+        for (auto it = s.begin() + p.first; it != last; ++it)
+        {
+            f(*it);
+        }
+    }
+
+    // value ranges cut where the rank (the rank index of the bitmap, or a search in the sorted array) crosses each share
+    template <class Allocator>
+    std::vector<piece> partition(const basic_frozen_set<Allocator>& s, std::size_t pieces, work_stealing_pool&, unsigned)
+    {
+        std::vector<piece> result;
+        std::size_t total = s.count();
+        pieces = std::min(pieces, total);
+        std::size_t first = 0;
+        for (std::size_t k = 1; k <= pieces; k++)
+        {
+            std::size_t last = s.size();
+            if (k < pieces)
+            {
+                // the smallest value with at least total * k / pieces elements below it
+                std::size_t target = total * k / pieces;
+                std::size_t low = first;
+                while (low < last)
+                {
+                    std::size_t middle = low + (last - low) / 2;
+                    if (s.rank(middle) < target)
+                        low = middle + 1;
+                    else
+                        last = middle;
+                }
+            }
+            if (last > first)
+                result.push_back(piece{ first, last });
+            first = last;
+        }
+        return result;
+    }
+
+    template <class Allocator, class F>
+    void for_each_in(const basic_frozen_set<Allocator>& s, const piece& p, F& f)
+    {
+        for (auto it = s.lower_bound(p.first), end = s.end(); it != end && *it < p.last; ++it)
+        {
+            f(*it);
+        }
+    }
+} // parallel
+
+///
+/// Calls f(x) for every element x of the set on up to threads threads of the pool (0: all of them). The elements are
+/// cut into pieces of about the same number of elements, eight per thread, which the threads take and steal from each
+/// other. The calls for different elements may run concurrently and in any order, so f must be safe to call from
+/// several threads. The set must not be modified until parallel_for_each returns.
+/// Supported: bounded_set, sparse_set, static_bounded_set, unordered_sparse_set and frozen_set.
+///
+template <class Set, class F>
+void parallel_for_each(const Set& s, F f, unsigned threads = 0, parallel::work_stealing_pool& pool = parallel::default_pool())
+{
+    unsigned participants = threads == 0 ? pool.thread_count() : std::min(threads, pool.thread_count());
+    std::vector<parallel::piece> pieces = parallel::partition(s, participants * parallel::pieces_per_thread, pool, threads);
+    pool.run(pieces.size(), [&](std::size_t k)
+    {
+        parallel::for_each_in(s, pieces[k], f);
+    }, threads);
+}
+
+///
+/// A parallel std::transform_reduce over the elements: init combined with transform(x) for every element x. Every piece
+/// is reduced by one thread, then the results of the pieces are combined with init in the order of the pieces, so
+/// combine must be associative (it need not be commutative). With the same number of threads, the pieces, and so
+/// the result, are the same from run to run (which matters for floating point sums).
+///
+template <class Set, class T, class Combine, class Transform>
+T parallel_reduce(const Set& s, T init, Combine combine, Transform transform, unsigned threads = 0,
+    parallel::work_stealing_pool& pool = parallel::default_pool())
+{
+    unsigned participants = threads == 0 ? pool.thread_count() : std::min(threads, pool.thread_count());
+    std::vector<parallel::piece> pieces = parallel::partition(s, participants * parallel::pieces_per_thread, pool, threads);
+    std::vector<T> partial(pieces.size(), init);
+    std::vector<char> present(pieces.size(), 0);
+
+    pool.run(pieces.size(), [&](std::size_t k)
+    {
+        bool first = true;
+        T r = init;
+        auto g = [&](std::size_t x)
+        {
+            if (first)
+            {
+                r = transform(x);
+                first = false;
+            }
+            else
+            {
+                r = combine(r, transform(x));
+            }
+        };
+        parallel::for_each_in(s, pieces[k], g);
+        partial[k] = r;
+        present[k] = !first;
+    }, threads);
+
+    T result = init;
+    for (std::size_t k = 0; k < pieces.size(); k++)
+    {
+        if (present[k])
+            result = combine(result, partial[k]);
+    }
+    return result;
+}
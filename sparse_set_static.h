@@ -0,0 +1,252 @@
+
+// <summary>Contains static_bounded_set, a bounded set with its words inline whose operations are constexpr (C++14)</summary>
+
+#pragma once
+
+#include <cstdint>
+#include <initializer_list>
+
+#include "sparse_sets.h"
+
+///
+/// Static bounded set: a bounded set over [0; N-1] whose bits are held in the object itself, with no allocation.
+/// Every operation is constexpr (with the relaxed constexpr rules of C++14), so that a table can be built at compile
+/// time and placed in read-only data, with no work at startup:
+///
+///     constexpr static_bounded_set<128> digits = { '0', '1', '2', '3', '4', '5', '6', '7', '8', '9' };
+///
+/// The words are a public member, which makes the set a structural type: with C++20 it can be a template argument.
+///
+template <std::size_t N>
+class static_bounded_set
+{
+public:
+    typedef std::uint64_t word_type;
+    typedef std::size_t value_type;
+    typedef std::size_t key_type;
+    typedef std::size_t size_type;
+
+    static constexpr unsigned word_bits = 64;
+    static constexpr std::size_t word_total = (N + word_bits - 1) / word_bits;
+
+    word_type m_words[word_total > 0 ? word_total : 1];
+
+private:
+    static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+    // the index of the lowest set bit; x must not be 0
+    static constexpr unsigned lowest_bit(word_type x)
+    {
+        unsigned r = 0;
+        if ((x & 0xFFFFFFFFu) == 0) { r += 32; x >>= 32; }
+        if ((x & 0xFFFFu) == 0) { r += 16; x >>= 16; }
+        if ((x & 0xFFu) == 0) { r += 8; x >>= 8; }
+        if ((x & 0xFu) == 0) { r += 4; x >>= 4; }
+        if ((x & 0x3u) == 0) { r += 2; x >>= 2; }
+        if ((x & 0x1u) == 0) { r += 1; }
+        return r;
+    }
+
+    static constexpr unsigned popcount(word_type x)
+    {
+        x -= (x >> 1) & 0x5555555555555555ull;
+        x = (x & 0x3333333333333333ull) + ((x >> 2) & 0x3333333333333333ull);
+        x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0Full;
+        return static_cast<unsigned>((x * 0x0101010101010101ull) >> 56);
+    }
+
+public:
+    constexpr static_bounded_set() : m_words{}
+    {
+    }
+
+    constexpr static_bounded_set(std::initializer_list<std::size_t> values) : m_words{}
+    {
+        for (auto x : values)
+        {
+            insert(x);
+        }
+    }
+
+    constexpr bool insert(std::size_t i)
+    {
+        word_type& w = m_words[i / word_bits];
+        word_type x = w;
+        w |= word_type(1) << (i % word_bits);
+        return x != w;
+    }
+
+    constexpr void erase(std::size_t i)
+    {
+        m_words[i / word_bits] &= ~(word_type(1) << (i % word_bits));
+    }
+
+    constexpr bool test(std::size_t i) const
+    {
+        return ((m_words[i / word_bits] >> (i % word_bits)) & 1) != 0;
+    }
+
+    class iterator
+    {
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef std::size_t value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const std::size_t* pointer;
+        typedef std::size_t reference;
+
+    private:
+        const static_bounded_set* m_set;
+        std::size_t m_word;
+        word_type m_current;
+        std::size_t m_value; // npos at the end
+
+        constexpr void next_bit()
+        {
+            while (m_current == 0)
+            {
+                if (++m_word >= word_total)
+                {
+                    m_value = npos;
+                    return;
+                }
+                m_current = m_set->m_words[m_word];
+            }
+            m_value = m_word * word_bits + lowest_bit(m_current);
+            m_current &= m_current - 1;
+            if (m_value >= N)
+            {
+                m_value = npos;
+                m_current = 0;
+            }
+        }
+
+    public:
+        constexpr iterator() : m_set(nullptr), m_word(0), m_current(0), m_value(npos)
+        {
+        }
+
+        // the first element >= i
+        constexpr iterator(const static_bounded_set& s, std::size_t i) : m_set(&s), m_word(i / word_bits), m_current(0), m_value(npos)
+        {
+            if (i < N)
+            {
+                m_current = (s.m_words[m_word] >> (i % word_bits)) << (i % word_bits);
+                next_bit();
+            }
+        }
+
+        constexpr std::size_t operator*() const
+        {
+            return m_value;
+        }
+
+        constexpr iterator& operator++()
+        {
+            next_bit();
+            return *this;
+        }
+
+        constexpr iterator operator++(int)
+        {
+            iterator tmp(*this);
+            next_bit();
+            return tmp;
+        }
+
+        constexpr bool operator==(const iterator& y) const
+        {
+            return m_value == y.m_value;
+        }
+
+        constexpr bool operator!=(const iterator& y) const
+        {
+            return m_value != y.m_value;
+        }
+    };
+
+    typedef iterator const_iterator;
+
+    constexpr iterator begin() const
+    {
+        return iterator(*this, 0);
+    }
+
+    constexpr iterator end() const
+    {
+        return iterator();
+    }
+
+    constexpr iterator find(std::size_t i) const
+    {
+        return i < N && test(i) ? iterator(*this, i) : iterator();
+    }
+
+    constexpr iterator lower_bound(std::size_t i) const
+    {
+        return iterator(*this, i);
+    }
+
+    constexpr iterator upper_bound(std::size_t i) const
+    {
+        return iterator(*this, i + 1);
+    }
+
+    constexpr void erase(const iterator& it)
+    {
+        erase(*it);
+    }
+
+    constexpr bool empty() const
+    {
+        for (std::size_t k = 0; k < word_total; k++)
+        {
+            if (m_words[k] != 0)
+                return false;
+        }
+        return true;
+    }
+
+    constexpr void clear()
+    {
+        for (std::size_t k = 0; k < word_total; k++)
+        {
+            m_words[k] = 0;
+        }
+    }
+
+    constexpr std::size_t size() const
+    {
+        return N;
+    }
+
+    constexpr std::size_t count() const
+    {
+        std::size_t counter = 0;
+        for (std::size_t k = 0; k < word_total; k++)
+        {
+            counter += popcount(m_words[k]);
+        }
+        return counter;
+    }
+
+    ///------------------------------------
+    /// Word access
+    ///------------------------------------
+
+    constexpr std::size_t word_count() const
+    {
+        return word_total;
+    }
+
+    constexpr const word_type* words() const
+    {
+        return m_words;
+    }
+
+    // replaces word k; the bits beyond N must be 0
+    constexpr void assign_word(std::size_t k, word_type w)
+    {
+        m_words[k] = w;
+    }
+}; // static bounded set
@@ -0,0 +1,515 @@
+
+// <summary>Contains word-aligned run-length (EWAH-style) streaming serialization of bitmap sets</summary>
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <iterator>
+#include <limits>
+
+#include "sparse_sets.h"
+
+///
+/// Wire format: a sequence of 64-bit words in host byte order.
+///
+///   word 0:  ewah_format::magic
+///   word 1:  the universe size, i.e. size() of the encoded set
+///   then a marker word followed by its literal words, repeated until all the blocks of the universe are covered.
+///
+/// A block is 64 consecutive bits of the universe. A marker describes a run of clean blocks (all zeros or all ones)
+/// followed by a number of literal blocks, which are stored verbatim after the marker:
+///
+///   bit  0       the value of the clean blocks
+///   bits 1..32   the number of clean blocks
+///   bits 33..63  the number of literal blocks
+///
+struct ewah_format
+{
+    typedef std::uint64_t word_type;
+
+    static constexpr word_type magic = 0x3148415745535053; // "SPSEWAH1"
+    static constexpr unsigned block_bits = 64;
+    static constexpr word_type max_run = 0xFFFFFFFF;
+    static constexpr word_type max_literals = 0x7FFFFFFF;
+
+    static word_type marker(bool run_bit, word_type run, word_type literals)
+    {
+        return (run_bit ? 1 : 0) | (run << 1) | (literals << 33);
+    }
+
+    static bool run_bit(word_type marker)
+    {
+        return (marker & 1) != 0;
+    }
+
+    static word_type run_length(word_type marker)
+    {
+        return (marker >> 1) & max_run;
+    }
+
+    static word_type literal_count(word_type marker)
+    {
+        return marker >> 33;
+    }
+
+    static std::size_t block_count(std::size_t universe)
+    {
+        return (universe + block_bits - 1) / block_bits;
+    }
+};
+
+namespace bits
+{
+    // 64-bit block k of a bitmap set, whatever the word size of the set
+    template <class Set>
+    std::uint64_t load_block(const Set& s, std::size_t k)
+    {
+        static constexpr unsigned per_block = ewah_format::block_bits / Set::word_bits;
+        const typename Set::word_type* w = s.words();
+
+        if (per_block == 1)
+            return w[k];
+
+        std::uint64_t block = 0;
+        std::size_t first = k * per_block;
+        for (unsigned j = 0; j < per_block && first + j < s.word_count(); j++)
+        {
+            block |= static_cast<std::uint64_t>(w[first + j]) << (j * Set::word_bits);
+        }
+        return block;
+    }
+
+    template <class Set>
+    void store_block(Set& s, std::size_t k, std::uint64_t block)
+    {
+        static constexpr unsigned per_block = ewah_format::block_bits / Set::word_bits;
+
+        if (per_block == 1)
+        {
+            s.assign_word(k, static_cast<typename Set::word_type>(block));
+            return;
+        }
+
+        std::size_t first = k * per_block;
+        for (unsigned j = 0; j < per_block && first + j < s.word_count(); j++)
+        {
+            s.assign_word(first + j, static_cast<typename Set::word_type>(block >> (j * Set::word_bits)));
+        }
+    }
+} // bits
+
+///
+/// Streaming encoder. Blocks are added in order; completed words can be taken out at any time
+/// (everything except the currently open marker and its literal blocks), so the output can be sent
+/// down a pipe while the set is still being encoded.
+///
+class ewah_encoder
+{
+public:
+    typedef ewah_format::word_type word_type;
+
+private:
+    std::vector<word_type> m_out;
+    std::size_t m_marker_pos;
+    bool m_run_bit;
+    word_type m_run_length;
+    word_type m_literal_count;
+    std::size_t m_block;
+    std::size_t m_block_total;
+    bool m_finished;
+
+    void close_marker()
+    {
+        m_out[m_marker_pos] = ewah_format::marker(m_run_bit, m_run_length, m_literal_count);
+    }
+
+    void open_marker()
+    {
+        close_marker();
+        m_marker_pos = m_out.size();
+        m_out.push_back(0);
+        m_run_bit = false;
+        m_run_length = 0;
+        m_literal_count = 0;
+    }
+
+public:
+    ewah_encoder(std::size_t universe) : m_out(), m_marker_pos(2), m_run_bit(false), m_run_length(0), m_literal_count(0),
+        m_block(0), m_block_total(ewah_format::block_count(universe)), m_finished(false)
+    {
+        m_out.push_back(word_type(ewah_format::magic));
+        m_out.push_back(universe);
+        m_out.push_back(0); // the first marker
+    }
+
+    void add_block(word_type w)
+    {
+        if (w == 0 || w == ~word_type(0))
+        {
+            add_clean(w != 0, 1);
+            return;
+        }
+
+        if (m_literal_count == ewah_format::max_literals)
+        {
+            open_marker();
+        }
+        m_out.push_back(w);
+        ++m_literal_count;
+        ++m_block;
+    }
+
+    // adds count clean blocks in one go
+    void add_clean(bool bit, std::size_t count)
+    {
+        m_block += count;
+        while (count != 0)
+        {
+            if (m_literal_count != 0 || (m_run_length != 0 && m_run_bit != bit) || m_run_length == ewah_format::max_run)
+            {
+                open_marker();
+            }
+            m_run_bit = bit;
+            word_type n = std::min<word_type>(count, ewah_format::max_run - m_run_length);
+            m_run_length += n;
+            count -= static_cast<std::size_t>(n);
+        }
+    }
+
+    // pads the universe with zero blocks and closes the last marker
+    void finish()
+    {
+        if (m_finished)
+            return;
+        if (m_block < m_block_total)
+        {
+            add_clean(false, m_block_total - m_block);
+        }
+        close_marker();
+        m_marker_pos = m_out.size();
+        m_finished = true;
+    }
+
+    // moves the completed words into chunk; returns the number of words moved
+    std::size_t take(std::vector<word_type>& chunk)
+    {
+        std::size_t n = m_marker_pos;
+        chunk.insert(chunk.end(), m_out.begin(), m_out.begin() + n);
+        m_out.erase(m_out.begin(), m_out.begin() + n);
+        m_marker_pos = 0;
+        return n;
+    }
+
+    bool finished() const
+    {
+        return m_finished;
+    }
+};
+
+///
+/// Streaming decoder into a bitmap set (bounded_set or sparse_set). The input may be fed in chunks of any size,
+/// for example as it arrives from a pipe; the set is filled as the blocks are decoded.
+///
+/// The input is not trusted: a universe larger than max_size, which defaults to the largest size the bounded and sparse
+/// sets can hold, is rejected before the set is resized, and so are bits past the universe in its last block. A caller
+/// that knows how large the sets it receives can be passes a smaller max_size, so that a corrupt size word cannot
+/// make it allocate gigabytes.
+///
+template <class Set>
+class ewah_decoder
+{
+public:
+    typedef ewah_format::word_type word_type;
+
+    static constexpr std::size_t default_max_size = std::numeric_limits<unsigned>::max();
+
+private:
+    enum state_type { read_magic, read_size, read_marker, read_literals, decoded, malformed };
+
+    Set& m_set;
+    state_type m_state;
+    std::size_t m_block;
+    std::size_t m_block_total;
+    word_type m_literals_remaining;
+    word_type m_tail_mask;               // the bits of the last block past the universe
+    std::size_t m_max_size;
+
+    void next_marker()
+    {
+        m_state = (m_block == m_block_total) ? decoded : read_marker;
+    }
+
+public:
+    ewah_decoder(Set& s, std::size_t max_size = default_max_size) : m_set(s), m_state(read_magic), m_block(0), m_block_total(0),
+        m_literals_remaining(0), m_tail_mask(0), m_max_size(max_size)
+    {
+    }
+
+    // returns false once the input is found to be malformed
+    bool feed(const word_type* data, std::size_t n)
+    {
+        for (std::size_t i = 0; i < n; i++)
+        {
+            word_type w = data[i];
+            switch (m_state)
+            {
+            case read_magic:
+                m_state = (w == ewah_format::magic) ? read_size : malformed;
+                break;
+
+            case read_size:
+                if (w > m_max_size)
+                {
+                    m_state = malformed;
+                    return false;
+                }
+                m_set.resize(static_cast<std::size_t>(w));
+                m_set.clear();
+                m_block_total = ewah_format::block_count(static_cast<std::size_t>(w));
+                m_tail_mask = w % ewah_format::block_bits != 0 ? ~word_type(0) << (w % ewah_format::block_bits) : 0;
+                m_state = read_marker;
+                break;
+
+            case read_marker:
+            {
+                word_type run = ewah_format::run_length(w);
+                m_literals_remaining = ewah_format::literal_count(w);
+                bool tail_set = ewah_format::run_bit(w) && run != 0 && m_block + run == m_block_total && m_tail_mask != 0;
+                if (run + m_literals_remaining > m_block_total - m_block || tail_set)
+                {
+                    m_state = malformed;
+                    return false;
+                }
+                if (ewah_format::run_bit(w))
+                {
+                    for (std::size_t k = m_block, kStop = m_block + static_cast<std::size_t>(run); k < kStop; k++)
+                    {
+                        bits::store_block(m_set, k, ~word_type(0));
+                    }
+                }
+                m_block += static_cast<std::size_t>(run);
+                if (m_literals_remaining != 0)
+                    m_state = read_literals;
+                else
+                    next_marker();
+                break;
+            }
+
+            case read_literals:
+                if (m_block + 1 == m_block_total && (w & m_tail_mask) != 0)
+                {
+                    m_state = malformed;
+                    return false;
+                }
+                bits::store_block(m_set, m_block++, w);
+                if (--m_literals_remaining == 0)
+                    next_marker();
+                break;
+
+            case decoded:
+            case malformed:
+                m_state = malformed;
+                return false;
+            }
+        }
+        return m_state != malformed;
+    }
+
+    bool done() const
+    {
+        return m_state == decoded;
+    }
+};
+
+///
+/// Iterates the elements straight from an encoded buffer without decoding it into a set.
+/// Runs of zero blocks are skipped in constant time.
+///
+class ewah_const_iterator
+{
+public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef std::size_t value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef const std::size_t* pointer;
+    typedef const std::size_t& reference;
+    typedef ewah_format::word_type word_type;
+
+private:
+    const word_type* m_data;
+    std::size_t m_data_size;
+    std::size_t m_pos;
+    bool m_run_bit;
+    word_type m_run_remaining;
+    word_type m_literals_remaining;
+    std::size_t m_block;
+    word_type m_current;
+    std::size_t m_base;
+    std::size_t m_value;
+
+    bool load_block()
+    {
+        do
+        {
+            if (m_run_remaining != 0)
+            {
+                if (!m_run_bit)
+                {
+                    m_block += static_cast<std::size_t>(m_run_remaining);
+                    m_run_remaining = 0;
+                    continue;
+                }
+                m_current = ~word_type(0);
+                --m_run_remaining;
+            }
+            else if (m_literals_remaining != 0)
+            {
+                if (m_pos >= m_data_size)
+                    return false;
+                m_current = m_data[m_pos++];
+                --m_literals_remaining;
+            }
+            else
+            {
+                if (m_pos >= m_data_size)
+                    return false;
+                word_type marker = m_data[m_pos++];
+                m_run_bit = ewah_format::run_bit(marker);
+                m_run_remaining = ewah_format::run_length(marker);
+                m_literals_remaining = ewah_format::literal_count(marker);
+                continue;
+            }
+            m_base = m_block * ewah_format::block_bits;
+            ++m_block;
+        } while (m_current == 0);
+        return true;
+    }
+
+    void next()
+    {
+        if (m_current == 0 && !load_block())
+        {
+            m_data = nullptr;
+            m_pos = 0;
+            m_value = 0;
+            return;
+        }
+        unsigned p = bits::lsb(m_current);
+        m_current &= m_current - 1;
+        m_value = m_base + p;
+    }
+
+public:
+    ewah_const_iterator(const word_type* data, std::size_t size)
+        : m_data(data), m_data_size(size), m_pos(2), m_run_bit(false), m_run_remaining(0), m_literals_remaining(0),
+        m_block(0), m_current(0), m_base(0), m_value(0)
+    {
+        if (size < 2 || data[0] != ewah_format::magic)
+        {
+            m_data = nullptr;
+            m_pos = 0;
+            return;
+        }
+        next();
+    }
+
+    ewah_const_iterator() // end
+        : m_data(nullptr), m_data_size(0), m_pos(0), m_run_bit(false), m_run_remaining(0), m_literals_remaining(0),
+        m_block(0), m_current(0), m_base(0), m_value(0)
+    {
+    }
+
+    const std::size_t& operator*() const
+    {
+        return m_value;
+    }
+
+    ewah_const_iterator& operator++()
+    {
+        next();
+        return *this;
+    }
+
+    ewah_const_iterator operator++(int)
+    {
+        ewah_const_iterator tmp(*this);
+        next();
+        return tmp;
+    }
+
+    bool operator==(const ewah_const_iterator& y) const
+    {
+        return m_data == y.m_data && m_value == y.m_value && (m_data == nullptr || m_pos == y.m_pos);
+    }
+
+    bool operator!=(const ewah_const_iterator& y) const
+    {
+        return !(*this == y);
+    }
+};
+
+///
+/// A view over an encoded buffer, so that the elements can be scanned with a range-based for loop
+///
+class ewah_view
+{
+public:
+    typedef ewah_format::word_type word_type;
+    typedef ewah_const_iterator iterator;
+    typedef iterator const_iterator;
+
+    ewah_view(const word_type* data, std::size_t size) : m_data(data), m_data_size(size)
+    {
+    }
+
+    ewah_view(const std::vector<word_type>& buffer) : m_data(buffer.data()), m_data_size(buffer.size())
+    {
+    }
+
+    std::size_t size() const // the universe size
+    {
+        return m_data_size >= 2 ? static_cast<std::size_t>(m_data[1]) : 0;
+    }
+
+    iterator begin() const
+    {
+        return iterator(m_data, m_data_size);
+    }
+
+    iterator end() const
+    {
+        return iterator();
+    }
+
+private:
+    const word_type* m_data;
+    std::size_t m_data_size;
+};
+
+template <class Set>
+void ewah_encode(const Set& s, ewah_encoder& encoder)
+{
+    for (std::size_t k = 0, kStop = ewah_format::block_count(s.size()); k < kStop; k++)
+    {
+        encoder.add_block(bits::load_block(s, k));
+    }
+    encoder.finish();
+}
+
+template <class Set>
+std::vector<ewah_format::word_type> ewah_encode(const Set& s)
+{
+    ewah_encoder encoder(s.size());
+    ewah_encode(s, encoder);
+    std::vector<ewah_format::word_type> buffer;
+    encoder.take(buffer);
+    return buffer;
+}
+
+template <class Set>
+bool ewah_decode(const std::vector<ewah_format::word_type>& buffer, Set& s, std::size_t max_size = ewah_decoder<Set>::default_max_size)
+{
+    ewah_decoder<Set> decoder(s, max_size);
+    return decoder.feed(buffer.data(), buffer.size()) && decoder.done();
+}
@@ -18,6 +18,7 @@
 #include <bitset>
 #include <algorithm>
 #include <unordered_map>
+#include <unordered_set>
 
 
 using namespace std::chrono;
@@ -45,10 +46,24 @@ typedef duration<double, std::ratio<1, 1000>>    time_in_msec;
 #include "boost/dynamic_bitset/dynamic_bitset.hpp"
 #endif
 
-const unsigned steps = 100000000;
-const unsigned repeat = 1;
+// used by the extra tests; set from the command line (see benchmark::options)
+unsigned steps = 100000000;
+unsigned repeat = 1;
 
 #include "sparse_sets.h"
+#include "sparse_set_stream.h"
+#include "sparse_set_frozen.h"
+#include "sparse_set_static.h"
+#include "sparse_set_parallel.h"
+#include "sparse_set_operations.h"
+#include "sparse_set_tracked.h"
+#include "sparse_set_window.h"
+#include "sparse_set_hashed.h"
+#include "sparse_set_allocators.h"
+#include "benchmark_harness.h"
+
+typedef basic_bounded_set<huge_page_allocator<std::size_t> > huge_page_bounded_set;
+typedef basic_unordered_sparse_set<huge_page_allocator<std::size_t> > huge_page_unordered_sparse_set;
 
 int Eratosthenes_Bounded_Set(unsigned n)
 {
@@ -75,6 +90,30 @@ int Eratosthenes_Bounded_Set(unsigned n)
     return test_set.count();
 }
 
+// the odd numbers only, in a window of stride 2: half the bits of the bounded set
+int Eratosthenes_Odd_Window(unsigned n)
+{
+    window_set<bounded_set> test_set(3, n + 1, 2);
+
+    for (unsigned i = 3; i <= n; i += 2)
+    {
+        test_set.insert(i);
+    }
+
+    for (unsigned i = 3; i*i <= n; i += 2)
+    {
+        if (test_set.test(i))
+        {
+            for (unsigned j = i * i; j <= n; j += 2 * i)
+            {
+                test_set.erase(j);
+            }
+        }
+    }
+
+    return n >= 2 ? test_set.count() + 1 : 0; // and 2
+}
+
 int Eratosthenes_Unordered_Sparse_Set(unsigned n)
 {
     unordered_sparse_set test_set(n + 1);
@@ -247,6 +286,48 @@ unsigned Eratosthenes_Bitset()
     return test_set.count();
 }
 
+// the sieve of n in a set of a fixed size larger than n
+template <class Set>
+unsigned Eratosthenes_Fixed_Size(Set& test_set, unsigned n)
+{
+    test_set.clear();
+
+    test_set.insert(2);
+    for (unsigned i = 3; i <= n; i += 2)
+    {
+        test_set.insert(i);
+    }
+
+    for (unsigned i = 3; i*i <= n; i += 2)
+    {
+        if (test_set.test(i))
+        {
+            for (unsigned j = i + i; j <= n; j += i)
+            {
+                test_set.erase(j);
+            }
+        }
+    }
+
+    return static_cast<unsigned>(test_set.count());
+}
+
+template <class Set>
+void Test_Eratosthenes_Fixed_Size(Set& test_set, unsigned k, unsigned iterations, const char* title)
+{
+    std::chrono::high_resolution_clock::time_point t1 = std::chrono::high_resolution_clock::now();
+
+    unsigned counter = 0;
+    for (unsigned i = 0; i < iterations; i++)
+    {
+        counter += Eratosthenes_Fixed_Size(test_set, k + i);
+    }
+
+    std::chrono::high_resolution_clock::time_point t2 = std::chrono::high_resolution_clock::now();
+    time_in_msec time_span = duration_cast<time_in_msec>(t2 - t1);
+    std::cout << title << ". Counter: " << counter << " took " << time_span.count() << " milliseconds." << std::endl;
+}
+
 template <unsigned k, unsigned n>
 struct Test_Eratosthenes_Bitset_Impl
 {
@@ -281,8 +362,115 @@ void Test_Eratosthenes_Bitset()
 
     double timing = time_span.count();
     std::cout << "Bitset. Counter: " << counter << " took " << time_span.count() << " milliseconds." << std::endl;           
+
+    // the same range with fixed size sets that do not allocate either
+    static_bounded_set<k + iterations> static_set;
+    Test_Eratosthenes_Fixed_Size(static_set, k, iterations, "Static bounded set");
+
+    basic_bounded_set<std::allocator<std::size_t>, no_stats, (k + iterations + 63) / 64> inline_set(k + iterations);
+    Test_Eratosthenes_Fixed_Size(inline_set, k, iterations, "Bounded set with inline words");
+}
+
+
+// the same sieve evaluated by the compiler: the table is in read-only data and costs nothing at startup
+template <std::size_t n>
+constexpr static_bounded_set<n + 1> Eratosthenes_Static_Bounded_Set()
+{
+    static_bounded_set<n + 1> test_set;
+
+    test_set.insert(2);
+    for (std::size_t i = 3; i <= n; i += 2)
+    {
+        test_set.insert(i);
+    }
+
+    for (std::size_t i = 3; i*i <= n; i += 2)
+    {
+        if (test_set.test(i))
+        {
+            for (std::size_t j = i + i; j <= n; j += i)
+            {
+                test_set.erase(j);
+            }
+        }
+    }
+
+    return test_set;
+}
+
+static constexpr static_bounded_set<65537> static_primes = Eratosthenes_Static_Bounded_Set<65536>();
+static_assert(static_primes.count() == 6542, "the number of primes up to 65536");
+
+#if defined(__cpp_nontype_template_args) && __cpp_nontype_template_args >= 201911L
+// with C++20 a constant set can be a template argument
+template <static_bounded_set<128> Class>
+unsigned Count_Class(const std::string& text)
+{
+    unsigned counter = 0;
+    for (unsigned char c : text)
+    {
+        counter += Class.test(c);
+    }
+    return counter;
 }
+#endif
+
+void Test_Static_Bounded_Set()
+{
+    const unsigned n = 65536;
+    std::cout << "________________________________________________________________________" << std::endl;
+    std::cout << "Static prime table. Range [0, " << n << "]" << std::endl;
+
+    clk::time_point t1 = high_resolution_clock::now();
+    bounded_set runtime_primes(n + 1);
+    runtime_primes.insert(2);
+    for (unsigned i = 3; i <= n; i += 2)
+    {
+        runtime_primes.insert(i);
+    }
+    for (unsigned i = 3; i*i <= n; i += 2)
+    {
+        if (runtime_primes.test(i))
+        {
+            for (unsigned j = i + i; j <= n; j += i)
+            {
+                runtime_primes.erase(j);
+            }
+        }
+    }
+    clk::time_point t2 = clk::now();
+    time_in_msec time_span = duration_cast<time_in_msec>(t2 - t1);
+    std::cout << "Bounded set built at startup. Counter: " << runtime_primes.count() << " took " << time_span.count() << " milliseconds." << std::endl;
+
+    reset_random_uint();
+    t1 = high_resolution_clock::now();
+    unsigned counter = 0;
+    for (unsigned i = 0; i < steps; i++)
+    {
+        counter += static_primes.test(random_uint() % (n + 1));
+    }
+    t2 = clk::now();
+    time_span = duration_cast<time_in_msec>(t2 - t1);
+    std::cout << "Static bounded set (built at compile time: " << static_primes.count() << " primes). Random access counter: " << counter
+        << " took " << time_span.count() << " milliseconds." << std::endl;
+
+    reset_random_uint();
+    t1 = high_resolution_clock::now();
+    counter = 0;
+    for (unsigned i = 0; i < steps; i++)
+    {
+        counter += runtime_primes.test(random_uint() % (n + 1));
+    }
+    t2 = clk::now();
+    time_span = duration_cast<time_in_msec>(t2 - t1);
+    std::cout << "Bounded set. Random access counter: " << counter << " took " << time_span.count() << " milliseconds." << std::endl;
+    reset_random_uint();
 
+#if defined(__cpp_nontype_template_args) && __cpp_nontype_template_args >= 201911L
+    static constexpr static_bounded_set<128> digits = { '0', '1', '2', '3', '4', '5', '6', '7', '8', '9' };
+    std::cout << "Digits in \"sparse sets 2015-01-03\": " << Count_Class<digits>("sparse sets 2015-01-03") << std::endl;
+#endif
+}
 
 #ifdef USE_BOOST
 int Eratosthenes_Boost_Dynamic_Bitset(unsigned n)
@@ -310,919 +498,1735 @@ int Eratosthenes_Boost_Dynamic_Bitset(unsigned n)
 }
 #endif
 
+#ifdef USE_BOOST
+struct Boost_Dynamic_Bitset_Traits : benchmark::container_traits<boost::dynamic_bitset<std::size_t> >
+{
+    typedef boost::dynamic_bitset<std::size_t> Container;
 
+    static void insert(Container& c, unsigned x)
+    {
+        c[x] = true;
+    }
 
-//double f(unsigned n)
-//{
-//    return n*(double)n;// 1000.0 * sin(n);
-//}
-
-#define f(n) n
-
+    template <class F>
+    static void for_each(const Container& c, unsigned, F f)
+    {
+        std::size_t bit = c.find_first();
+        while (bit != c.npos)
+        {
+            f(bit);
+            bit = c.find_next(bit);
+        }
+    }
 
+    static void erase(Container& c, unsigned x)
+    {
+        c[x] = false;
+    }
+};
+#endif
 
-void Test_Bitset(const unordered_sparse_set& values)
+static const benchmark::container_entry containers[] =
 {
-    std::size_t length = values.size();
-    std::size_t selection = values.count();
-
-    if (values.size() > 1000000)
-        return;
-    std::cout << "_____________________________________________________" << std::endl;
-    std::cout << "bitset. length:" << length << " selection: " << selection << " density: " << (selection / (double)length * 100.0) << "%" << std::endl;
+    { "unordered_sparse_set", true, benchmark::run<unordered_sparse_set> },
+    { "unordered_sparse_set_huge_pages", true, benchmark::run<huge_page_unordered_sparse_set> },
+    { "paged_unordered_sparse_set", true, benchmark::run<paged_unordered_sparse_set> },
+#ifdef USE_BOOST
+    { "boost_dynamic_bitset", true, benchmark::run<boost::dynamic_bitset<std::size_t>, Boost_Dynamic_Bitset_Traits> },
+#endif
+    { "bounded_set", true, benchmark::run<bounded_set> },
+    { "bounded_set_huge_pages", true, benchmark::run<huge_page_bounded_set> },
+    { "cow_bounded_set", true, benchmark::run<cow_bounded_set> },
+    { "paged_bounded_set", true, benchmark::run<paged_bounded_set> },
+    { "adaptive_set", true, benchmark::run<adaptive_set> },
+    { "sparse_set", true, benchmark::run<sparse_set> },
+    { "sparse_map", true, benchmark::run<sparse_map<double>, benchmark::sparse_map_traits<sparse_map<double> > > },
+    { "unordered_map", true, benchmark::run<std::unordered_map<unsigned, double>, benchmark::unordered_map_traits<double> > },
+    { "vector_bool", true, benchmark::run<std::vector<bool>, benchmark::flag_vector_traits<std::vector<bool>, true, false> > },
+    { "vector_char", true, benchmark::run<std::vector<char>, benchmark::flag_vector_traits<std::vector<char>, 'T', '\0'> > },
+    { "set", false, benchmark::run<std::set<unsigned>, benchmark::std_set_traits<unsigned> > },
+    { "bitset", false, benchmark::run<std::bitset<1000000>, benchmark::bitset_traits<1000000> > },
+};
 
-    //std::vector<unsigned> v(n);
-    clk::time_point t1 = high_resolution_clock::now();
-    //std::vector<bool> vx(n);
-    std::bitset<1000000> vx;
-        
-    for (auto x: values)
-    {       
-        vx[x] = true;        
-    };
+template <class Set>
+void Test_Snapshot_Of(const unordered_sparse_set& values, const char* title)
+{
+    const unsigned length = values.size();
+    const unsigned snapshots = 100;
+    const unsigned writes_per_snapshot = 1000;
 
-    clk::time_point t2 = clk::now();
-    time_in_msec time_span = duration_cast<time_in_msec>(t2 - t1);
-    std::cout << "bitset. Generation. It took " << time_span.count() << " milliseconds." << std::endl;
+    Set test_set(length);
+    for (auto x : values)
+    {
+        test_set.insert(x);
+    }
+    test_set.begin(); // the sparse set builds its sequence here, as it would for the readers
 
     reset_random_uint();
-    t1 = high_resolution_clock::now();
-
-
-    double sum = 0;
-    unsigned counter = 0;
-    
+    clk::time_point t1 = high_resolution_clock::now();
 
-    for (unsigned i = 0; i < steps; ++i)
+    std::size_t counter = 0;
+    for (unsigned k = 0; k < snapshots; k++)
     {
-        unsigned k1 = random_uint() % length;
-        if (vx[k1])
+        Set snapshot(test_set);
+        counter += snapshot.test(values.begin()[k % values.count()]);
+
+        for (unsigned i = 0; i < writes_per_snapshot; i++)
         {
-            //sum += f(k1);
-            counter++;
+            unsigned k1 = random_uint() % length;
+            if (i & 1)
+                test_set.insert(k1);
+            else
+                test_set.erase(k1);
         }
     }
 
-    t2 = clk::now();
-    time_span = duration_cast<time_in_msec>(t2 - t1);
-    //double units = (time_span.count() / counter)*10000.0;
-    std::cout << "counter: " << counter << " sum: " << std::setprecision(15) << sum << std::endl;
-    std::cout << "bitset random access. It took " << time_span.count() << " milliseconds." << std::endl;
-
-    reset_random_uint();
-    t1 = high_resolution_clock::now();
-    sum = 0;
-    unsigned long long counter2 = 0;
-
-    for (unsigned k = 0; k < repeat; k++)
+    clk::time_point t2 = clk::now();
+    time_in_msec time_span = duration_cast<time_in_msec>(t2 - t1);
+    std::cout << "counter: " << counter << std::endl;
+    std::cout << title << ". " << snapshots << " snapshots with " << writes_per_snapshot << " writes each. It took " << time_span.count() << " milliseconds." << std::endl;
+
+    // snapshots kept while the source is written, elements of the snapshots included, must not change: each is
+    // compared with a bounded set copied from the source when it was taken
+    std::vector<Set> kept;
+    std::vector<bounded_set> references;
+    kept.reserve(10);
+    references.reserve(10);
+    for (unsigned k = 0; k < 10; k++)
+    {
+        kept.push_back(test_set);
+        references.push_back(bounded_set(length));
+        for (auto x : test_set)
+        {
+            references.back().insert(x);
+        }
+        for (unsigned i = 0; i < writes_per_snapshot; i++)
+        {
+            test_set.erase(values.begin()[random_uint() % values.count()]);
+            test_set.insert(random_uint() % length);
+        }
+    }
+    std::size_t mismatches = 0;
+    for (std::size_t k = 0; k < kept.size(); k++)
     {
-        for (unsigned p = 0; p < length; p++)
+        std::size_t n = 0;
+        for (auto x : kept[k])
         {
-            if (vx[p])
-            {
-                double coeff = random_uint();
-                sum += p * coeff;
-                counter2++;
-            }
+            mismatches += !references[k].test(x);
+            n++;
         }
+        mismatches += n != references[k].count();
     }
+    std::cout << "mismatches: " << mismatches << std::endl;
+    reset_random_uint();
+}
 
-    t2 = clk::now();
-    time_span = duration_cast<time_in_msec>(t2 - t1);
-    std::cout << "counter: " << counter2 << " sum: " << std::setprecision(15) << sum << std::endl;
-    std::cout << "bitset summation. It took " << (time_span.count() / repeat) << " milliseconds." << std::endl;
-    std::cout << "per element (in one iteration)" << 1000000.0*time_span.count() / (double)counter2 << " nanoseconds." << std::endl;
+void Test_Snapshot(const unordered_sparse_set& values)
+{
+    const unsigned length = values.size();
+    const unsigned selection = values.count();
 
+    std::cout << "_____________________________________________________" << std::endl;
+    std::cout << "SNAPSHOTS. length:" << length << " selection: " << selection << " density: " << (selection / (double)length * 100.0) << "%" << std::endl;
 
-    reset_random_uint();
+    Test_Snapshot_Of<bounded_set>(values, "Bounded set");
+    Test_Snapshot_Of<sparse_set>(values, "Sparse Set");
+    Test_Snapshot_Of<cow_bounded_set>(values, "Copy-on-write bounded set");
+}
 
-    t1 = high_resolution_clock::now();
+void Print_Operation_Counts(const operation_counts& c, const char* title)
+{
+    std::cout << title << ". inserts: " << c.inserts << " (no-op: " << c.noop_inserts << ") erases: " << c.erases
+        << " sequence invalidations: " << c.sequence_invalidations << " rebuilds: " << c.sequence_rebuilds << std::endl;
+    std::cout << "  words scanned by count: " << c.count_words << " empty: " << c.empty_words << " iteration: " << c.iteration_words << std::endl;
+}
 
+// a read-mostly workload with a scan after every batch of writes, replayed on containers that count their operations
+template <class Set>
+void Test_Operation_Stats_Of(const unordered_sparse_set& values, const char* title)
+{
+    const unsigned length = values.size();
+    const unsigned rounds = 100;
+    const unsigned writes_per_round = 100;
 
-    sum = 0;
-    counter = 0;
-    /*
-    for (unsigned i = 0; i < steps; ++i)
+    Set test_set(length);
+    for (auto x : values)
     {
-        unsigned k1 = random_uint() % length;
-        vx[k1] = false;
+        test_set.insert(x);
     }
-    */
 
-    for (auto x : values)
+    reset_random_uint();
+    std::size_t counter = 0;
+    for (unsigned k = 0; k < rounds; k++)
     {
-        vx[x] = false;
+        for (unsigned i = 0; i < writes_per_round; i++)
+        {
+            unsigned k1 = random_uint() % length;
+            if (i & 1)
+                test_set.insert(k1);
+            else
+                test_set.erase(k1);
+        }
+        for (auto x : test_set)
+        {
+            counter += x & 1;
+        }
+        counter += test_set.count() + test_set.empty();
     }
-
-    t2 = clk::now();
-    time_span = duration_cast<time_in_msec>(t2 - t1);
-
-    counter = vx.count();
-
     std::cout << "counter: " << counter << std::endl;
-    std::cout << "bitset random deletion. It took " << time_span.count() << " milliseconds." << std::endl;
+    Print_Operation_Counts(test_set.stats(), title);
     reset_random_uint();
 }
 
-void Test_Set(const unordered_sparse_set& values)
+void Test_Operation_Stats(const unordered_sparse_set& values)
 {
     const unsigned length = values.size();
     const unsigned selection = values.count();
+
+    std::cout << "_____________________________________________________" << std::endl;
+    std::cout << "OPERATION STATISTICS. length:" << length << " selection: " << selection << " density: " << (selection / (double)length * 100.0) << "%" << std::endl;
+
+    Test_Operation_Stats_Of<basic_bounded_set<std::allocator<std::size_t>, operation_stats> >(values, "Bounded set");
+    Test_Operation_Stats_Of<basic_sparse_set<std::allocator<std::size_t>, operation_stats> >(values, "Sparse Set");
+    Test_Operation_Stats_Of<basic_unordered_sparse_set<std::allocator<std::size_t>, operation_stats> >(values, "Unordered Sparse Set");
+}
+
+void Test_Paged_Bounded_Set_Huge_Universe(unsigned long long length, unsigned selection)
+{
     std::cout << "_____________________________________________________" << std::endl;
-    std::cout << "Set. length:" << length << " selection: " << selection << " density: " << (selection / (double)length * 100.0) << "%" << std::endl;
-       
+    std::cout << "PAGED BOUNDED SET. length:" << length << " selection: " << selection << " density: " << (selection / (double)length * 100.0) << "%" << std::endl;
+
+    std::mt19937_64 generator64(0x11111111);
+    std::vector<unsigned long long> values(selection);
+    for (auto& x : values)
+    {
+        x = generator64() % length;
+    }
+
     clk::time_point t1 = high_resolution_clock::now();
+    paged_bounded_set test_set(length);
 
-    std::set<unsigned> vx;
     for (auto x : values)
     {
-        vx.insert(x);
-    };
-    
+        test_set.insert(x);
+    }
+
     clk::time_point t2 = clk::now();
     time_in_msec time_span = duration_cast<time_in_msec>(t2 - t1);
-    std::cout << "Set. Generation. It took " << time_span.count() << " milliseconds." << std::endl;
+    std::cout << "pages: " << test_set.allocated_page_count() << " of " << test_set.page_count()
+        << ", memory: " << test_set.memory_usage() << " bytes (a bounded set would need " << length / 8 << " bytes)" << std::endl;
+    std::cout << "Paged bounded set. Generation. It took " << time_span.count() << " milliseconds." << std::endl;
 
-    reset_random_uint();
     t1 = high_resolution_clock::now();
 
-
-    double sum = 0;
     unsigned counter = 0;
-
-    
-
-    for (unsigned i = 0; i < steps; ++i)
+    for (unsigned i = 0; i < steps / 10; ++i)
     {
-        unsigned k1 = random_uint() % length;
-        if (vx.find(k1) != vx.end())
+        unsigned long long k1 = generator64() % length;
+        if (test_set.test(k1))
         {
-            //sum += f(k1);
             counter++;
         }
     }
 
     t2 = clk::now();
     time_span = duration_cast<time_in_msec>(t2 - t1);
-    std::cout << "counter: " << counter << " sum: " << std::setprecision(15) << sum << std::endl;
-    std::cout << "Set random access. It took " << time_span.count() << " milliseconds." << std::endl;
+    std::cout << "counter: " << counter << std::endl;
+    std::cout << "Paged bounded set random access (" << steps / 10 << " steps). It took " << time_span.count() << " milliseconds." << std::endl;
 
-    reset_random_uint();
     t1 = high_resolution_clock::now();
-    sum = 0;
-    unsigned long long counter2 = 0;
 
+    double sum = 0;
+    unsigned long long counter2 = 0;
     for (unsigned k = 0; k < repeat; k++)
     {
-        for (auto p: vx)
+        for (auto x : test_set)
         {
-            double coeff = random_uint();
-            sum += p * coeff;
+            sum += x;
             counter2++;
-        }        
+        }
     }
 
     t2 = clk::now();
     time_span = duration_cast<time_in_msec>(t2 - t1);
     std::cout << "counter: " << counter2 << " sum: " << std::setprecision(15) << sum << std::endl;
-    std::cout << "Set summation. It took " << (time_span.count() / repeat) << " milliseconds." << std::endl;
-    std::cout << "per element (in one iteration)" << 1000000.0*time_span.count() / (double)counter2 << " nanoseconds." << std::endl;       
+    std::cout << "Paged bounded set summation. It took " << (time_span.count() / repeat) << " milliseconds." << std::endl;
 
-    reset_random_uint();
+    // test() and the iteration against the sorted values, on the values and on random probes
+    std::vector<unsigned long long> sorted(values);
+    std::sort(sorted.begin(), sorted.end());
+    sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+    std::vector<unsigned long long> elements;
+    for (auto x : test_set)
+    {
+        elements.push_back(x);
+    }
+    std::size_t mismatches = elements != sorted;
+    for (auto x : sorted)
+    {
+        mismatches += !test_set.test(x);
+    }
+    for (unsigned i = 0; i < 100000; ++i)
+    {
+        unsigned long long k1 = generator64() % length;
+        mismatches += test_set.test(k1) != std::binary_search(sorted.begin(), sorted.end(), k1);
+    }
 
     t1 = high_resolution_clock::now();
 
-
-    sum = 0;
-    counter = 0;
-
-    /*
-    for (unsigned i = 0; i < steps; ++i)
+    for (auto x : values)
     {
-        unsigned k1 = random_uint() % length;
-        vx.erase(k1);
-        if (vx.empty())
-            break;
-    }
-    */
-
-    for (auto x : values)
-    {
-        vx.erase(x);
+        test_set.erase(x);
     }
 
     t2 = clk::now();
     time_span = duration_cast<time_in_msec>(t2 - t1);
-
-    counter = vx.size();
-
-    std::cout << "counter: " << counter << std::endl;
-    std::cout << "Set random deletion. It took " << time_span.count() << " milliseconds." << std::endl;
-    reset_random_uint();
+    std::cout << "counter: " << test_set.count() << " pages: " << test_set.allocated_page_count() << std::endl;
+    std::cout << "Paged bounded set random deletion. It took " << time_span.count() << " milliseconds." << std::endl;
+    mismatches += test_set.count() != 0 || test_set.allocated_page_count() != 0 || test_set.begin() != test_set.end();
+    std::cout << "mismatches: " << mismatches << std::endl;
 }
 
-
-void Test_Vector_of_Bool(const unordered_sparse_set& values)
+// clustered IDs in a universe far too large for the flat sparse array of the unordered sparse set
+void Test_Paged_Unordered_Sparse_Set_Clustered(unsigned length, unsigned selection)
 {
-    const unsigned length = values.size();
-    const unsigned selection = values.count();
-
     std::cout << "_____________________________________________________" << std::endl;
-    std::cout << "vector<bool>. length:" << length << " selection: " << selection << " density: " << (selection / (double)length * 100.0) << "%" << std::endl;
+    std::cout << "PAGED UNORDERED SPARSE SET. length:" << length << " selection: " << selection << " density: " << (selection / (double)length * 100.0) << "%"
+        << " distribution: clustered" << std::endl;
+
+    benchmark::id_generator generator(benchmark::clustered_ids, length, selection, 0x11111111);
+    std::vector<unsigned> values = benchmark::populate(generator, length, selection);
+    std::vector<unsigned> probes = benchmark::probe_stream(generator, steps / 10);
 
-    reset_random_uint();
-    
-    reset_random_uint();    
     clk::time_point t1 = high_resolution_clock::now();
-    
-    std::vector<bool> vx(length);
+    paged_unordered_sparse_set test_set(length);
 
     for (auto x : values)
     {
-        vx[x] = true;
+        test_set.insert(x);
     }
-        
+
     clk::time_point t2 = clk::now();
     time_in_msec time_span = duration_cast<time_in_msec>(t2 - t1);
-    std::cout << "vector<bool>. Generation. It took " << time_span.count() << " milliseconds." << std::endl;
+    std::cout << "pages: " << test_set.allocated_page_count() << " of " << test_set.page_count()
+        << ", memory: " << test_set.memory_usage() << " bytes (an unordered sparse set would need "
+        << (unsigned long long)length * 2 * sizeof(std::size_t) << " bytes)" << std::endl;
+    std::cout << "Paged unordered sparse set. Generation. It took " << time_span.count() << " milliseconds." << std::endl;
 
-    reset_random_uint();
     t1 = high_resolution_clock::now();
 
-
-    double sum = 0;
-    unsigned counter = 0;    
-
-    for (unsigned i = 0; i < steps; ++i)
+    unsigned counter = 0;
+    for (auto k1 : probes)
     {
-        unsigned k1 = random_uint() % length;
-        if (vx[k1])
+        if (test_set.test(k1))
         {
-            //sum += f(k1);
             counter++;
         }
     }
 
     t2 = clk::now();
     time_span = duration_cast<time_in_msec>(t2 - t1);
-    //double units = (time_span.count() / counter)*10000.0;
-    std::cout << "counter: " << counter << " sum: " << std::setprecision(15) << sum << std::endl;
-    std::cout << "vector<bool> random access. It took " << time_span.count() << " milliseconds." << std::endl;
+    std::cout << "counter: " << counter << std::endl;
+    std::cout << "Paged unordered sparse set random access (" << probes.size() << " steps). It took " << time_span.count() << " milliseconds." << std::endl;
 
-    reset_random_uint();
     t1 = high_resolution_clock::now();
-    sum = 0;
-    unsigned long long counter2 = 0;
-
 
+    double sum = 0;
     for (unsigned k = 0; k < repeat; k++)
     {
-        unsigned p = 0;
-        for (std::vector<bool>::const_iterator it = vx.cbegin(), itStop = vx.cend(); it != itStop; ++it)
+        for (auto x : test_set)
         {
-            if (*it)
-            {
-                double coeff = random_uint();
-                sum += p * coeff;
-                counter2++;
-            }
-            p++;
+            sum += x;
         }
     }
 
     t2 = clk::now();
     time_span = duration_cast<time_in_msec>(t2 - t1);
-    std::cout << "counter: " << counter2 << " sum: " << std::setprecision(15) << sum << std::endl;
-    std::cout << "vector<bool> summation. It took " << (time_span.count() / repeat) << " milliseconds." << std::endl;
-    std::cout << "per element (in one iteration)" << 1000000.0*time_span.count() / (double)counter2 << " nanoseconds." << std::endl;
+    std::cout << "sum: " << std::setprecision(15) << sum << std::endl;
+    std::cout << "Paged unordered sparse set summation. It took " << (time_span.count() / repeat) << " milliseconds." << std::endl;
 
-    //unsigned total_elements = counter2 / repeat;
-    //double density = total_elements / (double)length * 100.0;
-    //std::cout << " length: " << length << " total elements:" << total_elements << " Density: " << density << "%" << std::endl;
+    // test() and the iteration, in insertion order, against the sorted values; the probes fall in and out of the clusters
+    std::vector<unsigned> sorted(values);
+    std::sort(sorted.begin(), sorted.end());
+    sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+    std::vector<unsigned> elements;
+    for (auto x : test_set)
+    {
+        elements.push_back(static_cast<unsigned>(x));
+    }
+    std::sort(elements.begin(), elements.end());
+    std::size_t mismatches = elements != sorted;
+    for (auto x : sorted)
+    {
+        mismatches += !test_set.test(x);
+    }
+    for (auto k1 : probes)
+    {
+        mismatches += test_set.test(k1) != std::binary_search(sorted.begin(), sorted.end(), k1);
+    }
 
+    t1 = high_resolution_clock::now();
 
+    for (auto x : values)
+    {
+        test_set.erase(x);
+    }
 
-    reset_random_uint();
+    t2 = clk::now();
+    time_span = duration_cast<time_in_msec>(t2 - t1);
+    std::cout << "counter: " << test_set.count() << " pages: " << test_set.allocated_page_count() << std::endl;
+    std::cout << "Paged unordered sparse set random deletion. It took " << time_span.count() << " milliseconds." << std::endl;
+    mismatches += test_set.count() != 0 || test_set.allocated_page_count() != 0 || test_set.begin() != test_set.end();
+    std::cout << "mismatches: " << mismatches << std::endl;
+}
 
-    t1 = high_resolution_clock::now();
+// many tags over one universe: which tags contain an element, with one bounded set per tag and with a set family
+void Test_Set_Family(unsigned length, unsigned tags)
+{
+    const unsigned per_tag = length / 100;
+    const unsigned queries = steps / 1000;
 
+    std::cout << "_____________________________________________________" << std::endl;
+    std::cout << "SET FAMILY. length:" << length << " tags: " << tags << " elements per tag: " << per_tag << " queries: " << queries << std::endl;
 
-    sum = 0;
-    counter = 0;
-    /*
-    for (unsigned i = 0; i < steps; ++i)
+    std::vector<bounded_set> tag_sets(tags, bounded_set(length));
+    set_family family(tags, length);
+    reset_random_uint();
+    for (unsigned t = 0; t < tags; t++)
     {
-        unsigned k1 = random_uint() % length;
-        vx[k1] = false;
-        bool empty = true;
-        for (auto x : vx)
+        for (unsigned k = 0; k < per_tag; k++)
         {
-            if (x)
-            {
-                empty = false;
-                break;
-            }
+            unsigned x = random_uint() % length;
+            tag_sets[t].insert(x);
+            family.insert(t, x);
         }
-        if (empty)
-            break;
     }
-    */
 
-    for (auto x : values)
+    std::vector<unsigned> probes(queries);
+    for (auto& x : probes)
     {
-        vx[x] = false;
+        x = random_uint() % length;
     }
+    reset_random_uint();
 
+    clk::time_point t1 = high_resolution_clock::now();
+    std::size_t counter = 0;
+    for (auto x : probes)
+    {
+        for (unsigned t = 0; t < tags; t++)
+        {
+            counter += tag_sets[t].test(x);
+        }
+    }
+    clk::time_point t2 = clk::now();
+    time_in_msec time_span = duration_cast<time_in_msec>(t2 - t1);
+    std::cout << "counter: " << counter << std::endl;
+    std::cout << "Bounded set per tag, tags of an element. It took " << time_span.count() << " milliseconds." << std::endl;
+
+    t1 = high_resolution_clock::now();
+    family.transpose();
     t2 = clk::now();
     time_span = duration_cast<time_in_msec>(t2 - t1);
+    std::cout << "Set family transpose to column major (" << family.memory_usage() << " bytes). It took " << time_span.count() << " milliseconds." << std::endl;
 
-    
-    for (auto x: vx)
+    std::vector<set_family::word_type> tags_of(family.vector_words());
+    t1 = high_resolution_clock::now();
+    counter = 0;
+    for (auto x : probes)
     {
-        if (x)
-        {            
-            counter++;
-        }        
+        family.membership(x, tags_of.data());
+        for (auto w : tags_of)
+        {
+            counter += bits::count_bits(w);
+        }
     }
+    t2 = clk::now();
+    time_span = duration_cast<time_in_msec>(t2 - t1);
+    std::cout << "counter: " << counter << std::endl;
+    std::cout << "Set family (column major), tags of an element. It took " << time_span.count() << " milliseconds." << std::endl;
 
+    family.transpose();
+    std::vector<std::size_t> some_tags;
+    for (unsigned t = 0; t < tags; t += 16)
+    {
+        some_tags.push_back(t);
+    }
+    std::vector<set_family::word_type> any_of(family.row_words());
+    t1 = high_resolution_clock::now();
+    family.rows_or(some_tags.data(), some_tags.size(), any_of.data());
+    t2 = clk::now();
+    time_span = duration_cast<time_in_msec>(t2 - t1);
+    counter = 0;
+    for (auto w : any_of)
+    {
+        counter += bits::count_bits(w);
+    }
     std::cout << "counter: " << counter << std::endl;
-    std::cout << "vector<bool> random deletion. It took " << time_span.count() << " milliseconds." << std::endl;
-    reset_random_uint();
+    std::cout << "Set family (row major), union of " << some_tags.size() << " tags. It took " << time_span.count() << " milliseconds." << std::endl;
+}
+
+// times one way of intersecting every posting list with the large set; returns the total size of the intersections
+template <class F>
+std::size_t Time_Intersections(const std::vector<std::vector<std::uint32_t>>& lists, F intersect_one, const char* title)
+{
+    std::vector<std::uint32_t> out;
+    clk::time_point t1 = high_resolution_clock::now();
+    std::size_t counter = 0;
+    for (auto& list : lists)
+    {
+        intersect_one(list, out);
+        counter += out.size();
+    }
+    clk::time_point t2 = clk::now();
+    time_in_msec time_span = duration_cast<time_in_msec>(t2 - t1);
+    std::cout << "counter: " << counter << std::endl;
+    std::cout << title << ". It took " << time_span.count() << " milliseconds." << std::endl;
+    return counter;
 }
 
+// the number of results of the kernels and overloads on a and b, in a universe of length, that differ from merging
+template <class T>
+std::size_t Check_Set_Operations(const std::vector<T>& a, const std::vector<T>& b, std::size_t length)
+{
+    using namespace set_operations;
+
+    std::vector<T> common(std::min(a.size(), b.size()));
+    common.resize(intersect_merge(a.data(), a.size(), b.data(), b.size(), common.data()));
+    std::vector<T> all(a.size() + b.size());
+    all.resize(unite_merge(a.data(), a.size(), b.data(), b.size(), all.data()));
+    std::vector<T> rest(a.size());
+    rest.resize(subtract_merge(a.data(), a.size(), b.data(), b.size(), rest.data()));
+
+    const std::vector<T>& small = a.size() <= b.size() ? a : b;
+    const std::vector<T>& large = a.size() <= b.size() ? b : a;
+    bounded_set set_a(length);
+    bounded_set set_b(length);
+    for (auto x : a)
+    {
+        set_a.insert(x);
+    }
+    for (auto x : b)
+    {
+        set_b.insert(x);
+    }
+
+    std::size_t mismatches = 0;
+    std::vector<T> out;
+    bounded_set result;
+    auto check_set = [&](const std::vector<T>& expected)
+    {
+        out.clear();
+        for (auto x : result)
+        {
+            out.push_back(static_cast<T>(x));
+        }
+        mismatches += out != expected;
+    };
 
+    for (auto kernel : { merge_kernel, block_kernel, scan_kernel, galloping_kernel })
+    {
+        out.resize(small.size());
+        out.resize(intersect(a.data(), a.size(), b.data(), b.size(), out.data(), kernel));
+        mismatches += out != common;
+    }
+    out.resize(a.size());
+    out.resize(probe(a.data(), a.size(), bitmap(set_b), out.data(), true));
+    mismatches += out != common;
+    out.resize(a.size() + b.size());
+    out.resize(unite_galloping(small.data(), small.size(), large.data(), large.size(), out.data()));
+    mismatches += out != all;
+    out.resize(a.size());
+    out.resize(subtract_galloping(a.data(), a.size(), b.data(), b.size(), out.data()));
+    mismatches += out != rest;
+    out.resize(a.size());
+    out.resize(probe(a.data(), a.size(), bitmap(set_b), out.data(), false));
+    mismatches += out != rest;
+
+    intersect(sorted(a), sorted(b), out);
+    mismatches += out != common;
+    intersect(sorted(a), bitmap(set_b), out);
+    mismatches += out != common;
+    intersect(bitmap(set_a), sorted(b), out);
+    mismatches += out != common;
+    unite(sorted(a), sorted(b), out);
+    mismatches += out != all;
+    subtract(sorted(a), sorted(b), out);
+    mismatches += out != rest;
+    subtract(sorted(a), bitmap(set_b), out);
+    mismatches += out != rest;
+
+    intersect(bitmap(set_a), bitmap(set_b), result);
+    check_set(common);
+    unite(bitmap(set_a), bitmap(set_b), result);
+    check_set(all);
+    unite(bitmap(set_a), sorted(b), result);
+    check_set(all);
+    unite(sorted(a), bitmap(set_b), result);
+    check_set(all);
+    subtract(bitmap(set_a), bitmap(set_b), result);
+    check_set(rest);
+    subtract(bitmap(set_a), sorted(b), result);
+    check_set(rest);
+    return mismatches;
+}
 
-void Test_Vector_of_Char(const unordered_sparse_set& values)
+// the query planner case: short posting lists intersected with a large set, and two large sets with each other
+void Test_Set_Operations(unsigned length, unsigned large, unsigned list_length, unsigned lists)
 {
-    const unsigned length = values.size();
-    const unsigned selection = values.count();
+    using namespace set_operations;
 
     std::cout << "_____________________________________________________" << std::endl;
-    std::cout << "vector<char>. length:" << length << " selection: " << selection << " density: " << (selection / (double)length * 100.0) << "%" << std::endl;
+    std::cout << "SET OPERATIONS. length:" << length << " large set: " << large << " posting lists: " << lists << " x " << list_length << std::endl;
 
-    clk::time_point t1 = high_resolution_clock::now();    
-    std::vector<char> vx(length);
+    sparse_set big(length);
+    sparse_set other(length);
+    reset_random_uint();
+    for (unsigned n = 0; n < large; )
+    {
+        n += big.insert(random_uint() % length);
+    }
+    for (unsigned n = 0; n < large; )
+    {
+        n += other.insert(random_uint() % length);
+    }
 
-    for (auto x : values)
+    std::vector<std::uint32_t> big_sorted;
+    for (auto x : big)
+    {
+        big_sorted.push_back(static_cast<std::uint32_t>(x));
+    }
+
+    std::vector<std::vector<std::uint32_t>> posting(lists);
+    for (auto& list : posting)
+    {
+        bounded_set ids(length);
+        for (unsigned k = 0; k < list_length; k++)
+        {
+            ids.insert(random_uint() % length);
+        }
+        for (auto x : ids)
+        {
+            list.push_back(x);
+        }
+    }
+    reset_random_uint();
+
+    Time_Intersections(posting, [&](const std::vector<std::uint32_t>& list, std::vector<std::uint32_t>& out)
     {
-        vx[x] = 'T';
+        out.clear();
+        for (auto x : list)
+        {
+            if (big.test(x))
+                out.push_back(x);
+        }
+    }, "Posting list x sparse set, loop by hand");
+
+    Time_Intersections(posting, [&](const std::vector<std::uint32_t>& list, std::vector<std::uint32_t>& out)
+    {
+        intersect(sorted(list), bitmap(big), out);
+    }, "Posting list x sparse set bitmap, probe");
+
+    // merging would read the whole large array for every list
+    kernel_type kernel = choose_kernel(list_length, large);
+    std::string title = std::string("Posting list x sorted array, ") + kernel_name(kernel);
+    Time_Intersections(posting, [&](const std::vector<std::uint32_t>& list, std::vector<std::uint32_t>& out)
+    {
+        intersect(sorted(list), sorted(big_sorted), out);
+    }, title.c_str());
+
+    // two large sets: their sequences against each other and their bit arrays word by word
+    std::vector<std::size_t> both;
+    sorted(big);
+    sorted(other);
+    for (auto kernel : { merge_kernel, block_kernel, scan_kernel })
+    {
+        clk::time_point t1 = high_resolution_clock::now();
+        both.resize(large);
+        both.resize(intersect(sorted(big).data, large, sorted(other).data, large, both.data(), kernel));
+        clk::time_point t2 = clk::now();
+        time_in_msec time_span = duration_cast<time_in_msec>(t2 - t1);
+        std::cout << "counter: " << both.size() << std::endl;
+        std::cout << "Sparse set sequences, " << kernel_name(kernel) << ". It took " << time_span.count() << " milliseconds." << std::endl;
     }
 
+    clk::time_point t1 = high_resolution_clock::now();
+    bounded_set result;
+    intersect(bitmap(big), bitmap(other), result);
     clk::time_point t2 = clk::now();
     time_in_msec time_span = duration_cast<time_in_msec>(t2 - t1);
-    std::cout << "vector<char>. Generation. It took " << time_span.count() << " milliseconds." << std::endl;
+    std::cout << "counter: " << result.count() << std::endl;
+    std::cout << "Sparse set bit arrays, " << kernel_name(bitmap_kernel) << ". It took " << time_span.count() << " milliseconds." << std::endl;
 
-    reset_random_uint();
-    t1 = high_resolution_clock::now();
+    // every kernel and overload against merging: the posting lists with the next one, an empty list, a few lists
+    // with the large set and the two large sets (merging reads the large arrays, so not every list)
+    std::vector<std::uint32_t> other_sorted;
+    for (auto x : other)
+    {
+        other_sorted.push_back(static_cast<std::uint32_t>(x));
+    }
+    std::size_t mismatches = Check_Set_Operations(std::vector<std::uint32_t>(), posting.front(), length);
+    for (std::size_t k = 0; k < posting.size() && k < 100; k++)
+    {
+        mismatches += Check_Set_Operations(posting[k], posting[(k + 1) % posting.size()], length);
+        if (k < 4)
+            mismatches += Check_Set_Operations(posting[k], big_sorted, length) + Check_Set_Operations(big_sorted, posting[k], length);
+    }
+    mismatches += Check_Set_Operations(big_sorted, other_sorted, length);
+    std::cout << "mismatches: " << mismatches << std::endl;
+}
 
+// per-element work heavy enough to be worth a thread: the weight of an element is a few rounds of a hash
+double Element_Weight(std::size_t x)
+{
+    std::uint64_t h = x;
+    for (unsigned k = 0; k < 64; k++)
+    {
+        h ^= h >> 31;
+        h *= 0x9E3779B97F4A7C15ull;
+    }
+    return static_cast<double>(h >> 11) * (1.0 / 9007199254740992.0);
+}
 
-    double sum = 0;
-    unsigned counter = 0;    
+// the weighted sum of the elements, on one thread, on equal ranges of the universe and on balanced pieces
+void Test_Parallel(const unordered_sparse_set& values)
+{
+    const unsigned length = values.size();
+    const unsigned selection = values.count();
+    parallel::work_stealing_pool& pool = parallel::default_pool();
+    const std::size_t pieces = pool.thread_count() * parallel::pieces_per_thread;
 
-    for (unsigned i = 0; i < steps; ++i)
+    std::cout << "_____________________________________________________" << std::endl;
+    std::cout << "PARALLEL SCAN. length:" << length << " selection: " << selection << " threads: " << pool.thread_count() << std::endl;
+
+    bounded_set bounded(length);
+    for (auto x : values)
     {
-        unsigned k1 = random_uint() % length;
-        if (vx[k1] == 'T')
-        {
-            //sum += f(k1);
-            counter++;
-        }
+        bounded.insert(x);
     }
 
-    t2 = clk::now();
-    time_span = duration_cast<time_in_msec>(t2 - t1);
-    //double units = (time_span.count() / counter)*10000.0;
-    std::cout << "counter: " << counter << " sum: " << std::setprecision(15) << sum << std::endl;
-    std::cout << "vector<bool> random access. It took " << time_span.count() << " milliseconds." << std::endl;
-
+    clk::time_point t1 = high_resolution_clock::now();
+    double sum = 0;
+    for (auto x : bounded)
+    {
+        sum += x * Element_Weight(x);
+    }
+    clk::time_point t2 = clk::now();
+    time_in_msec time_span = duration_cast<time_in_msec>(t2 - t1);
+    std::cout << "sum: " << std::setprecision(15) << sum << std::endl;
+    std::cout << "One thread. It took " << time_span.count() << " milliseconds." << std::endl;
 
-    reset_random_uint();
+    // equal ranges of words: on clustered data a few of them hold most of the elements
+    std::vector<parallel::piece> ranges = parallel::partition_positions(bounded.word_count(), pieces);
+    std::vector<double> partial(ranges.size());
+    std::vector<std::size_t> counts(ranges.size());
     t1 = high_resolution_clock::now();
+    pool.run(ranges.size(), [&](std::size_t k)
+    {
+        double s = 0;
+        std::size_t n = 0;
+        auto f = [&](std::size_t x)
+        {
+            s += x * Element_Weight(x);
+            n++;
+        };
+        parallel::for_each_in_words(bounded.words(), ranges[k], f);
+        partial[k] = s;
+        counts[k] = n;
+    });
     sum = 0;
-    unsigned long long counter2 = 0;
-
+    for (auto s : partial)
+    {
+        sum += s;
+    }
+    t2 = clk::now();
+    time_span = duration_cast<time_in_msec>(t2 - t1);
+    std::cout << "sum: " << std::setprecision(15) << sum << std::endl;
+    std::cout << "Equal ranges of the universe (largest piece: " << *std::max_element(counts.begin(), counts.end()) << " elements). It took "
+        << time_span.count() << " milliseconds." << std::endl;
 
-    for (unsigned k = 0; k < repeat; k++)
+    std::vector<parallel::piece> balanced = parallel::partition(bounded, pieces, pool, 0);
+    std::size_t largest = 0;
+    for (auto& p : balanced)
     {
-        unsigned p = 0;
-        for (std::vector<char>::const_iterator it = vx.cbegin(), itStop = vx.cend(); it != itStop; ++it)
-        {
-            if (*it == 'T')
-            {
-                double coeff = random_uint();
-                sum += p * coeff;
-                counter2++;
-            }
-            p++;
-        }
+        std::size_t n = 0;
+        auto f = [&](std::size_t) { n++; };
+        parallel::for_each_in_words(bounded.words(), p, f);
+        largest = std::max(largest, n);
     }
 
+    t1 = high_resolution_clock::now();
+    sum = parallel_reduce(bounded, 0.0, [](double a, double b) { return a + b; }, [](std::size_t x) { return x * Element_Weight(x); });
     t2 = clk::now();
     time_span = duration_cast<time_in_msec>(t2 - t1);
-    std::cout << "counter: " << counter2 << " sum: " << std::setprecision(15) << sum << std::endl;
-    std::cout << "vector<char> summation. It took " << (time_span.count() / repeat) << " milliseconds." << std::endl;
-    std::cout << "per element (in one iteration)" << 1000000.0*time_span.count() / (double)counter2 << " nanoseconds." << std::endl;
-    
-    reset_random_uint();
+    std::cout << "sum: " << std::setprecision(15) << sum << std::endl;
+    std::cout << "parallel_reduce, pieces balanced by popcount (largest piece: " << largest << " elements). It took "
+        << time_span.count() << " milliseconds." << std::endl;
+}
 
-    t1 = high_resolution_clock::now();
+// narrow windows over the set, as in range queries: the sparse set decodes only the words of each window
+void Test_Range_Scan(const unordered_sparse_set& values)
+{
+    const unsigned length = values.size();
+    const unsigned selection = values.count();
+    const unsigned windows = 10000;
+    const unsigned width = 4096;
 
+    std::cout << "_____________________________________________________" << std::endl;
+    std::cout << "RANGE SCAN. length:" << length << " selection: " << selection << " density: " << (selection / (double)length * 100.0) << "%"
+        << " windows: " << windows << " width: " << width << std::endl;
 
-    sum = 0;
-    counter = 0;
+    sparse_set sparse(length);
+    bounded_set bounded(length);
+    for (auto x : values)
+    {
+        sparse.insert(x);
+        bounded.insert(x);
+    }
 
+    std::vector<unsigned> starts(windows);
+    reset_random_uint();
+    for (auto& a : starts)
+    {
+        a = random_uint() % length;
+    }
+    reset_random_uint();
 
-    /*
-    for (unsigned i = 0; i < steps; ++i)
+    clk::time_point t1 = high_resolution_clock::now();
+    double sum = 0;
+    for (auto a : starts)
     {
-        unsigned k1 = random_uint() % length;
-        vx[k1] = '\0';
-        bool empty = true;
-        for (auto x : vx)
+        for (auto x : sparse.range(a, a + width))
         {
-            if (x == 'T')
-            {
-                empty = false;
-                break;
-            }
+            sum += x;
         }
-        if (empty)
-            break;
     }
-    */
+    clk::time_point t2 = clk::now();
+    time_in_msec time_span = duration_cast<time_in_msec>(t2 - t1);
+    std::cout << "sum: " << sum << std::endl;
+    std::cout << "Sparse Set range. It took " << time_span.count() << " milliseconds." << std::endl;
 
-    for (auto x : values)
+    t1 = high_resolution_clock::now();
+    sum = 0;
+    for (auto a : starts)
     {
-        vx[x] = '\0';
+        for (auto it = bounded.lower_bound(a), itStop = bounded.end(); it != itStop && *it < a + width; ++it)
+        {
+            sum += *it;
+        }
     }
-
     t2 = clk::now();
     time_span = duration_cast<time_in_msec>(t2 - t1);
-    
-    for (auto x: vx)
+    std::cout << "sum: " << sum << std::endl;
+    std::cout << "Bounded set lower_bound. It took " << time_span.count() << " milliseconds." << std::endl;
+
+    t1 = high_resolution_clock::now();
+    sum = 0;
+    for (auto a : starts)
     {
-        if (x == 'T')
-        {            
-            counter++;
-        }        
+        for (auto it = sparse.lower_bound(a), itStop = sparse.lower_bound(a + width); it != itStop; ++it) // builds the sequence once
+        {
+            sum += *it;
+        }
     }
-
-    std::cout << "counter: " << counter << std::endl;
-    std::cout << "vector<char> random deletion. It took " << time_span.count() << " milliseconds." << std::endl;
-    reset_random_uint();
+    t2 = clk::now();
+    time_span = duration_cast<time_in_msec>(t2 - t1);
+    std::cout << "sum: " << sum << std::endl;
+    std::cout << "Sparse Set lower_bound (with the sequence). It took " << time_span.count() << " milliseconds." << std::endl;
 }
 
-void Test_Bounded_Set(const unordered_sparse_set& values)
+// the runs of consecutive elements, as in time-ordered ID batches: coalesced from the elements, or found a word at a time
+void Test_Runs(const unordered_sparse_set& values)
 {
     const unsigned length = values.size();
     const unsigned selection = values.count();
 
     std::cout << "_____________________________________________________" << std::endl;
-    std::cout << "BOUNDED SET. length:" << length << " selection: " << selection << " density: " << (selection / (double)length * 100.0) << "%" << std::endl;
-    reset_random_uint();
-
+    std::cout << "RUNS. length:" << length << " selection: " << selection << std::endl;
 
-    clk::time_point t1 = high_resolution_clock::now();
-    bounded_set test_set(length);
-    
+    bounded_set bounded(length);
     for (auto x : values)
     {
-        test_set.insert(x);
+        bounded.insert(x);
     }
 
+    clk::time_point t1 = high_resolution_clock::now();
+    std::vector<bounded_set::run_type> coalesced;
+    for (auto x : bounded)
+    {
+        if (!coalesced.empty() && coalesced.back().last == x)
+            coalesced.back().last++;
+        else
+            coalesced.push_back(bounded_set::run_type{ x, x + 1 });
+    }
     clk::time_point t2 = clk::now();
     time_in_msec time_span = duration_cast<time_in_msec>(t2 - t1);
-
-    double timing = time_span.count();
-    std::cout << "Bounded set. Generation. It took " << time_span.count() << " milliseconds." << std::endl;
-
-    reset_random_uint();
+    std::cout << "runs: " << coalesced.size() << std::endl;
+    std::cout << "Coalescing the elements. It took " << time_span.count() << " milliseconds." << std::endl;
 
     t1 = high_resolution_clock::now();
+    std::vector<bounded_set::run_type> runs;
+    bounded.for_each_run([&](std::size_t first, std::size_t last)
+    {
+        runs.push_back(bounded_set::run_type{ first, last });
+    });
+    t2 = clk::now();
+    time_span = duration_cast<time_in_msec>(t2 - t1);
+    std::cout << "runs: " << runs.size() << std::endl;
+    std::cout << "for_each_run. It took " << time_span.count() << " milliseconds." << std::endl;
 
+    std::size_t mismatches = runs.size() != coalesced.size() ? 1 : 0;
+    for (std::size_t k = 0; mismatches == 0 && k < runs.size(); k++)
+    {
+        mismatches += runs[k].first != coalesced[k].first || runs[k].last != coalesced[k].last;
+    }
+    std::cout << "mismatches: " << mismatches << std::endl;
 
-    double sum = 0;
-    unsigned counter = 0;    
-
-    for (unsigned i = 0; i < steps; ++i)
+    t1 = high_resolution_clock::now();
+    bounded_set elementwise(length);
+    for (auto& r : runs)
     {
-        unsigned k1 = random_uint() % length;
-        if (test_set.test(k1))
+        for (std::size_t x = r.first; x < r.last; x++)
         {
-            //sum += f(k1);
-            counter++;
+            elementwise.insert(x);
         }
     }
+    t2 = clk::now();
+    time_span = duration_cast<time_in_msec>(t2 - t1);
+    std::cout << "Building from the runs, an element at a time. It took " << time_span.count() << " milliseconds." << std::endl;
 
+    t1 = high_resolution_clock::now();
+    bounded_set rebuilt(length);
+    rebuilt.insert_runs(runs.begin(), runs.end());
     t2 = clk::now();
     time_span = duration_cast<time_in_msec>(t2 - t1);
-    //double units = (time_span.count() / counter)*10000.0;
-    std::cout << "counter: " << counter << " sum: " << std::setprecision(15) << sum << std::endl;
-    std::cout << "bounded set random access. It took " << time_span.count() << " milliseconds." << std::endl;
+    mismatches = 0;
+    for (std::size_t k = 0; k < rebuilt.word_count(); k++)
+    {
+        mismatches += rebuilt.words()[k] != bounded.words()[k] || elementwise.words()[k] != bounded.words()[k];
+    }
+    std::cout << "mismatches: " << mismatches << std::endl;
+    std::cout << "Building from the runs with insert_runs. It took " << time_span.count() << " milliseconds." << std::endl;
+}
+
+// a slot allocator over a nearly full set: the free slots are the complement, and the lowest one is allocated first
+void Test_Free_Slots(unsigned length, unsigned holes, unsigned allocations)
+{
+    std::cout << "_____________________________________________________" << std::endl;
+    std::cout << "FREE SLOTS. length:" << length << " free: " << holes << " allocations: " << allocations << std::endl;
 
+    bounded_set used(length);
+    used.insert_run(0, length);
     reset_random_uint();
-    t1 = high_resolution_clock::now();
+    for (unsigned k = 0; k < holes; k++)
+    {
+        used.erase(random_uint() % length);
+    }
+    reset_random_uint();
+
+    clk::time_point t1 = high_resolution_clock::now();
+    double sum = 0;
+    for (unsigned x = 0; x < length; x++)
+    {
+        if (!used.test(x))
+            sum += x;
+    }
+    clk::time_point t2 = clk::now();
+    time_in_msec time_span = duration_cast<time_in_msec>(t2 - t1);
+    std::cout << "sum: " << sum << std::endl;
+    std::cout << "Testing every slot. It took " << time_span.count() << " milliseconds." << std::endl;
 
+    t1 = high_resolution_clock::now();
     sum = 0;
-    unsigned long long counter2 = 0;
+    used.for_each_absent([&](std::size_t x) { sum += x; });
+    t2 = clk::now();
+    time_span = duration_cast<time_in_msec>(t2 - t1);
+    std::cout << "sum: " << sum << std::endl;
+    std::cout << "for_each_absent. It took " << time_span.count() << " milliseconds." << std::endl;
 
-    for (unsigned k = 0; k < repeat; k++)
+    bounded_set slots(used);
+    t1 = high_resolution_clock::now();
+    sum = 0;
+    for (unsigned k = 0; k < allocations; k++)
     {
-        for (bounded_set::const_iterator it = test_set.begin(), itStop = test_set.end(); it != itStop; ++it)
+        unsigned x = 0;
+        while (x < length && slots.test(x))
         {
-            double coeff = random_uint();
-            sum += *it * coeff;//f(*it);
-            counter2++;
+            x++;
         }
+        slots.insert(x);
+        sum += x;
     }
+    t2 = clk::now();
+    time_span = duration_cast<time_in_msec>(t2 - t1);
+    std::cout << "sum: " << sum << std::endl;
+    std::cout << "Allocation by testing from slot 0. It took " << time_span.count() << " milliseconds." << std::endl;
 
+    slots = used;
+    t1 = high_resolution_clock::now();
+    sum = 0;
+    for (unsigned k = 0; k < allocations; k++)
+    {
+        std::size_t x = slots.find_first_absent();
+        slots.insert(x);
+        sum += x;
+    }
     t2 = clk::now();
     time_span = duration_cast<time_in_msec>(t2 - t1);
-    std::cout << "counter: " << counter2 << " sum: " << std::setprecision(15) << sum << std::endl;
+    std::cout << "sum: " << sum << std::endl;
+    std::cout << "Allocation by find_first_absent(). It took " << time_span.count() << " milliseconds." << std::endl;
 
-    timing = time_span.count();
-    std::cout << "Bounded set summation. It took " << (time_span.count() / repeat) << " milliseconds." << std::endl;
-    std::cout << "per element (in one iteration)" << 1000000.0*time_span.count() / (double)counter2 << " nanoseconds." << std::endl;
+    slots = used;
+    t1 = high_resolution_clock::now();
+    sum = 0;
+    std::size_t hint = 0;
+    for (unsigned k = 0; k < allocations; k++)
+    {
+        hint = slots.find_first_absent(hint); // nothing below the last slot allocated is free
+        slots.insert(hint);
+        sum += hint;
+    }
+    t2 = clk::now();
+    time_span = duration_cast<time_in_msec>(t2 - t1);
+    std::cout << "sum: " << sum << std::endl;
+    std::cout << "Allocation by find_first_absent(hint). It took " << time_span.count() << " milliseconds." << std::endl;
+}
+
+// an incremental consumer that keeps a copy of a set up to date after every batch of changes: by comparing the words
+// of the set with those of its copy, or by reading the changes since its last checkpoint
+void Test_Change_Tracking(unsigned length, unsigned selection, unsigned batch, unsigned batches)
+{
+    std::cout << "_____________________________________________________" << std::endl;
+    std::cout << "CHANGE TRACKING. length:" << length << " selection: " << selection << " batch: " << batch << " batches: " << batches << std::endl;
 
+    tracked_set<bounded_set> tracked(length);
+    reset_random_uint();
+    for (unsigned k = 0; k < selection; k++)
+    {
+        tracked.insert(random_uint() % length);
+    }
+    std::vector<unsigned> changes(batch * batches);
+    for (auto& x : changes)
+    {
+        x = random_uint() % length;
+    }
     reset_random_uint();
 
-    t1 = high_resolution_clock::now();
+    bounded_set copy(tracked.set());
+    time_in_msec scan_time(0), tracked_time(0);
+    double scan_sum = 0, tracked_sum = 0;
+    auto c = tracked.checkpoint();
+    bounded_set mirror(tracked.set());
+    for (unsigned b = 0; b < batches; b++)
+    {
+        for (unsigned k = b * batch; k < (b + 1) * batch; k++)
+        {
+            if (!tracked.insert(changes[k]))
+                tracked.erase(changes[k]);
+        }
 
+        clk::time_point t1 = high_resolution_clock::now();
+        const bounded_set& current = tracked.set();
+        for (std::size_t w = 0; w < current.word_count(); w++)
+        {
+            bounded_set::word_type d = current.words()[w] ^ copy.words()[w];
+            if (d == 0)
+                continue;
+            for (; d != 0; d &= d - 1)
+            {
+                std::size_t x = w * bounded_set::word_bits + bits::trailing_zeros64(d);
+                scan_sum += current.test(x) ? x : -double(x);
+            }
+            copy.assign_word(w, current.words()[w]);
+        }
+        clk::time_point t2 = clk::now();
+        scan_time += duration_cast<time_in_msec>(t2 - t1);
 
-    sum = 0;
-    counter = 0;
+        t1 = high_resolution_clock::now();
+        tracked.for_each_change(c, [&](std::size_t x, bool inserted)
+        {
+            if (inserted)
+                mirror.insert(x);
+            else
+                mirror.erase(x);
+            tracked_sum += inserted ? x : -double(x);
+        });
+        c = tracked.checkpoint();
+        t2 = clk::now();
+        tracked_time += duration_cast<time_in_msec>(t2 - t1);
+    }
+
+    std::size_t mismatches = 0;
+    for (std::size_t w = 0; w < mirror.word_count(); w++)
+    {
+        mismatches += mirror.words()[w] != tracked.set().words()[w] || copy.words()[w] != tracked.set().words()[w];
+    }
+    std::cout << "mismatches: " << mismatches << std::endl;
+    std::cout << "sum: " << scan_sum << std::endl;
+    std::cout << "Comparing the words with a copy. It took " << scan_time.count() << " milliseconds." << std::endl;
+    std::cout << "sum: " << tracked_sum << std::endl;
+    std::cout << "tracked_set changes and checkpoint. It took " << tracked_time.count() << " milliseconds." << std::endl;
+}
 
+// a window of recent IDs around 3,000,000,000 that moves as new IDs arrive: the bit array covers the window only
+template <class Set>
+void Test_Sliding_Window_Of(unsigned width, unsigned ids, unsigned step, const char* title)
+{
+    const std::size_t base = 3000000000ull;
+    window_set<Set> window(base, base + width);
 
-    /*
-    for (unsigned i = 0; i < steps; ++i)
+    clk::time_point t1 = high_resolution_clock::now();
+    std::size_t slides = 0;
+    for (std::size_t id = base; id < base + ids; id++)
     {
-        unsigned k1 = random_uint() % length;
-        test_set.erase(k1);
-        if (test_set.empty())
-            break;
+        if (id >= window.upper())
+        {
+            window.slide(step);
+            slides++;
+        }
+        if ((id * 0x9E3779B97F4A7C15ull) >> 63 == 0) // about half of the IDs, cheaper to draw than random_uint()
+            window.insert(id);
     }
-    */
+    clk::time_point t2 = clk::now();
+    time_in_msec time_span = duration_cast<time_in_msec>(t2 - t1);
 
-    for (auto x : values)
+    double sum = 0;
+    for (auto x : window)
     {
-        test_set.erase(x);
+        sum += x - window.lower();
     }
+    std::cout << "window: [" << window.lower() << ", " << window.upper() << ") slides: " << slides << " sum: " << sum << std::endl;
+    std::cout << title << ". It took " << time_span.count() << " milliseconds." << std::endl;
+}
 
-    t2 = clk::now();
-    time_span = duration_cast<time_in_msec>(t2 - t1);
+// a window of the given stride moved up and down at random, by slide() and rebase(), against a std::set of its values;
+// returns the number of differences
+template <class Set>
+std::size_t Check_Sliding_Window(std::size_t width, std::size_t stride, unsigned moves)
+{
+    const std::size_t base = 3000000000ull;
+    window_set<Set> window(base, base + width * stride, stride);
+    std::set<std::size_t> model;
+    std::size_t mismatches = 0;
+    reset_random_uint();
+    for (unsigned m = 0; m < moves; m++)
+    {
+        for (unsigned k = 0; k < 64; k++)
+        {
+            // also values just outside the window and between its slots
+            std::size_t x = window.lower() - stride + random_uint() % ((width + 2) * stride);
+            bool inside = x >= window.lower() && x < window.upper() && (x - window.lower()) % stride == 0;
+            if (k % 4 == 3)
+            {
+                window.erase(x);
+                model.erase(x);
+                continue;
+            }
+            mismatches += window.insert(x) != (inside && model.insert(x).second);
+        }
 
-    counter = test_set.count();
+        // up or down by up to 3/4 of the width, and now and then past the whole window
+        std::ptrdiff_t steps = static_cast<std::ptrdiff_t>(random_uint() % (3 * width / 2 + 1)) - static_cast<std::ptrdiff_t>(3 * width / 4);
+        if (m % 16 == 15)
+            steps = static_cast<std::ptrdiff_t>(width + 1) * (steps < 0 ? -1 : 1);
+        std::size_t lower = steps >= 0 ? window.lower() + steps * stride : window.lower() - static_cast<std::size_t>(-steps) * stride;
+        if (m % 2 == 0)
+            window.slide(steps);
+        else
+            window.rebase(lower);
+        model.erase(model.begin(), model.lower_bound(lower));
+        model.erase(model.lower_bound(lower + width * stride), model.end());
+
+        std::vector<std::size_t> elements;
+        for (auto x : window)
+        {
+            elements.push_back(x);
+        }
+        std::sort(elements.begin(), elements.end());
+        mismatches += window.lower() != lower || window.count() != model.size();
+        mismatches += elements != std::vector<std::size_t>(model.begin(), model.end());
+    }
 
-    std::cout << "counter: " << counter << std::endl;
-    std::cout << "bounded set random deletion. It took " << time_span.count() << " milliseconds." << std::endl;
-    reset_random_uint();
+    // the window may reach 0 but not pass it
+    window_set<Set> low(10 * stride, 10 * stride + width * stride, stride);
+    try
+    {
+        low.slide(-11);
+        mismatches++;
+    }
+    catch (const std::invalid_argument&)
+    {
+    }
+    low.slide(-10);
+    mismatches += low.lower() != 0;
+    return mismatches;
 }
 
+void Test_Sliding_Window(unsigned width, unsigned ids, unsigned step)
+{
+    std::cout << "_____________________________________________________" << std::endl;
+    std::cout << "SLIDING WINDOW. width:" << width << " ids: " << ids << " step: " << step
+        << " words: " << (width + 63) / 64 << " (against " << (3000000000ull + ids + 63) / 64 << " from 0)" << std::endl;
+
+    Test_Sliding_Window_Of<bounded_set>(width, ids, step, "Bounded set window");
+    Test_Sliding_Window_Of<sparse_set>(width, ids, step, "Sparse set window");
+    Test_Sliding_Window_Of<unordered_sparse_set>(width, ids, step, "Unordered sparse set window");
+
+    // the moves in both directions: the word shifts of the bit arrays and the element by element shift
+    std::size_t mismatches = Check_Sliding_Window<bounded_set>(4096, 1, 2000) + Check_Sliding_Window<sparse_set>(4096, 1, 2000)
+        + Check_Sliding_Window<unordered_sparse_set>(4096, 1, 2000) + Check_Sliding_Window<bounded_set>(1000, 2, 2000)
+        + Check_Sliding_Window<sparse_set>(1000, 3, 2000);
+    std::cout << "mismatches: " << mismatches << std::endl;
+}
 
-void Test_Unordered_Sparse_Set(const unordered_sparse_set& values)
+// the elements of a set, in the order of its iteration
+template <class Set>
+std::vector<std::size_t> Elements_Of(const Set& s)
 {
-    //std::cout << "start test" << std::endl;
-    const unsigned length = values.size();
-    //std::cout << "after length" << std::endl;
-    const unsigned selection = values.count();
+    std::vector<std::size_t> elements;
+    for (auto x : s)
+    {
+        elements.push_back(x);
+    }
+    return elements;
+}
 
+// the comparisons of a and b on the words that differ from their elements: equality, inclusion, intersection, hashes
+template <class Set1, class Set2>
+std::size_t Check_Set_Comparisons(const Set1& a, const Set2& b)
+{
+    std::vector<std::size_t> ea = Elements_Of(a);
+    std::vector<std::size_t> eb = Elements_Of(b);
+    std::vector<std::size_t> common;
+    std::set_intersection(ea.begin(), ea.end(), eb.begin(), eb.end(), std::back_inserter(common));
+
+    std::size_t mismatches = 0;
+    mismatches += a.equals(b) != (ea == eb);
+    mismatches += a.is_subset_of(b) != (common.size() == ea.size());
+    mismatches += b.is_subset_of(a) != (common.size() == eb.size());
+    mismatches += a.intersects(b) != !common.empty();
+    mismatches += ea == eb && a.hash() != b.hash();
+    return mismatches;
+}
+
+// a dedup cache of filter sets, half of which repeat an earlier one, some with an element more: pairs of sets compared
+// an element at a time and by words, and the sets deduplicated with hashes computed on the words or kept by hashed_set
+void Test_Set_Equality(unsigned length, unsigned sets, unsigned elements)
+{
     std::cout << "_____________________________________________________" << std::endl;
-    std::cout << "UNORDERED SPARSE SET. length:" << length << " selection: " << selection << " density: " << (selection/(double)length * 100.0) << "%" << std::endl;
+    std::cout << "SET EQUALITY. length:" << length << " sets: " << sets << " elements: " << elements << std::endl;
+
+    std::vector<bounded_set> filters;
+    std::vector<hashed_set<bounded_set> > hashed;
+    std::vector<std::pair<std::size_t, std::size_t> > pairs;
     reset_random_uint();
+    for (std::size_t k = 0; k < sets; k++)
+    {
+        if (k % 2 == 1)
+        {
+            std::size_t source = random_uint() % k;
+            bounded_set filter(filters[source]);
+            hashed_set<bounded_set> h(hashed[source]);
+            if (random_uint() % 2 == 0)
+            {
+                unsigned x = random_uint() % length;
+                filter.insert(x);
+                h.insert(x);
+            }
+            filters.push_back(filter);
+            hashed.push_back(h);
+            pairs.push_back(std::make_pair(k, source));
+            continue;
+        }
 
+        bounded_set filter(length);
+        for (unsigned j = 0; j < elements; j++)
+        {
+            filter.insert(random_uint() % length);
+        }
+        filters.push_back(filter);
+        hashed.push_back(hashed_set<bounded_set>(filter));
+    }
+    reset_random_uint();
 
     clk::time_point t1 = high_resolution_clock::now();
-    unordered_sparse_set test_set(length);
-    //std::cout << "unordered sparse set created" << std::endl;
-
-    for (auto x : values)
+    std::size_t equal = 0;
+    for (auto& p : pairs)
     {
-        test_set.insert(x);
+        const bounded_set& a = filters[p.first];
+        const bounded_set& b = filters[p.second];
+        bool same = true;
+        for (auto x : a)
+        {
+            if (!b.test(x))
+            {
+                same = false;
+                break;
+            }
+        }
+        for (auto it = b.begin(), itStop = b.end(); same && it != itStop; ++it)
+        {
+            same = a.test(*it);
+        }
+        equal += same;
     }
-
     clk::time_point t2 = clk::now();
     time_in_msec time_span = duration_cast<time_in_msec>(t2 - t1);
+    std::cout << "equal pairs: " << equal << " of " << pairs.size() << std::endl;
+    std::cout << "Comparing the elements. It took " << time_span.count() << " milliseconds." << std::endl;
 
-    double timing = time_span.count();
-    std::cout << "Unordered Sparse set. Generation. It took " << time_span.count() << " milliseconds." << std::endl;
+    t1 = high_resolution_clock::now();
+    equal = 0;
+    for (auto& p : pairs)
+    {
+        equal += filters[p.first] == filters[p.second];
+    }
+    t2 = clk::now();
+    time_span = duration_cast<time_in_msec>(t2 - t1);
+    std::cout << "equal pairs: " << equal << " of " << pairs.size() << std::endl;
+    std::cout << "operator== on the words. It took " << time_span.count() << " milliseconds." << std::endl;
 
-    reset_random_uint();
+    t1 = high_resolution_clock::now();
+    std::size_t subsets = 0;
+    for (auto& p : pairs)
+    {
+        subsets += filters[p.second].is_subset_of(filters[p.first]);
+    }
+    t2 = clk::now();
+    time_span = duration_cast<time_in_msec>(t2 - t1);
+    std::cout << "subsets: " << subsets << " of " << pairs.size() << std::endl;
+    std::cout << "is_subset_of. It took " << time_span.count() << " milliseconds." << std::endl;
 
+    // the tables hold indices, so that the sets are not copied
+    auto hash_words = [&](std::size_t k) { return std::hash<bounded_set>()(filters[k]); };
+    auto equal_words = [&](std::size_t a, std::size_t b) { return filters[a] == filters[b]; };
     t1 = high_resolution_clock::now();
+    std::unordered_set<std::size_t, decltype(hash_words), decltype(equal_words)> unique(2 * sets, hash_words, equal_words);
+    for (std::size_t k = 0; k < sets; k++)
+    {
+        unique.insert(k);
+    }
+    t2 = clk::now();
+    time_span = duration_cast<time_in_msec>(t2 - t1);
+    std::cout << "distinct sets: " << unique.size() << std::endl;
+    std::cout << "Deduplication, hashing the words. It took " << time_span.count() << " milliseconds." << std::endl;
+
+    auto hash_kept = [&](std::size_t k) { return std::hash<hashed_set<bounded_set> >()(hashed[k]); };
+    auto equal_kept = [&](std::size_t a, std::size_t b) { return hashed[a] == hashed[b]; };
+    t1 = high_resolution_clock::now();
+    std::unordered_set<std::size_t, decltype(hash_kept), decltype(equal_kept)> unique_hashed(2 * sets, hash_kept, equal_kept);
+    for (std::size_t k = 0; k < sets; k++)
+    {
+        unique_hashed.insert(k);
+    }
+    t2 = clk::now();
+    time_span = duration_cast<time_in_msec>(t2 - t1);
+    std::cout << "distinct sets: " << unique_hashed.size() << std::endl;
+    std::cout << "Deduplication, hashes kept by hashed_set. It took " << time_span.count() << " milliseconds." << std::endl;
+
+    // the comparisons against the elements: the pairs both ways, unrelated and disjoint sets, the kept hashes, the
+    // same elements in larger universes and in a sparse set, and a set shrunk below some of its elements
+    std::size_t mismatches = 0;
+    for (auto& p : pairs)
+    {
+        mismatches += Check_Set_Comparisons(filters[p.first], filters[p.second]);
+    }
+    for (std::size_t k = 0; k + 2 < sets; k += 2)
+    {
+        mismatches += Check_Set_Comparisons(filters[k], filters[k + 2]);
+    }
+    for (std::size_t k = 0; k < sets; k++)
+    {
+        mismatches += hashed[k].hash() != hashed[k].set().hash() || hashed[k].hash() != filters[k].hash();
+        mismatches += !(hashed[k].set() == filters[k]);
+    }
+    for (std::size_t k = 0; k < sets && k < 20; k += 2)
+    {
+        const bounded_set& filter = filters[k];
+        bounded_set low(length / 2);
+        bounded_set high(length);
+        bounded_set padded(length + 1000);
+        sparse_set sparse(2 * length + 7);
+        hashed_set<sparse_set> kept(2 * length + 7);
+        for (auto x : filter)
+        {
+            (x < length / 2 ? low : high).insert(x);
+            padded.insert(x);
+            sparse.insert(x);
+            kept.insert(x);
+        }
+        mismatches += Check_Set_Comparisons(low, high) + Check_Set_Comparisons(low, filter) + Check_Set_Comparisons(high, filter);
+        mismatches += Check_Set_Comparisons(filter, padded) + Check_Set_Comparisons(filter, sparse);
+        mismatches += Check_Set_Comparisons(padded, sparse) + Check_Set_Comparisons(sparse, filter);
+        mismatches += !filter.equals(kept.set()) || kept.hash() != filter.hash();
+
+        padded.insert(length + 500);
+        sparse.insert(2 * length);
+        kept.insert(2 * length);
+        kept.erase(*filter.begin());
+        mismatches += Check_Set_Comparisons(filter, padded) + Check_Set_Comparisons(padded, sparse);
+        mismatches += kept.hash() != kept.set().hash() || kept.equals(hashed_set<bounded_set>(filter));
+
+        // shrinking drops the elements past the new size, also those in its last word
+        std::size_t size = length - 30;
+        bounded_set shrunk(filter);
+        sparse_set shrunk_sparse(length);
+        bounded_set below(size);
+        sparse_set below_sparse(size);
+        for (auto x : filter)
+        {
+            shrunk_sparse.insert(x);
+            if (x < size)
+            {
+                below.insert(x);
+                below_sparse.insert(x);
+            }
+        }
+        shrunk.insert(length - 1);
+        shrunk_sparse.insert(length - 1);
+        shrunk.resize(size);
+        shrunk_sparse.resize(size);
+        mismatches += Elements_Of(shrunk) != Elements_Of(below) || Elements_Of(shrunk_sparse) != Elements_Of(below);
+        mismatches += shrunk.count() != below.count() || shrunk_sparse.count() != below.count();
+        mismatches += !(shrunk == below) || !(shrunk_sparse == below_sparse);
+        mismatches += Check_Set_Comparisons(shrunk, below) + Check_Set_Comparisons(shrunk_sparse, shrunk);
+        shrunk.resize(length);
+        mismatches += !(shrunk == below) || shrunk.test(length - 1);
+    }
+    std::cout << "mismatches: " << mismatches << std::endl;
+}
 
+// the layered alternative to handle_set: an unordered sparse set of indices with a separate version table and free list
+class Versioned_Unordered_Sparse_Set
+{
+    unordered_sparse_set m_ids;
+    std::vector<std::uint32_t> m_versions;
+    std::vector<std::uint32_t> m_free;
 
-    double sum = 0;
-    unsigned counter = 0;    
+public:
+    Versioned_Unordered_Sparse_Set(unsigned capacity) : m_ids(capacity), m_versions(), m_free()
+    {
+    }
 
-    for (unsigned i = 0; i < steps; ++i)
+    std::uint64_t insert()
     {
-        unsigned k1 = random_uint() % length;
-        if (test_set.test(k1))
+        std::uint32_t index;
+        if (!m_free.empty())
         {
-            //sum += f(k1);
-            counter++;
+            index = m_free.back();
+            m_free.pop_back();
         }
+        else
+        {
+            index = static_cast<std::uint32_t>(m_versions.size());
+            m_versions.push_back(0);
+        }
+        m_ids.insert(index);
+        return (static_cast<std::uint64_t>(m_versions[index]) << 32) | index;
     }
 
-    t2 = clk::now();
-    time_span = duration_cast<time_in_msec>(t2 - t1);
-    //double units = (time_span.count() / counter)*10000.0;
-    std::cout << "counter: " << counter << " sum: " << std::setprecision(15) << sum << std::endl;
-    std::cout << "Unordered Sparse Set random access. It took " << time_span.count() << " milliseconds." << std::endl;
-
-    reset_random_uint();
-    t1 = high_resolution_clock::now();
-
-    sum = 0;
-    unsigned long long counter2 = 0;
-
-    for (unsigned k = 0; k < repeat; k++)
+    bool test(std::uint64_t h) const
     {
-        for (unordered_sparse_set::iterator it = test_set.begin(), itStop = test_set.end(); it != itStop; ++it)
-        {
-            double coeff = random_uint();
-            sum += *it * coeff;//f(*it);
-            counter2++;
-        }
+        std::uint32_t index = static_cast<std::uint32_t>(h);
+        return index < m_versions.size() && m_versions[index] == (h >> 32) && m_ids.test(index);
     }
 
-    t2 = clk::now();
-    time_span = duration_cast<time_in_msec>(t2 - t1);
-    std::cout << "counter: " << counter2 << " sum: " << std::setprecision(15) << sum << std::endl;
+    bool erase(std::uint64_t h)
+    {
+        if (!test(h))
+            return false;
+        std::uint32_t index = static_cast<std::uint32_t>(h);
+        m_ids.erase(index);
+        m_versions[index]++;
+        m_free.push_back(index);
+        return true;
+    }
+};
 
-    timing = time_span.count();
-    std::cout << "Unordered Sparse Set summation. It took " << (time_span.count() / repeat) << " milliseconds." << std::endl;
-    std::cout << "per element (in one iteration)" << 1000000.0*time_span.count() / (double)counter2 << " nanoseconds." << std::endl;
+// every step erases a random live ID, checks that its handle is stale and allocates a new one in its place
+template <class Set>
+void Test_Handle_Churn_Of(unsigned live, unsigned churn, const char* title)
+{
+    Set ids(live);
+    std::vector<std::uint64_t> handles(live);
+    for (auto& h : handles)
+    {
+        h = ids.insert();
+    }
 
     reset_random_uint();
+    clk::time_point t1 = high_resolution_clock::now();
 
-    t1 = high_resolution_clock::now();
+    std::size_t counter = 0;
+    for (unsigned i = 0; i < churn; i++)
+    {
+        std::uint64_t& h = handles[random_uint() % live];
+        counter += ids.test(h);
+        ids.erase(h);
+        counter += ids.test(h);
+        h = ids.insert();
+    }
 
+    clk::time_point t2 = clk::now();
+    time_in_msec time_span = duration_cast<time_in_msec>(t2 - t1);
+    std::cout << "counter: " << counter << std::endl;
+    std::cout << title << ". It took " << time_span.count() << " milliseconds ("
+        << churn / time_span.count() / 1000.0 << " million IDs recycled per second)." << std::endl;
+    reset_random_uint();
+}
 
-    sum = 0;
-    counter = 0;
+void Test_Handle_Churn(unsigned live, unsigned churn)
+{
+    std::cout << "_____________________________________________________" << std::endl;
+    std::cout << "HANDLE CHURN. live IDs: " << live << " recycled: " << churn << std::endl;
 
+    Test_Handle_Churn_Of<handle_set>(live, churn, "Handle set");
+    Test_Handle_Churn_Of<Versioned_Unordered_Sparse_Set>(live, churn, "Unordered sparse set with a version table");
+}
 
-    /*
-    for (unsigned i = 0; i < steps; ++i)
-    {
-        unsigned k1 = random_uint() % length;
-        test_set.erase(k1);
-        if (test_set.empty())
-            break;
-    }
-    */
-    for (auto x : values)
+// millions of short lived sets over a small universe (a filter per request, the neighbours of a node...)
+template <class Set>
+void Test_Tiny_Sets_Of(unsigned universe, unsigned count, const char* title)
+{
+    // the keys are drawn beforehand, so that the loop measures the sets and the allocator
+    std::vector<unsigned> keys(4096);
+    reset_random_uint();
+    for (auto& k : keys)
     {
-        //unsigned k1 = random_uint() % length;
-        test_set.erase(x);
-        //if (test_set.empty())
-        //    break;
+        k = random_uint() % universe;
     }
 
+    clk::time_point t1 = high_resolution_clock::now();
 
-    t2 = clk::now();
-    time_span = duration_cast<time_in_msec>(t2 - t1);
-
-    counter = test_set.count();
+    std::size_t counter = 0;
+    std::size_t next = 0;
+    for (unsigned i = 0; i < count; i++)
+    {
+        Set s(universe);
+        for (unsigned j = 0; j < 8; j++)
+        {
+            s.insert(keys[next++ & 4095]);
+        }
+        counter += s.test(keys[next++ & 4095]);
+    }
 
+    clk::time_point t2 = clk::now();
+    time_in_msec time_span = duration_cast<time_in_msec>(t2 - t1);
     std::cout << "counter: " << counter << std::endl;
-    std::cout << "Unordered Sparse Set random deletion. It took " << time_span.count() << " milliseconds." << std::endl;
+    std::cout << title << ". It took " << time_span.count() << " milliseconds." << std::endl;
     reset_random_uint();
 }
 
-#ifdef USE_BOOST
-void Test_Boost_Dynamic_Bitset(const unordered_sparse_set& values)
+void Test_Tiny_Sets(unsigned universe, unsigned count)
+{
+    std::cout << "_____________________________________________________" << std::endl;
+    std::cout << "TINY SETS. universe: " << universe << " sets: " << count << std::endl;
+
+    Test_Tiny_Sets_Of<bounded_set>(universe, count, "Bounded set (inline words)");
+    Test_Tiny_Sets_Of<basic_bounded_set<std::allocator<std::size_t>, no_stats, 0>>(universe, count, "Bounded set (words on the heap)");
+    Test_Tiny_Sets_Of<sparse_set>(universe, count, "Sparse set (inline words)");
+    Test_Tiny_Sets_Of<basic_sparse_set<std::allocator<std::size_t>, no_stats, 0>>(universe, count, "Sparse set (words on the heap)");
+}
+
+// the read-only serving phase: a frozen set against the mutable sets it was built from
+void Test_Frozen(const unordered_sparse_set& values)
 {
     const unsigned length = values.size();
     const unsigned selection = values.count();
 
     std::cout << "_____________________________________________________" << std::endl;
-    std::cout << "BOOST DYNAMIC BITSET. length:" << length << " selection: " << selection << " density: " << (selection / (double)length * 100.0) << "%" << std::endl;
-    reset_random_uint();
-
-
-    clk::time_point t1 = high_resolution_clock::now();
-    boost::dynamic_bitset<std::size_t> test_set(length);
+    std::cout << "FROZEN SET. length:" << length << " selection: " << selection << " density: " << (selection / (double)length * 100.0) << "%" << std::endl;
 
+    sparse_set test_set(length);
     for (auto x : values)
     {
-        test_set[x] = true;
+        test_set.insert(x);
     }
+    test_set.begin();
 
+    clk::time_point t1 = high_resolution_clock::now();
+    frozen_set frozen = freeze(test_set);
     clk::time_point t2 = clk::now();
     time_in_msec time_span = duration_cast<time_in_msec>(t2 - t1);
-
-    double timing = time_span.count();
-    std::cout << "Boost Dynamic Bitset. Generation. It took " << time_span.count() << " milliseconds." << std::endl;
+    std::cout << "representation: " << (frozen.representation() == frozen_set::bitmap ? "bitmap" : "sorted array")
+        << ", memory: " << frozen.memory_usage() << " bytes (sparse set: " << (test_set.word_count() * sizeof(sparse_set::word_type) + selection * sizeof(std::size_t))
+        << " bytes, unordered sparse set: " << (unsigned long long)length * 2 * sizeof(std::size_t) << " bytes)" << std::endl;
+    std::cout << "Freeze. It took " << time_span.count() << " milliseconds." << std::endl;
 
     reset_random_uint();
-
     t1 = high_resolution_clock::now();
-
-
-    double sum = 0;
-    unsigned counter = 0;    
-
+    unsigned counter = 0;
     for (unsigned i = 0; i < steps; ++i)
     {
-        unsigned k1 = random_uint() % length;
-        if (test_set.test(k1))
-        {
-            //sum += f(k1);
-            counter++;
-        }
+        counter += frozen.test(random_uint() % length);
     }
-
     t2 = clk::now();
     time_span = duration_cast<time_in_msec>(t2 - t1);
-    //double units = (time_span.count() / counter)*10000.0;
-    std::cout << "counter: " << counter << " sum: " << std::setprecision(15) << sum << std::endl;
-    std::cout << "Boost Dynamic Bitset random access. It took " << time_span.count() << " milliseconds." << std::endl;
+    std::cout << "counter: " << counter << std::endl;
+    std::cout << "Frozen set random access. It took " << time_span.count() << " milliseconds." << std::endl;
 
     reset_random_uint();
     t1 = high_resolution_clock::now();
-
-    sum = 0;
-    unsigned long long counter2 = 0;
-
-    for (unsigned k = 0; k < repeat; k++)
+    counter = 0;
+    for (unsigned i = 0; i < steps; ++i)
     {
-        std::size_t bit = test_set.find_first();
-        while (bit != test_set.npos)
-        {
-            double coeff = random_uint();
-            sum += bit * coeff;//f(*it);
-            counter2++;
-            bit = test_set.find_next(bit);
-        }
+        counter += test_set.test(random_uint() % length);
     }
-
     t2 = clk::now();
     time_span = duration_cast<time_in_msec>(t2 - t1);
-    std::cout << "counter: " << counter2 << " sum: " << std::setprecision(15) << sum << std::endl;
-
-    timing = time_span.count();
-    std::cout << "Boost Dynamic Bitset summation. It took " << (time_span.count()/repeat) << " milliseconds." << std::endl;
-    std::cout << "per element (in one iteration)" << 1000000.0*time_span.count() / (double)counter2 << " nanoseconds." << std::endl;
-
-    //unsigned total_elements = counter2 / repeat;
-    //double density = total_elements / (double)length * 100.0;
-    //std::cout << " length: " << length << " total elements:" << total_elements << " Density: " << density << "%" << std::endl;
-    //std::cout << " random access: units*density: " << (units * density) << std::endl;
+    std::cout << "counter: " << counter << std::endl;
+    std::cout << "Sparse set random access. It took " << time_span.count() << " milliseconds." << std::endl;
 
     reset_random_uint();
-
     t1 = high_resolution_clock::now();
-
-
-    sum = 0;
-    counter = 0;
-
-
-    /*
-    for (unsigned i = 0; i < steps; ++i)
-    {
-        unsigned k1 = random_uint() % length;
-        test_set[k1] = false;
-        std::size_t bit = test_set.find_first();
-        if (bit == test_set.npos)
-            break;
-    }
-    */
-
-    for (auto x : values)
+    std::size_t ranks = 0;
+    for (unsigned i = 0; i < steps / 10; ++i)
     {
-        //unsigned k1 = random_uint() % length;
-        test_set[x] = false;
-        //if (test_set.empty())
-        //    break;
+        ranks += frozen.rank(random_uint() % length);
     }
-
     t2 = clk::now();
     time_span = duration_cast<time_in_msec>(t2 - t1);
-
-    std::size_t bit = test_set.find_first();
-    counter = 0;
-    while (bit != test_set.npos)
-    {        
-        counter++;
-        bit = test_set.find_next(bit);
-    }
-
-    std::cout << "counter: " << counter << std::endl;
-    std::cout << "Boost Dynamic Bitset random deletion. It took " << time_span.count() << " milliseconds." << std::endl;
+    std::cout << "sum of ranks: " << ranks << std::endl;
+    std::cout << "Frozen set rank (" << steps / 10 << " steps). It took " << time_span.count() << " milliseconds." << std::endl;
     reset_random_uint();
+
+    sparse_set thawed = thaw<sparse_set>(frozen);
+    std::cout << "thawed: " << thawed.count() << " elements" << std::endl;
 }
-#endif
 
-void Test_Sparse_Set(const unordered_sparse_set& values)
+void Test_Compressed_Stream(const unordered_sparse_set& values)
 {
     const unsigned length = values.size();
     const unsigned selection = values.count();
+    const unsigned chunk_words = 4096;
 
     std::cout << "_____________________________________________________" << std::endl;
-    std::cout << "Sparse Set. length:" << length << " selection: " << selection << " density: " << (selection / (double)length * 100.0) << "%" << std::endl;
-    reset_random_uint();
-    clk::time_point t1 = high_resolution_clock::now();
-    sparse_set test_set(length);
+    std::cout << "EWAH STREAM. length:" << length << " selection: " << selection << " density: " << (selection / (double)length * 100.0) << "%" << std::endl;
 
+    bounded_set source(length);
     for (auto x : values)
     {
-        test_set.insert(x);
+        source.insert(x);
+    }
+
+    double raw_bytes = source.word_count() * sizeof(bounded_set::word_type);
+
+    clk::time_point t1 = high_resolution_clock::now();
+
+    std::vector<ewah_format::word_type> buffer;
+    for (unsigned k = 0; k < repeat; k++)
+    {
+        buffer = ewah_encode(source);
     }
 
     clk::time_point t2 = clk::now();
     time_in_msec time_span = duration_cast<time_in_msec>(t2 - t1);
 
-    double timing = time_span.count();
-    std::cout << "Sparse Set. Generation. It took " << time_span.count() << " milliseconds." << std::endl;
+    double encoded_bytes = buffer.size() * sizeof(ewah_format::word_type);
+    std::cout << "raw: " << raw_bytes << " bytes, encoded: " << encoded_bytes << " bytes, ratio: " << raw_bytes / encoded_bytes << std::endl;
+    std::cout << "EWAH stream. Encoding. It took " << (time_span.count() / repeat) << " milliseconds ("
+        << raw_bytes / 1000.0 / (time_span.count() / repeat) << " MB/s)." << std::endl;
 
-    reset_random_uint();
     t1 = high_resolution_clock::now();
 
-
-    double sum = 0;
-    unsigned counter = 0;    
-
-    for (unsigned i = 0; i < steps; ++i)
+    bounded_set bounded_target;
+    bool bounded_ok = true;
+    for (unsigned k = 0; k < repeat; k++)
     {
-        unsigned k1 = random_uint() % length;
-        if (test_set.test(k1))
+        ewah_decoder<bounded_set> decoder(bounded_target);
+        for (std::size_t pos = 0; pos < buffer.size(); pos += chunk_words)
         {
-            //sum += f(k1);
-            counter++;
+            bounded_ok = decoder.feed(&buffer[pos], std::min<std::size_t>(chunk_words, buffer.size() - pos)) && bounded_ok;
         }
+        bounded_ok = decoder.done() && bounded_ok;
     }
 
     t2 = clk::now();
     time_span = duration_cast<time_in_msec>(t2 - t1);
-    //double units = (time_span.count() / (double)counter)*10000.0;
-    std::cout << "counter: " << counter << " sum: " << std::setprecision(15) << sum << std::endl;
-    std::cout << "Sparse Set random access. It took " << time_span.count() << " milliseconds." << std::endl;
-
-    reset_random_uint();
+    std::cout << "counter: " << bounded_target.count() << std::endl;
+    std::cout << "EWAH stream. Decoding into bounded set. It took " << (time_span.count() / repeat) << " milliseconds ("
+        << raw_bytes / 1000.0 / (time_span.count() / repeat) << " MB/s)." << std::endl;
 
     t1 = high_resolution_clock::now();
 
-    sum = 0;
-    unsigned long long counter2 = 0;
-
+    sparse_set sparse_target;
+    bool sparse_ok = true;
     for (unsigned k = 0; k < repeat; k++)
     {
-        for (sparse_set::const_iterator it = test_set.begin(), itStop = test_set.end(); it != itStop; ++it)
+        ewah_decoder<sparse_set> decoder(sparse_target);
+        for (std::size_t pos = 0; pos < buffer.size(); pos += chunk_words)
         {
-            double coeff = random_uint();
-            sum += *it * coeff;
-            counter2++;
+            sparse_ok = decoder.feed(&buffer[pos], std::min<std::size_t>(chunk_words, buffer.size() - pos)) && sparse_ok;
         }
+        sparse_ok = decoder.done() && sparse_ok;
     }
 
     t2 = clk::now();
     time_span = duration_cast<time_in_msec>(t2 - t1);
-    std::cout << "counter: " << counter2 << " sum: " << std::setprecision(15) << sum << std::endl;
-    timing = time_span.count();
-    std::cout << "Sparse Set summation. It took " << (time_span.count() / repeat) << " milliseconds." << std::endl;
-    std::cout << "per element (in one iteration)" << 1000000.0*time_span.count() / (double)counter2 << " nanoseconds." << std::endl;
-    
-    //unsigned total_elements = counter2 / repeat;
-    //double density = total_elements / (double)length * 100.0;
-    //std::cout << " length: " << length << " total elements:" << total_elements << " Density: " << density << "%" << std::endl;
-    //std::cout << " random access: units*density: " << (units * density) << std::endl;
+    std::cout << "counter: " << sparse_target.count() << std::endl;
+    std::cout << "EWAH stream. Decoding into sparse set. It took " << (time_span.count() / repeat) << " milliseconds ("
+        << raw_bytes / 1000.0 / (time_span.count() / repeat) << " MB/s)." << std::endl;
 
     reset_random_uint();
-
     t1 = high_resolution_clock::now();
 
+    double sum = 0;
+    unsigned long long counter2 = 0;
 
-    sum = 0;
-    counter = 0;
-
-    /*
-    for (unsigned i = 0; i < steps; ++i)
+    for (unsigned k = 0; k < repeat; k++)
     {
-        unsigned k1 = random_uint() % length;
-        test_set.erase(k1);
-        if (test_set.empty())
-            break;
-    }
-    */
-
-    for (auto x : values)
-    {        
-        test_set.erase(x);     
+        for (auto x : ewah_view(buffer))
+        {
+            double coeff = random_uint();
+            sum += x * coeff;
+            counter2++;
+        }
     }
 
     t2 = clk::now();
     time_span = duration_cast<time_in_msec>(t2 - t1);
-
-    counter = test_set.count();
-
-    std::cout << "counter: " << counter << std::endl;
-    std::cout << "Sparse Set random deletion. It took " << time_span.count() << " milliseconds." << std::endl;
+    std::cout << "counter: " << counter2 << " sum: " << std::setprecision(15) << sum << std::endl;
+    std::cout << "EWAH stream summation (no decoding). It took " << (time_span.count() / repeat) << " milliseconds." << std::endl;
+    std::cout << "per element (in one iteration)" << 1000000.0*time_span.count() / (double)counter2 << " nanoseconds." << std::endl;
     reset_random_uint();
-}
 
+    // the decoded words and the elements of the view against the source
+    std::size_t mismatches = !bounded_ok + !sparse_ok;
+    mismatches += bounded_target.size() != source.size() || sparse_target.size() != source.size();
+    for (std::size_t w = 0; mismatches == 0 && w < source.word_count(); w++)
+    {
+        mismatches += bounded_target.words()[w] != source.words()[w] || sparse_target.words()[w] != source.words()[w];
+    }
+    std::vector<std::size_t> viewed;
+    for (auto x : ewah_view(buffer))
+    {
+        viewed.push_back(x);
+    }
+    mismatches += viewed != Elements_Of(source);
+
+    // malformed streams are rejected: a universe above max_size, and bits past the universe in the last block,
+    // set by a literal or by a run of ones
+    bounded_set rejected;
+    mismatches += ewah_decode(buffer, rejected, length - 1);
+    bounded_set tail(100);
+    bounded_set full(128);
+    for (unsigned x = 0; x < 128; x++)
+    {
+        if (x < 100)
+            tail.insert(x);
+        full.insert(x);
+    }
+    std::vector<ewah_format::word_type> corrupt = ewah_encode(tail);
+    mismatches += !ewah_decode(corrupt, rejected) || rejected.count() != 100;
+    corrupt.back() |= ewah_format::word_type(1) << 40;
+    mismatches += ewah_decode(corrupt, rejected);
+    corrupt = ewah_encode(full);
+    mismatches += !ewah_decode(corrupt, rejected) || rejected.count() != 128;
+    corrupt[1] = 100;
+    mismatches += ewah_decode(corrupt, rejected);
+    corrupt[1] = ewah_format::word_type(1) << 40;
+    mismatches += ewah_decode(corrupt, rejected);
+    std::cout << "mismatches: " << mismatches << std::endl;
+}
 
 void Test_Eratosthenes(unsigned n)
 {
@@ -1247,6 +2251,20 @@ void Test_Eratosthenes(unsigned n)
 
     t1 = high_resolution_clock::now();
 
+    counter = 0;
+    for (unsigned i = 0; i < iterations; i++)
+    {
+        counter += Eratosthenes_Odd_Window(n + i);
+    }
+
+    t2 = clk::now();
+    time_span = duration_cast<time_in_msec>(t2 - t1);
+
+    timing = time_span.count();
+    std::cout << "Odd window. Counter: " << counter << " took " << time_span.count() << " milliseconds." << std::endl;
+
+    t1 = high_resolution_clock::now();
+
     counter = 0;
     for (unsigned i = 0; i < iterations; i++)
     {
@@ -1335,8 +2353,8 @@ void Test_Eratosthenes(unsigned n)
 }
 
 
-int main()
-{   
+void Test_Bounds()
+{
     bounded_set x(100);
     x.insert(5);
     x.insert(20);
@@ -1366,62 +2384,180 @@ int main()
     {
         std::cout << *it2 << std::endl;
     }
+}
 
-    Test_Eratosthenes_Bitset<1000>();
-    Test_Eratosthenes_Bitset<10000>();
-    Test_Eratosthenes_Bitset<100000>();
-    //Test_Eratosthenes_Bitset<1000000>();
-    //Test_Eratosthenes_Bitset<5000000>();
-    
-    Test_Eratosthenes(1000);
-    Test_Eratosthenes(10000);
-    Test_Eratosthenes(100000);
-    //Test_Eratosthenes(1000000);
-    //Test_Eratosthenes(5000000);
-    //Test_Eratosthenes(10000000);
-    //Test_Eratosthenes(50000000);
-       
-
-    unsigned lengths[] = { 100000, 1000000, 10000000, 50000000 };// , 50000000};
-    unsigned selections[] = { 100000 };
+// a sparse map resized after insertions: the keys are dropped, and the map can be filled again
+void Test_Sparse_Map_Resize()
+{
+    std::cout << "_____________________________________________________" << std::endl;
+    std::cout << "SPARSE MAP RESIZE" << std::endl;
+
+    sparse_map<double> m(100);
+    m[5] = 1;
+    m[7] = 2;
+    m.resize(200);
+
+    std::size_t mismatches = 0;
+    mismatches += m.test(5) || m.test(7) || m.count() != 0 || m.size() != 200;
+    m[5] = 3;
+    m[150] = 4;
+    mismatches += !m.test(5) || m.test(7) || !m.test(150) || m.count() != 2;
+    mismatches += m[5] != 3 || m[150] != 4;
+    m.erase(5);
+    mismatches += m.test(5) || m.count() != 1 || m[150] != 4;
+    std::cout << "mismatches: " << mismatches << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+    benchmark::options opt;
+    if (!benchmark::parse_options(argc, argv, opt, std::cerr))
+    {
+        benchmark::print_usage(std::cerr, argv[0]);
+        return 1;
+    }
+    if (opt.help)
+    {
+        benchmark::print_usage(std::cout, argv[0]);
+        return 0;
+    }
+
+    std::vector<const benchmark::container_entry*> selected;
+    for (auto& entry : containers)
+    {
+        bool all = opt.containers.size() == 1 && opt.containers[0] == "all";
+        if ((opt.containers.empty() && entry.run_by_default) || all
+            || std::find(opt.containers.begin(), opt.containers.end(), entry.name) != opt.containers.end())
+        {
+            selected.push_back(&entry);
+        }
+    }
+    for (auto& name : opt.containers)
+    {
+        bool known = name == "all";
+        for (auto& entry : containers)
+        {
+            known = known || name == entry.name;
+        }
+        if (!known)
+        {
+            std::cerr << "Unknown container: " << name << std::endl;
+            return 1;
+        }
+    }
+
+    if (opt.cpu >= 0 && !benchmark::pin_to_cpu(opt.cpu))
+    {
+        std::cerr << "Could not pin the process to CPU " << opt.cpu << std::endl;
+    }
+
+    if (opt.counters && !benchmark::hardware_counters().any_available())
+    {
+        std::cerr << "Hardware performance counters are not available (see /proc/sys/kernel/perf_event_paranoid); "
+            << "only the timings are reported" << std::endl;
+        opt.counters = false;
+    }
+
+    std::ofstream file;
+    if (!opt.output.empty())
+    {
+        file.open(opt.output);
+        if (!file)
+        {
+            std::cerr << "Could not open " << opt.output << std::endl;
+            return 1;
+        }
+    }
+    std::ostream& out = opt.output.empty() ? std::cout : file;
+
+    // the progress goes wherever the machine readable results do not
+    std::ostream* text = opt.format == "text" ? &out : opt.output.empty() ? &std::cerr : &std::cout;
+
+    steps = opt.steps;
+    repeat = opt.repeats.front();
 
+    if (opt.extras)
+    {
+        Test_Bounds();
+        Test_Sparse_Map_Resize();
+
+        Test_Eratosthenes_Bitset<1000>();
+        Test_Eratosthenes_Bitset<10000>();
+        Test_Eratosthenes_Bitset<100000>();
+        Test_Static_Bounded_Set();
+        //Test_Eratosthenes_Bitset<1000000>();
+        //Test_Eratosthenes_Bitset<5000000>();
+
+        Test_Eratosthenes(1000);
+        Test_Eratosthenes(10000);
+        Test_Eratosthenes(100000);
+        //Test_Eratosthenes(1000000);
+        //Test_Eratosthenes(5000000);
+        //Test_Eratosthenes(10000000);
+        //Test_Eratosthenes(50000000);
+    }
+
+    benchmark::report results;
     unordered_sparse_set values;
-    for (auto length : lengths)
+    for (auto length : opt.lengths)
     {
         values.resize(length);
-        for (auto selection : selections)
+        for (auto distribution : opt.distributions)
         {
-            values.clear();
-            reset_random_uint();
-            unsigned select_counter = 0;
-            do
+            for (auto selection : benchmark::selections_for(opt, length))
             {
-                unsigned k1 = random_uint() % length;
-                if (values.insert(k1))
+                // with the default seed, the uniform population is the one the original tests used
+                benchmark::workload w = benchmark::make_workload(opt, distribution, length, selection);
+                for (auto entry : selected)
                 {
-                    select_counter++;
+                    entry->run(entry->name, w, length, opt, results, text);
                 }
-            } while (select_counter != selection);
 
-            Test_Unordered_Sparse_Set(values);
-#ifdef USE_BOOST
-            Test_Boost_Dynamic_Bitset(values);
-#endif
-            Test_Bounded_Set(values);
-            Test_Sparse_Set(values);
-            Test_Vector_of_Bool(values);
-            Test_Vector_of_Char(values);
-        }        
+                if (opt.extras)
+                {
+                    values.clear();
+                    for (auto x : w.values)
+                    {
+                        values.insert(x);
+                    }
+                    Test_Snapshot(values);
+                    Test_Operation_Stats(values);
+                    Test_Compressed_Stream(values);
+                    Test_Frozen(values);
+                    Test_Range_Scan(values);
+                    Test_Runs(values);
+                    Test_Parallel(values);
+                }
+            }
+        }
     }
-    
-    int zz;
-    std::cin >> zz;
-
-    return 0;
-}
-
-
 
+    if (opt.extras)
+    {
+        Test_Paged_Bounded_Set_Huge_Universe(1ull << 33, 100000);
+        Test_Paged_Unordered_Sparse_Set_Clustered(4000000000u, 1000000);
+        Test_Handle_Churn(1000000, 10000000);
+        Test_Tiny_Sets(512, 10000000);
+        Test_Free_Slots(10000000, 10000, 1000);
+        Test_Change_Tracking(10000000, 5000000, 1000, 100);
+        Test_Change_Tracking(100000, 50000, 5000, 20); // batches larger than the log: the changes are read from the XOR
+        Test_Sliding_Window(1 << 20, 20000000, 1 << 16);
+        Test_Set_Equality(200000, 2000, 20000);
+        Test_Set_Family(1000000, 256);
+        Test_Set_Operations(20000000, 10000000, 1000, 1000);
+    }
 
+    // how closely the adaptive set follows the best container over the grid
+    if (text != nullptr && std::find_if(selected.begin(), selected.end(),
+        [](const benchmark::container_entry* e) { return std::string(e->name) == "adaptive_set"; }) != selected.end() && selected.size() > 1)
+    {
+        results.write_comparison(*text, "adaptive_set");
+    }
 
+    if (opt.format == "csv")
+        results.write_csv(out);
+    else if (opt.format == "json")
+        results.write_json(out);
 
+    return 0;
+}
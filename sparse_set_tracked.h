@@ -0,0 +1,214 @@
+
+// <summary>Contains tracked_set, a set that records the elements inserted and erased since its last checkpoint</summary>
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+#include "sparse_sets.h"
+
+///
+/// A bounded set or sparse set that keeps the net changes since the last checkpoint, so that an incremental consumer
+/// reads the changes instead of scanning the whole set and comparing it with a copy.
+///
+/// The first change of an element after the checkpoint appends the element and its state at the checkpoint to a log,
+/// and sets its bit in a bit array of touched elements, so that it is logged once. An element inserted and then erased
+/// again is in the log but is not reported. While the log is shorter than the bit array has words, the changes are
+/// read from it and a checkpoint clears only the bits it names, so both cost O(changes). Past that length the log
+/// overflows and is dropped: the bit array becomes the XOR of the set at the checkpoint and the set now, the changes
+/// are read from its words and a checkpoint clears them all, which is then no slower than reading the log would be.
+///
+/// There is one checkpoint at a time: changes_since() takes the value returned by the last checkpoint(), or 0 for the
+/// empty set the tracked set was constructed as, and throws std::invalid_argument for an older one, whose changes are gone.
+///
+template <class Set = sparse_set>
+class tracked_set
+{
+public:
+    typedef Set set_type;
+    typedef std::size_t value_type;
+    typedef std::uint64_t checkpoint_type;
+
+    // the net changes since a checkpoint, each list in increasing order
+    struct changes
+    {
+        std::vector<std::size_t> inserted;
+        std::vector<std::size_t> erased;
+    };
+
+private:
+    struct entry
+    {
+        std::size_t value;
+        bool present;                    // at the checkpoint
+    };
+
+    Set m_set;
+    bounded_set m_delta;                 // the elements touched since the checkpoint, or the XOR once overflowed
+    std::vector<entry> m_log;            // the elements as they were first touched, unless overflowed
+    bool m_overflow;
+    checkpoint_type m_checkpoint;
+
+    // x has just changed; present is its state before the change
+    void record(std::size_t x, bool present)
+    {
+        if (m_overflow)
+        {
+            if (!m_delta.insert(x))
+                m_delta.erase(x);
+            return;
+        }
+        if (m_delta.test(x))
+            return;
+        if (m_log.size() < m_delta.word_count())
+        {
+            m_delta.insert(x);
+            m_log.push_back(entry{ x, present });
+            return;
+        }
+
+        for (auto& e : m_log) // touched, but back to its state at the checkpoint
+        {
+            if (m_set.test(e.value) == e.present)
+                m_delta.erase(e.value);
+        }
+        m_delta.insert(x);
+        m_overflow = true;
+        m_log.clear();
+        m_log.shrink_to_fit();
+    }
+
+    void check(checkpoint_type c) const
+    {
+        if (c != m_checkpoint)
+            throw std::invalid_argument("tracked_set::changes_since: not the last checkpoint");
+    }
+
+public:
+    tracked_set(std::size_t size) : m_set(size), m_delta(size), m_log(), m_overflow(false), m_checkpoint(0)
+    {
+    }
+
+    bool insert(std::size_t x)
+    {
+        if (!m_set.insert(x))
+            return false;
+        record(x, false);
+        return true;
+    }
+
+    bool erase(std::size_t x)
+    {
+        if (!m_set.test(x))
+            return false;
+        m_set.erase(x);
+        record(x, true);
+        return true;
+    }
+
+    bool test(std::size_t x) const
+    {
+        return m_set.test(x);
+    }
+
+    std::size_t size() const
+    {
+        return m_set.size();
+    }
+
+    std::size_t count() const
+    {
+        return m_set.count();
+    }
+
+    void clear()
+    {
+        std::vector<std::size_t> present;
+        for (auto x : m_set)
+        {
+            present.push_back(x);
+        }
+        for (auto x : present)
+        {
+            erase(x);
+        }
+    }
+
+    // the set itself, for reading
+    const Set& set() const
+    {
+        return m_set;
+    }
+
+    ///
+    /// Forgets the changes made so far and returns the checkpoint from which changes are counted again
+    ///
+    checkpoint_type checkpoint()
+    {
+        if (m_overflow)
+        {
+            m_delta.clear();
+        }
+        else
+        {
+            for (auto& e : m_log)
+            {
+                m_delta.erase(e.value);
+            }
+        }
+        m_log.clear();
+        m_overflow = false;
+        return ++m_checkpoint;
+    }
+
+    // the number of entries read for the changes: the log, or the words of the bit array once the log has overflowed
+    std::size_t change_cost() const
+    {
+        return m_overflow ? m_delta.word_count() : m_log.size();
+    }
+
+    ///
+    /// Calls f(x, inserted) for every element x whose membership changed since the checkpoint c, inserted being
+    /// true if x is now in the set. The order is the order of the first changes, or increasing once the log
+    /// has overflowed.
+    ///
+    template <class F>
+    void for_each_change(checkpoint_type c, F f) const
+    {
+        check(c);
+        if (m_overflow)
+        {
+            m_delta.for_each_run([&](std::size_t first, std::size_t last)
+            {
+                for (std::size_t x = first; x < last; x++)
+                {
+                    f(x, m_set.test(x));
+                }
+            });
+            return;
+        }
+        for (auto& e : m_log)
+        {
+            if (m_set.test(e.value) != e.present)
+                f(e.value, !e.present);
+        }
+    }
+
+    changes changes_since(checkpoint_type c) const
+    {
+        changes result;
+        for_each_change(c, [&](std::size_t x, bool inserted)
+        {
+            (inserted ? result.inserted : result.erased).push_back(x);
+        });
+        if (!m_overflow)
+        {
+            std::sort(result.inserted.begin(), result.inserted.end());
+            std::sort(result.erased.begin(), result.erased.end());
+        }
+        return result;
+    }
+};
@@ -0,0 +1,311 @@
+
+// <summary>Contains window_set, a set over the values lower, lower + stride, ... below upper rather than over [0, size)</summary>
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <iterator>
+#include <stdexcept>
+
+#include "sparse_sets.h"
+
+namespace bits
+{
+    // erases the elements less than n and moves the others down by n: a word at a time for bit arrays
+    template <class Allocator, class Stats, std::size_t InlineWords>
+    void shift_elements_down(basic_bounded_set<Allocator, Stats, InlineWords>& s, std::size_t n)
+    {
+        s.shift_down(n);
+    }
+
+    template <class Allocator, class Stats, std::size_t InlineWords>
+    void shift_elements_down(basic_sparse_set<Allocator, Stats, InlineWords>& s, std::size_t n)
+    {
+        s.shift_down(n);
+    }
+
+    // an element at a time for the other sets
+    template <class Set>
+    void shift_elements_down(Set& s, std::size_t n)
+    {
+        std::vector<std::size_t> kept;
+        for (auto x : s)
+        {
+            if (x >= n)
+                kept.push_back(x - n);
+        }
+        s.clear();
+        for (auto x : kept)
+        {
+            s.insert(x);
+        }
+    }
+
+    // erases the elements not less than size() - n and moves the others up by n
+    template <class Allocator, class Stats, std::size_t InlineWords>
+    void shift_elements_up(basic_bounded_set<Allocator, Stats, InlineWords>& s, std::size_t n)
+    {
+        s.shift_up(n);
+    }
+
+    template <class Allocator, class Stats, std::size_t InlineWords>
+    void shift_elements_up(basic_sparse_set<Allocator, Stats, InlineWords>& s, std::size_t n)
+    {
+        s.shift_up(n);
+    }
+
+    template <class Set>
+    void shift_elements_up(Set& s, std::size_t n)
+    {
+        std::vector<std::size_t> kept;
+        for (auto x : s)
+        {
+            if (x + n < s.size())
+                kept.push_back(x + n);
+        }
+        s.clear();
+        for (auto x : kept)
+        {
+            s.insert(x);
+        }
+    }
+} // bits
+
+///
+/// A set over the values lower, lower + stride, lower + 2 * stride, ... below upper, stored in a Set over the slots
+/// [0, width()), so that memory and scans follow the width of the window rather than the values: a window of IDs
+/// around 3,000,000,000 does not need 3G bits of leading zeros, and stride 2 keeps only the odd numbers for a sieve.
+/// Set is a bounded set or a sparse set, or any set with the same interface, such as an unordered sparse set.
+///
+/// Values outside the window, or between its slots, are never present: insert() ignores them and returns false.
+/// slide() and rebase() move the window along the values; the elements that leave it are erased. For bit arrays the
+/// move shifts the words, so it costs O(width() / 64) whatever the distance; for the other sets it costs O(count()).
+///
+template <class Set = bounded_set>
+class window_set
+{
+public:
+    typedef Set set_type;
+    typedef std::size_t value_type;
+    typedef std::size_t key_type;
+
+    ///
+    /// A forward iterator over the values of the window, in the order of the slots in the underlying set
+    ///
+    class iterator
+    {
+        typedef typename Set::const_iterator slot_iterator;
+
+        slot_iterator m_slot;
+        std::size_t m_lower;
+        std::size_t m_stride;
+        mutable std::size_t m_value;
+
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef std::size_t value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const std::size_t* pointer;
+        typedef const std::size_t& reference;
+
+        iterator(slot_iterator slot, std::size_t lower, std::size_t stride) : m_slot(slot), m_lower(lower), m_stride(stride), m_value(0)
+        {
+        }
+
+        const std::size_t& operator*() const
+        {
+            m_value = m_lower + m_stride * static_cast<std::size_t>(*m_slot);
+            return m_value;
+        }
+
+        iterator& operator++()
+        {
+            ++m_slot;
+            return *this;
+        }
+
+        iterator operator++(int)
+        {
+            iterator tmp(*this);
+            ++*this;
+            return tmp;
+        }
+
+        bool operator==(const iterator& y) const
+        {
+            return m_slot == y.m_slot;
+        }
+
+        bool operator!=(const iterator& y) const
+        {
+            return m_slot != y.m_slot;
+        }
+    };
+    typedef iterator const_iterator;
+
+private:
+    static constexpr unsigned no_shift = ~0u;
+
+    Set m_set;
+    std::size_t m_lower;
+    std::size_t m_stride;
+    unsigned m_stride_log2;             // no_shift unless the stride is a power of two
+    std::size_t m_width;                // the number of slots
+
+    // the slot of x, or false if x is not a value of the window
+    bool slot(std::size_t x, std::size_t& k) const
+    {
+        if (x < m_lower)
+            return false;
+        std::size_t d = x - m_lower;
+        if (m_stride_log2 != no_shift)
+        {
+            if ((d & (m_stride - 1)) != 0)
+                return false;
+            k = d >> m_stride_log2;
+        }
+        else
+        {
+            if (d % m_stride != 0)
+                return false;
+            k = d / m_stride;
+        }
+        return k < m_width;
+    }
+
+    static std::size_t slot_count(std::size_t lower, std::size_t upper, std::size_t stride)
+    {
+        return upper > lower && stride != 0 ? (upper - lower - 1) / stride + 1 : 0;
+    }
+
+    static unsigned stride_log2(std::size_t stride)
+    {
+        if (stride == 0 || (stride & (stride - 1)) != 0)
+            return no_shift;
+        unsigned log2 = 0;
+        while ((std::size_t(1) << log2) != stride)
+        {
+            log2++;
+        }
+        return log2;
+    }
+
+public:
+    ///
+    /// The window of the values lower, lower + stride, ... less than upper; throws std::invalid_argument if the stride is 0
+    ///
+    window_set(std::size_t lower, std::size_t upper, std::size_t stride = 1)
+        : m_set(slot_count(lower, upper, stride)), m_lower(lower), m_stride(stride), m_stride_log2(stride_log2(stride)),
+        m_width(slot_count(lower, upper, stride))
+    {
+        if (stride == 0)
+            throw std::invalid_argument("window_set: the stride must not be 0");
+    }
+
+    bool insert(std::size_t x)
+    {
+        std::size_t k;
+        return slot(x, k) && m_set.insert(k);
+    }
+
+    void erase(std::size_t x)
+    {
+        std::size_t k;
+        if (slot(x, k))
+            m_set.erase(k);
+    }
+
+    bool test(std::size_t x) const
+    {
+        std::size_t k;
+        return slot(x, k) && m_set.test(k);
+    }
+
+    void clear()
+    {
+        m_set.clear();
+    }
+
+    std::size_t count() const
+    {
+        return m_set.count();
+    }
+
+    // the first value of the window
+    std::size_t lower() const
+    {
+        return m_lower;
+    }
+
+    // one stride past the last value of the window
+    std::size_t upper() const
+    {
+        return m_lower + m_width * m_stride;
+    }
+
+    std::size_t stride() const
+    {
+        return m_stride;
+    }
+
+    // the number of values the window can hold
+    std::size_t width() const
+    {
+        return m_width;
+    }
+
+    // the set of the slots: the value lower() + stride() * k is present if slot k is
+    const Set& slots() const
+    {
+        return m_set;
+    }
+
+    iterator begin() const
+    {
+        return iterator(m_set.begin(), m_lower, m_stride);
+    }
+
+    iterator end() const
+    {
+        return iterator(m_set.end(), m_lower, m_stride);
+    }
+
+    ///
+    /// Moves the window by steps slots, that is steps * stride() values, up if steps is positive and down if it is
+    /// negative; std::invalid_argument is thrown if the window would pass 0
+    ///
+    void slide(std::ptrdiff_t steps)
+    {
+        if (steps >= 0)
+        {
+            rebase(m_lower + static_cast<std::size_t>(steps) * m_stride);
+            return;
+        }
+        std::size_t n = static_cast<std::size_t>(-(steps + 1)) + 1;
+        if (n > m_lower / m_stride)
+            throw std::invalid_argument("window_set::slide: the window would pass 0");
+        rebase(m_lower - n * m_stride);
+    }
+
+    ///
+    /// Moves the window to start at lower, which must differ from lower() by a multiple of stride(); otherwise
+    /// std::invalid_argument is thrown. The elements still in the window keep their values; those that leave it are erased.
+    ///
+    void rebase(std::size_t lower)
+    {
+        std::size_t d = lower > m_lower ? lower - m_lower : m_lower - lower;
+        if (d % m_stride != 0)
+            throw std::invalid_argument("window_set::rebase: the new lower bound is not on the stride");
+        std::size_t steps = d / m_stride;
+        if (lower > m_lower)
+        {
+            bits::shift_elements_down(m_set, steps);
+        }
+        else
+        {
+            bits::shift_elements_up(m_set, steps);
+        }
+        m_lower = lower;
+    }
+};
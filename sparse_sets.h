@@ -3,11 +3,25 @@
 // <date>2015-01-03</date>
 // <summary>Contains implementation of Sparse Sets of Integers</summary>
 
+#pragma once
+
 #include <vector>
 #include <string>
 #include <iterator>
 #include <limits>
 #include <algorithm>
+#include <memory>
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+#include <functional>
+#include <atomic>
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#elif defined(_MSC_VER)
+#include <xmmintrin.h>
+#endif
 
 namespace bits
 {
@@ -41,603 +55,4341 @@ namespace bits
         }
         return count;
     }    
+
+    // the position of the lowest set bit; x must not be 0
+    inline unsigned trailing_zeros64(std::uint64_t x)
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        return static_cast<unsigned>(__builtin_ctzll(x));
+#else
+        return static_cast<unsigned>(lsb(x));
+#endif
+    }
 } // bits
 
+///------------------------------------
+/// Operation statistics
+///------------------------------------
 
 ///
-/// Fast operations for a collection of integer values in the range [0; size-1]
-/// Whenever an iterator is required an array of values is generated.
-/// It outperform boost::dynamic_bitset and bounded_set (see below) in repeated iterations over the same set of values. 
-/// In comparison, boost::dynamic_bitset and bounded_set use less memory and outperform the sparse set if repeated iterations are
-/// not required.
+/// A snapshot of the operations counted by a container with the operation_stats policy
 ///
+struct operation_counts
+{
+    unsigned long long inserts;                // elements added
+    unsigned long long noop_inserts;           // inserts of elements that were already present
+    unsigned long long erases;                 // erase calls
+    unsigned long long sequence_invalidations; // sparse_set: cached sequences thrown away by a modification
+    unsigned long long sequence_rebuilds;      // sparse_set: sequences built from the bit array
+    unsigned long long count_words;            // words scanned by count()
+    unsigned long long empty_words;            // words scanned by empty()
+    unsigned long long iteration_words;        // words scanned by iteration (including sequence rebuilds)
+};
 
-class sparse_set
+///
+/// The statistics policy of the containers (the last template parameter). The default policy, no_stats, is empty and
+/// all its hooks are inline no-ops, so the containers are the same size and generate the same code as without it.
+///
+class no_stats
 {
-    static constexpr std::size_t EmptyIndex = static_cast<std::size_t>(-1);
-    typedef std::size_t base_type;
-    static constexpr unsigned unsigned_bits = std::numeric_limits<base_type>::digits;
-    static constexpr unsigned unsigned_bits_log2 = (unsigned_bits == 64 ? 6 : unsigned_bits == 32 ? 5 : unsigned_bits == 16 ? 4 : 3);
-    static constexpr unsigned unsigned_bits_log2_mask = 0xFFFFFFFF >> (32 - unsigned_bits_log2);
-    static constexpr std::size_t one_bit = 1;
+public:
+    static constexpr bool enabled = false;
 
-    unsigned m_size;
-    std::vector<base_type> m_bit_array;
-    mutable std::vector<std::size_t> m_sequence;
-    mutable bool m_iterator_present;
+    void on_insert(bool) const {}
+    void on_erase() const {}
+    void on_sequence_invalidated() const {}
+    void on_sequence_rebuilt() const {}
+    void on_count_scan(std::size_t) const {}
+    void on_empty_scan(std::size_t) const {}
+    void on_iteration_scan(std::size_t) const {}
 
-    void create_iteration_sequence() const
+    operation_counts snapshot() const
     {
-        //if (!m_sequence.empty())
-        //    return;
+        return operation_counts{ 0, 0, 0, 0, 0, 0, 0, 0 };
+    }
 
-        if (m_sequence.capacity() != m_size)
-        {
-            m_sequence.reserve(m_size);
-        }
+    void reset() {}
+};
 
-        std::size_t k = 0;
-        for (auto x : m_bit_array)
-        {
-            if (x)
-            {
-                unsigned bit = k;
-                do
-                {
-                    unsigned p = bits::lsb(x);
-                    bit += p;
-                    x >>= p;
-                    m_sequence.push_back(bit);
-                    if (x == 1)
-                        break;
-                    x >>= 1;
-                    bit++;
-                } while (true);
-            }
-            k += unsigned_bits;
-        }
-    }
+///
+/// Counts the operations of one container (not thread safe, like the containers themselves).
+/// The counts are read with stats() and cleared with reset_stats() on the container.
+///
+class operation_stats
+{
+    mutable operation_counts m_counts;
 
 public:
-    typedef std::size_t value_type;
-    typedef std::size_t key_type;
-    typedef std::size_t size_type;
-    typedef std::vector<std::size_t>::const_iterator iterator;
-    typedef iterator const_iterator;
+    static constexpr bool enabled = true;
 
-    typedef std::vector<std::size_t>::const_reverse_iterator reverse_iterator;
-    typedef reverse_iterator const_reverse_iterator;
+    operation_stats() : m_counts{ 0, 0, 0, 0, 0, 0, 0, 0 } {}
 
-    sparse_set(std::size_t size) :m_size(size),
-        m_bit_array((m_size + unsigned_bits - 1) / unsigned_bits), m_sequence(), m_iterator_present(false)
+    void on_insert(bool inserted) const
     {
-        
+        if (inserted)
+            m_counts.inserts++;
+        else
+            m_counts.noop_inserts++;
     }
 
-    sparse_set() :m_size(0),
-        m_bit_array(0), m_sequence(), m_iterator_present(false)
+    void on_erase() const
     {
+        m_counts.erases++;
     }
 
-    void swap(sparse_set& s)
+    void on_sequence_invalidated() const
     {
-        m_bit_array.swap(s.m_bit_array);
-        m_sequence.swap(s.m_sequence);
-        std::swap(m_iterator_present, s.m_iterator_present);
-        std::swap(m_size, s.m_size);
+        m_counts.sequence_invalidations++;
     }
 
-    void resize(std::size_t size)
+    void on_sequence_rebuilt() const
     {
-        m_size = size;
-        m_bit_array.resize((m_size + unsigned_bits - 1) / unsigned_bits);        
-        if (m_iterator_present)
-        {
-            m_iterator_present = false;
-            m_sequence.clear();
-        }
+        m_counts.sequence_rebuilds++;
     }
 
-    bool insert(value_type i)
+    void on_count_scan(std::size_t words) const
     {
-        if (m_iterator_present)
-        {
-            m_iterator_present = false;
-            m_sequence.clear();
-        }
-        base_type& v = m_bit_array[i >> unsigned_bits_log2];
-        base_type x = v;
-        v |= (one_bit << (i & unsigned_bits_log2_mask));
-        return x != v;  
+        m_counts.count_words += words;
     }
 
-    void erase(value_type i)
+    void on_empty_scan(std::size_t words) const
     {
-        m_bit_array[i >> unsigned_bits_log2] &= ~(one_bit << (i & unsigned_bits_log2_mask));
-        if (m_iterator_present)
-        {
-            m_iterator_present = false;
-            m_sequence.clear();
-        }
+        m_counts.empty_words += words;
     }
 
-    bool test(std::size_t i) const
-    {        
-        return ((m_bit_array[i >> unsigned_bits_log2] >> (i & unsigned_bits_log2_mask)) & 1) != 0;        
+    void on_iteration_scan(std::size_t words) const
+    {
+        m_counts.iteration_words += words;
     }
 
-    bool empty() const
-    {        
-        for (auto x : m_bit_array)
-        {
-            if (x != 0)
-                return false;
-        }
-        return true;
+    operation_counts snapshot() const
+    {
+        return m_counts;
     }
 
-    void clear()
+    void reset()
     {
-        if (m_iterator_present)
+        m_counts = operation_counts{ 0, 0, 0, 0, 0, 0, 0, 0 };
+    }
+};
+
+namespace bits
+{
+    // lets an iterator report the words it scans to its container's statistics; empty when they are disabled
+    template <class Stats, bool Enabled = Stats::enabled>
+    class stats_handle
+    {
+        const Stats* m_stats;
+
+    public:
+        stats_handle(const Stats* stats = nullptr) : m_stats(stats) {}
+
+        void on_iteration_scan(std::size_t words) const
         {
-            m_iterator_present = false;
-            m_sequence.clear();
+            if (m_stats != nullptr)
+                m_stats->on_iteration_scan(words);
         }
-        std::fill(m_bit_array.begin(), m_bit_array.end(), 0);
-    }
+    };
 
-    std::size_t size() const
+    template <class Stats>
+    class stats_handle<Stats, false>
     {
-        return m_size;
-    }
+    public:
+        stats_handle(const Stats* = nullptr) {}
 
-    std::size_t count() const
+        void on_iteration_scan(std::size_t) const {}
+    };
+} // bits
+
+
+namespace bits
+{
+    ///
+    /// A forward iterator over the elements of a set, read either from a sorted sequence of values or straight from
+    /// the words of a bit array; in the latter case only the words covering [first, last) are read
+    ///
+    template <class Word, class Sequence = std::size_t>
+    class value_range_iterator
     {
-        if (m_iterator_present)
-            return m_sequence.size();
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef std::size_t value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const std::size_t* pointer;
+        typedef const std::size_t& reference;
 
-        std::size_t count = 0;
-        for (auto x : m_bit_array)
+    private:
+        static constexpr unsigned word_bits = std::numeric_limits<Word>::digits;
+        static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+        const Sequence* m_position;    // sequence
+        const Sequence* m_stop;
+        const Word* m_words;           // bit array
+        std::size_t m_word_index;
+        std::size_t m_word_stop;
+        std::size_t m_last;
+        Word m_current;
+        std::size_t m_value;           // npos at the end
+
+        void next_bit()
         {
-            count += bits::count_bits(x);
+            while (m_current == 0)
+            {
+                if (++m_word_index >= m_word_stop)
+                {
+                    m_value = npos;
+                    return;
+                }
+                m_current = m_words[m_word_index];
+            }
+            m_value = m_word_index * word_bits + lsb(m_current);
+            m_current &= m_current - 1;
+            if (m_value >= m_last)
+            {
+                m_value = npos;
+                m_current = 0;
+                m_word_index = m_word_stop;
+            }
         }
-        return count;
-    }
 
-    iterator begin() const
-    {
-        if (!m_iterator_present)
+    public:
+        value_range_iterator() // end
+            : m_position(nullptr), m_stop(nullptr), m_words(nullptr), m_word_index(0), m_word_stop(0), m_last(0), m_current(0), m_value(npos)
         {
-            create_iteration_sequence();
-            m_iterator_present = true;
         }
-        return m_sequence.begin();
-    }
 
-    iterator end() const
-    {
-        if (!m_iterator_present)
+        // the values in [position, stop), which are sorted
+        value_range_iterator(const Sequence* position, const Sequence* stop)
+            : m_position(position), m_stop(stop), m_words(nullptr), m_word_index(0), m_word_stop(0), m_last(0), m_current(0),
+            m_value(position != stop ? *position : npos)
         {
-            create_iteration_sequence();
-            m_iterator_present = true;
         }
-        return m_sequence.end();
-    }
 
-    reverse_iterator rbegin() const
-    {
-        if (!m_iterator_present)
+        // the elements of the bit array in [first, last); the bit array must have at least last bits
+        value_range_iterator(const Word* words, std::size_t first, std::size_t last)
+            : m_position(nullptr), m_stop(nullptr), m_words(words), m_word_index(first / word_bits),
+            m_word_stop((last + word_bits - 1) / word_bits), m_last(last), m_current(0), m_value(npos)
         {
-            create_iteration_sequence();
-            m_iterator_present = true;
+            if (first < last)
+            {
+                unsigned bit = first % word_bits;
+                m_current = (m_words[m_word_index] >> bit) << bit;
+                next_bit();
+            }
         }
-        return m_sequence.rbegin();
-    }
 
-    reverse_iterator rend() const
-    {
-        if (!m_iterator_present)
-        {            
-            create_iteration_sequence();
-            m_iterator_present = true;            
+        const std::size_t& operator*() const
+        {
+            return m_value;
         }
-        return m_sequence.rend();
-    }
 
-    iterator lower_bound(value_type i) const
-    {
-        return std::lower_bound(m_sequence.begin(), m_sequence.end(), i);
-    }
+        value_range_iterator& operator++()
+        {
+            if (m_words != nullptr)
+                next_bit();
+            else
+                m_value = ++m_position != m_stop ? *m_position : npos;
+            return *this;
+        }
 
-    iterator upper_bound(value_type i) const
+        value_range_iterator operator++(int)
+        {
+            value_range_iterator tmp(*this);
+            ++*this;
+            return tmp;
+        }
+
+        bool operator==(const value_range_iterator& y) const
+        {
+            return m_value == y.m_value;
+        }
+
+        bool operator!=(const value_range_iterator& y) const
+        {
+            return m_value != y.m_value;
+        }
+    };
+
+    // a pair of iterators that can be used in a range-based for loop
+    template <class Iterator>
+    class iterator_range
     {
-        return std::upper_bound(m_sequence.begin(), m_sequence.end(), i);
-    }
-};
+        Iterator m_begin;
+        Iterator m_end;
 
-///
-/// The unordered sparse set is slower than sparse set, except for iteration over the whole set of values.
-/// It uses more memory than sparse set.
-///
-class unordered_sparse_set
-{
-public:
+    public:
+        typedef Iterator iterator;
+        typedef Iterator const_iterator;
 
+        iterator_range(Iterator first, Iterator last) : m_begin(first), m_end(last) {}
 
-    typedef std::vector<std::size_t*> direct_access_sequence;
-    typedef std::vector<std::size_t>  iteration_sequence;
+        Iterator begin() const
+        {
+            return m_begin;
+        }
 
-    direct_access_sequence m_sparse;
-    iteration_sequence m_dense;
+        Iterator end() const
+        {
+            return m_end;
+        }
 
-public:
-    typedef std::size_t value_type;
-    typedef std::size_t size_type;
-    typedef std::size_t key_type;
-    typedef iteration_sequence::const_iterator iterator;
-    typedef iterator const_iterator;
+        bool empty() const
+        {
+            return m_begin == m_end;
+        }
+    };
+} // bits
 
-    typedef iteration_sequence::const_reverse_iterator reverse_iterator;
-    typedef reverse_iterator const_reverse_iterator;
+namespace bits
+{
+    ///------------------------------------
+    /// Runs, shifts and the complement
+    ///------------------------------------
 
-    unordered_sparse_set(std::size_t size) :m_sparse(size), m_dense()
+    // the elements first, first + 1, ..., last - 1
+    struct run
     {
-        m_dense.reserve(size);
-    }
-
-    unordered_sparse_set() :m_sparse(), m_dense() {}
+        std::size_t first;
+        std::size_t last;
+    };
 
-    void resize(std::size_t size)
+    // the position of the first set bit at or after position in a bit array of count words, or count * word bits
+    template <class Word>
+    std::size_t next_one(const Word* words, std::size_t count, std::size_t position)
     {
-        m_sparse.resize(size);
-        m_dense.reserve(size);
-        m_dense.clear();
+        static constexpr unsigned word_bits = std::numeric_limits<Word>::digits;
+        std::size_t k = position / word_bits;
+        if (k >= count)
+            return count * word_bits;
+
+        Word x = words[k] & (~Word(0) << (position % word_bits));
+        while (x == 0)
+        {
+            if (++k == count)
+                return count * word_bits;
+            x = words[k];
+        }
+        return k * word_bits + trailing_zeros64(x);
     }
 
-    void swap(unordered_sparse_set& s)
+    // the position of the first clear bit at or after position, or count * word bits; found on the complement, so
+    // a word of all ones is skipped with a single comparison
+    template <class Word>
+    std::size_t next_zero(const Word* words, std::size_t count, std::size_t position)
     {
-        m_sparse.swap(s.m_sparse);
-        m_dense.swap(s.m_dense);
+        static constexpr unsigned word_bits = std::numeric_limits<Word>::digits;
+        std::size_t k = position / word_bits;
+        if (k >= count)
+            return count * word_bits;
+
+        Word x = ~words[k] & (~Word(0) << (position % word_bits));
+        while (x == 0)
+        {
+            if (++k == count)
+                return count * word_bits;
+            x = ~words[k];
+        }
+        return k * word_bits + trailing_zeros64(x);
     }
 
-    bool test(std::size_t i) const
+    // sets (or clears) the bits in [first, last), a word at a time; first must be less than last
+    template <class Word>
+    void fill_bits(Word* words, std::size_t first, std::size_t last, bool value)
     {
-        return m_sparse[i] != nullptr;
+        static constexpr unsigned word_bits = std::numeric_limits<Word>::digits;
+        std::size_t w1 = first / word_bits;
+        std::size_t w2 = (last - 1) / word_bits;
+        Word first_mask = ~Word(0) << (first % word_bits);
+        Word last_mask = ~Word(0) >> (word_bits - 1 - (last - 1) % word_bits);
+
+        if (w1 == w2)
+            first_mask &= last_mask;
+        if (value)
+            words[w1] |= first_mask;
+        else
+            words[w1] &= ~first_mask;
+        if (w1 == w2)
+            return;
+
+        std::fill(words + w1 + 1, words + w2, value ? ~Word(0) : Word(0));
+        if (value)
+            words[w2] |= last_mask;
+        else
+            words[w2] &= ~last_mask;
     }
 
-    bool insert(std::size_t i)
+    // moves the bits of a bit array of count words down by n positions; the bits shifted in at the top are zero
+    template <class Word>
+    void shift_words_down(Word* words, std::size_t count, std::size_t n)
     {
-        if (m_sparse[i] != nullptr)
-            return false;
-        m_dense.push_back(i);
-        m_sparse[i] = &m_dense.back();
-        return true;
+        static constexpr unsigned word_bits = std::numeric_limits<Word>::digits;
+        std::size_t q = n / word_bits;
+        unsigned r = n % word_bits;
+        for (std::size_t k = 0; k < count; k++)
+        {
+            Word low = k + q < count ? words[k + q] : Word(0);
+            Word high = k + q + 1 < count ? words[k + q + 1] : Word(0);
+            words[k] = r == 0 ? low : (low >> r) | (high << (word_bits - r));
+        }
+    }
+
+    // moves the bits of a bit array of size bits up by n positions, dropping those that pass size; the bits shifted
+    // in at the bottom are zero
+    template <class Word>
+    void shift_words_up(Word* words, std::size_t size, std::size_t n)
+    {
+        static constexpr unsigned word_bits = std::numeric_limits<Word>::digits;
+        std::size_t count = (size + word_bits - 1) / word_bits;
+        std::size_t q = n / word_bits;
+        unsigned r = n % word_bits;
+        for (std::size_t k = count; k-- > 0; )
+        {
+            Word high = k >= q ? words[k - q] : Word(0);
+            Word low = k >= q + 1 ? words[k - q - 1] : Word(0);
+            words[k] = r == 0 ? high : (high << r) | (low >> (word_bits - r));
+        }
+        if (size % word_bits != 0)
+            words[count - 1] &= ~Word(0) >> (word_bits - size % word_bits);
+    }
+
+    ///
+    /// A forward iterator over the runs of a bit array of size bits, in increasing order. Each step looks for the next
+    /// set bit and then for the next clear bit, so a run costs one operation per word it spans rather than per element.
+    ///
+    template <class Word>
+    class run_iterator
+    {
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef run value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const run* pointer;
+        typedef const run& reference;
+
+    private:
+        static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+        const Word* m_words;
+        std::size_t m_word_count;
+        std::size_t m_size;
+        run m_run;                     // first is npos at the end
+
+        void find(std::size_t position)
+        {
+            std::size_t first = position < m_size ? next_one(m_words, m_word_count, position) : m_size;
+            if (first >= m_size)
+            {
+                m_run.first = m_run.last = npos;
+                return;
+            }
+            m_run.first = first;
+            m_run.last = std::min(m_size, next_zero(m_words, m_word_count, first));
+        }
+
+    public:
+        run_iterator() // end
+            : m_words(nullptr), m_word_count(0), m_size(0)
+        {
+            m_run.first = m_run.last = npos;
+        }
+
+        run_iterator(const Word* words, std::size_t word_count, std::size_t size)
+            : m_words(words), m_word_count(word_count), m_size(size)
+        {
+            find(0);
+        }
+
+        const run& operator*() const
+        {
+            return m_run;
+        }
+
+        const run* operator->() const
+        {
+            return &m_run;
+        }
+
+        run_iterator& operator++()
+        {
+            find(m_run.last);
+            return *this;
+        }
+
+        run_iterator operator++(int)
+        {
+            run_iterator tmp(*this);
+            ++*this;
+            return tmp;
+        }
+
+        bool operator==(const run_iterator& y) const
+        {
+            return m_run.first == y.m_run.first;
+        }
+
+        bool operator!=(const run_iterator& y) const
+        {
+            return m_run.first != y.m_run.first;
+        }
+    };
+
+    ///
+    /// A forward iterator over the values of [0, size) that are absent from a bit array, read from the inverted words;
+    /// the bits of the last word beyond size are never reported, and a word of all ones is skipped with a single comparison
+    ///
+    template <class Word>
+    class complement_iterator
+    {
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef std::size_t value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const std::size_t* pointer;
+        typedef const std::size_t& reference;
+
+    private:
+        static constexpr unsigned word_bits = std::numeric_limits<Word>::digits;
+        static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+        const Word* m_words;
+        std::size_t m_word_index;
+        std::size_t m_word_count;
+        std::size_t m_size;
+        Word m_current;                // the inverted bits of the current word not yet reported
+        std::size_t m_value;           // npos at the end
+
+        void next_bit()
+        {
+            while (m_current == 0)
+            {
+                if (++m_word_index >= m_word_count)
+                {
+                    m_value = npos;
+                    return;
+                }
+                m_current = ~m_words[m_word_index];
+            }
+            m_value = m_word_index * word_bits + trailing_zeros64(m_current);
+            m_current &= m_current - 1;
+            if (m_value >= m_size)
+            {
+                m_value = npos;
+                m_current = 0;
+                m_word_index = m_word_count;
+            }
+        }
+
+    public:
+        complement_iterator() // end
+            : m_words(nullptr), m_word_index(0), m_word_count(0), m_size(0), m_current(0), m_value(npos)
+        {
+        }
+
+        // the values of [first, size) absent from the bit array, which has at least size bits
+        complement_iterator(const Word* words, std::size_t size, std::size_t first = 0)
+            : m_words(words), m_word_index(first / word_bits), m_word_count((size + word_bits - 1) / word_bits), m_size(size),
+            m_current(0), m_value(npos)
+        {
+            if (first < size)
+            {
+                m_current = ~m_words[m_word_index] & (~Word(0) << (first % word_bits));
+                next_bit();
+            }
+        }
+
+        const std::size_t& operator*() const
+        {
+            return m_value;
+        }
+
+        complement_iterator& operator++()
+        {
+            next_bit();
+            return *this;
+        }
+
+        complement_iterator operator++(int)
+        {
+            complement_iterator tmp(*this);
+            ++*this;
+            return tmp;
+        }
+
+        bool operator==(const complement_iterator& y) const
+        {
+            return m_value == y.m_value;
+        }
+
+        bool operator!=(const complement_iterator& y) const
+        {
+            return m_value != y.m_value;
+        }
+    };
+} // bits
+
+namespace bits
+{
+    ///------------------------------------
+    /// Comparisons and hashing of bit arrays by content: a shorter bit array compares as if it were padded with
+    /// zero words, so sets over different universes are equal if they have the same elements
+    ///------------------------------------
+
+    static constexpr std::size_t compare_block_bytes = 64; // two AVX2 registers between early exits
+
+    // true if the n words are all zero
+    template <class Word>
+    bool zero_words(const Word* a, std::size_t n)
+    {
+        std::size_t i = 0;
+#if defined(__AVX2__)
+        static constexpr std::size_t block = compare_block_bytes / sizeof(Word);
+        for (; i + block <= n; i += block)
+        {
+            __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+            __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i + block / 2));
+            __m256i z = _mm256_or_si256(x, y);
+            if (!_mm256_testz_si256(z, z))
+                return false;
+        }
+#endif
+        for (; i < n; i++)
+        {
+            if (a[i] != 0)
+                return false;
+        }
+        return true;
+    }
+
+    // a == b, stopping at the first block of words that differs
+    template <class Word>
+    bool equal_words(const Word* a, std::size_t na, const Word* b, std::size_t nb)
+    {
+        std::size_t n = std::min(na, nb);
+        std::size_t i = 0;
+#if defined(__AVX2__)
+        static constexpr std::size_t block = compare_block_bytes / sizeof(Word);
+        for (; i + block <= n; i += block)
+        {
+            __m256i x = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i)),
+                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i)));
+            __m256i y = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i + block / 2)),
+                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i + block / 2)));
+            __m256i z = _mm256_or_si256(x, y);
+            if (!_mm256_testz_si256(z, z))
+                return false;
+        }
+#endif
+        for (; i < n; i++)
+        {
+            if (a[i] != b[i])
+                return false;
+        }
+        return na > nb ? zero_words(a + n, na - n) : zero_words(b + n, nb - n);
+    }
+
+    // every bit of a is in b, stopping at the first block of words with a bit outside b
+    template <class Word>
+    bool subset_words(const Word* a, std::size_t na, const Word* b, std::size_t nb)
+    {
+        std::size_t n = std::min(na, nb);
+        std::size_t i = 0;
+#if defined(__AVX2__)
+        static constexpr std::size_t block = compare_block_bytes / sizeof(Word);
+        for (; i + block <= n; i += block)
+        {
+            __m256i x = _mm256_andnot_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i)),
+                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i)));
+            __m256i y = _mm256_andnot_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i + block / 2)),
+                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i + block / 2)));
+            __m256i z = _mm256_or_si256(x, y);
+            if (!_mm256_testz_si256(z, z))
+                return false;
+        }
+#endif
+        for (; i < n; i++)
+        {
+            if ((a[i] & ~b[i]) != 0)
+                return false;
+        }
+        return na <= n || zero_words(a + n, na - n);
+    }
+
+    // a and b have a bit in common, stopping at the first block of words where they do
+    template <class Word>
+    bool intersect_words(const Word* a, std::size_t na, const Word* b, std::size_t nb)
+    {
+        std::size_t n = std::min(na, nb);
+        std::size_t i = 0;
+#if defined(__AVX2__)
+        static constexpr std::size_t block = compare_block_bytes / sizeof(Word);
+        for (; i + block <= n; i += block)
+        {
+            __m256i x = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i)),
+                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i)));
+            __m256i y = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i + block / 2)),
+                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i + block / 2)));
+            __m256i z = _mm256_or_si256(x, y);
+            if (!_mm256_testz_si256(z, z))
+                return true;
+        }
+#endif
+        for (; i < n; i++)
+        {
+            if ((a[i] & b[i]) != 0)
+                return true;
+        }
+        return false;
+    }
+
+    // the finalizer of MurmurHash3: every bit of x affects every bit of the result
+    inline std::uint64_t mix64(std::uint64_t x)
+    {
+        x ^= x >> 33;
+        x *= 0xFF51AFD7ED558CCDull;
+        x ^= x >> 33;
+        x *= 0xC4CEB9FE1A85EC53ull;
+        x ^= x >> 33;
+        return x;
+    }
+
+    ///
+    /// The share of word k with the value w in the hash of a bit array: 0 for a zero word, so that trailing zero words
+    /// do not change the hash. The hash is the XOR of the shares, so a change to one word updates it in O(1):
+    /// hash ^= hash_word(k, old) ^ hash_word(k, new).
+    ///
+    inline std::uint64_t hash_word(std::size_t k, std::uint64_t w)
+    {
+        return w == 0 ? 0 : mix64(w ^ mix64(k + 0x9E3779B97F4A7C15ull));
+    }
+
+    template <class Word>
+    std::uint64_t hash_words(const Word* a, std::size_t n)
+    {
+        std::uint64_t h = 0;
+        for (std::size_t k = 0; k < n; k++)
+        {
+            h ^= hash_word(k, a[k]);
+        }
+        return h;
+    }
+} // bits
+
+namespace bits
+{
+    ///------------------------------------
+    /// Batched membership tests
+    ///------------------------------------
+
+    static constexpr std::size_t prefetch_distance = 16; // keys ahead of the one being tested
+
+    inline void prefetch(const void* p)
+    {
+#if defined(__GNUC__)
+        __builtin_prefetch(p);
+#elif defined(_MSC_VER)
+        _mm_prefetch(static_cast<const char*>(p), _MM_HINT_T0);
+#else
+        (void)p;
+#endif
+    }
+
+    ///
+    /// Tests keys[0..n-1] against a bit array: bit j of out_mask (which has (n + 63) / 64 words) is set if keys[j] is present.
+    /// Returns the number of keys present. Every key must be in the bit array. The words for the keys prefetch_distance
+    /// ahead are prefetched, so that up to that many cache misses are in flight instead of one at a time.
+    ///
+    template <class Word, class Key>
+    std::size_t test_batch(const Word* words, const Key* keys, std::size_t n, std::uint64_t* out_mask)
+    {
+        static constexpr unsigned word_bits = std::numeric_limits<Word>::digits;
+
+        std::size_t count = 0;
+        for (std::size_t j = 0; j < n; j += 64)
+        {
+            std::size_t stop = std::min(n, j + 64);
+            std::uint64_t mask = 0;
+            for (std::size_t k = j; k < stop; k++)
+            {
+                if (k + prefetch_distance < n)
+                    prefetch(words + keys[k + prefetch_distance] / word_bits);
+                std::uint64_t bit = (words[keys[k] / word_bits] >> (keys[k] % word_bits)) & 1;
+                mask |= bit << (k - j);
+                count += static_cast<std::size_t>(bit);
+            }
+            out_mask[j / 64] = mask;
+        }
+        return count;
+    }
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+    ///
+    /// The same for 32-bit keys with gathers: the bit array is read as 32-bit words (little endian), 16 keys
+    /// at a time with AVX-512 and 8 at a time with AVX2. The keys of the next block of 64 are prefetched.
+    ///
+    template <class Word>
+    std::size_t test_batch(const Word* words, const std::uint32_t* keys, std::size_t n, std::uint64_t* out_mask)
+    {
+        const int* words32 = reinterpret_cast<const int*>(words);
+        std::size_t count = 0;
+        std::size_t j = 0;
+
+        for (; j + 64 <= n; j += 64)
+        {
+            for (std::size_t k = j + 64, kStop = std::min(n, j + 128); k < kStop; k++)
+            {
+                prefetch(words32 + (keys[k] >> 5));
+            }
+
+            std::uint64_t mask = 0;
+#if defined(__AVX512F__)
+            const __m512i low_bits = _mm512_set1_epi32(31);
+            const __m512i one = _mm512_set1_epi32(1);
+            for (unsigned b = 0; b < 64; b += 16)
+            {
+                __m512i k = _mm512_loadu_si512(reinterpret_cast<const void*>(keys + j + b));
+                __m512i w = _mm512_i32gather_epi32(_mm512_srli_epi32(k, 5), words32, 4);
+                __m512i bit = _mm512_srlv_epi32(w, _mm512_and_si512(k, low_bits));
+                mask |= static_cast<std::uint64_t>(_mm512_test_epi32_mask(bit, one)) << b;
+            }
+#else
+            const __m256i low_bits = _mm256_set1_epi32(31);
+            for (unsigned b = 0; b < 64; b += 8)
+            {
+                __m256i k = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + j + b));
+                __m256i w = _mm256_i32gather_epi32(words32, _mm256_srli_epi32(k, 5), 4);
+                __m256i bit = _mm256_slli_epi32(_mm256_srlv_epi32(w, _mm256_and_si256(k, low_bits)), 31);
+                mask |= static_cast<std::uint64_t>(static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(bit)))) << b;
+            }
+#endif
+            out_mask[j / 64] = mask;
+            count += count_bits(mask);
+        }
+
+        if (j < n)
+            count += test_batch<Word, std::uint32_t>(words, keys + j, n - j, out_mask + j / 64);
+        return count;
+    }
+#endif
+} // bits
+
+namespace bits
+{
+    ///
+    /// A vector of trivially copyable values that keeps up to InlineCount of them in the object itself and only
+    /// allocates from Allocator beyond that, so that small sets make no heap allocations. Access goes through a data
+    /// pointer in both cases, so it costs the same as for std::vector. Only what the bit arrays need is provided.
+    ///
+    template <class T, std::size_t InlineCount, class Allocator>
+    class small_vector : private Allocator
+    {
+        typedef std::allocator_traits<Allocator> traits;
+
+        T* m_data;
+        std::size_t m_size;
+        std::size_t m_capacity;
+        T m_inline[InlineCount > 0 ? InlineCount : 1];
+
+        bool is_inline() const
+        {
+            return m_data == m_inline;
+        }
+
+        void release()
+        {
+            if (!is_inline())
+                traits::deallocate(*this, m_data, m_capacity);
+            m_data = m_inline;
+            m_size = 0;
+            m_capacity = InlineCount;
+        }
+
+        // takes over the contents of s, which is left empty
+        void move_from(small_vector& s)
+        {
+            release();
+            static_cast<Allocator&>(*this) = static_cast<Allocator&>(s);
+            if (s.is_inline())
+            {
+                std::copy(s.m_inline, s.m_inline + s.m_size, m_inline);
+                m_size = s.m_size;
+            }
+            else
+            {
+                m_data = s.m_data;
+                m_size = s.m_size;
+                m_capacity = s.m_capacity;
+                s.m_data = s.m_inline;
+                s.m_capacity = InlineCount;
+            }
+            s.m_size = 0;
+        }
+
+        void reallocate(std::size_t capacity)
+        {
+            T* data = traits::allocate(*this, capacity);
+            std::copy(m_data, m_data + m_size, data);
+            std::size_t size = m_size;
+            release();
+            m_data = data;
+            m_size = size;
+            m_capacity = capacity;
+        }
+
+    public:
+        typedef T value_type;
+        typedef T* iterator;
+        typedef const T* const_iterator;
+        typedef Allocator allocator_type;
+
+        static constexpr std::size_t inline_capacity = InlineCount;
+
+        small_vector(const Allocator& alloc = Allocator()) : Allocator(alloc), m_data(m_inline), m_size(0), m_capacity(InlineCount)
+        {
+        }
+
+        small_vector(std::size_t n, const T& value, const Allocator& alloc = Allocator())
+            : Allocator(alloc), m_data(m_inline), m_size(0), m_capacity(InlineCount)
+        {
+            resize(n, value);
+        }
+
+        small_vector(const small_vector& s)
+            : Allocator(traits::select_on_container_copy_construction(s)), m_data(m_inline), m_size(0), m_capacity(InlineCount)
+        {
+            if (s.m_size > m_capacity)
+                reallocate(s.m_size);
+            std::copy(s.m_data, s.m_data + s.m_size, m_data);
+            m_size = s.m_size;
+        }
+
+        small_vector(small_vector&& s) : Allocator(s), m_data(m_inline), m_size(0), m_capacity(InlineCount)
+        {
+            move_from(s);
+        }
+
+        small_vector& operator=(const small_vector& s)
+        {
+            if (this != &s)
+            {
+                small_vector copy(s);
+                move_from(copy);
+            }
+            return *this;
+        }
+
+        small_vector& operator=(small_vector&& s)
+        {
+            if (this != &s)
+                move_from(s);
+            return *this;
+        }
+
+        ~small_vector()
+        {
+            release();
+        }
+
+        void swap(small_vector& s)
+        {
+            small_vector t(std::move(s));
+            s.move_from(*this);
+            move_from(t);
+        }
+
+        void resize(std::size_t n, const T& value = T())
+        {
+            if (n > m_capacity)
+                reallocate(n);
+            if (n > m_size)
+                std::fill(m_data + m_size, m_data + n, value);
+            m_size = n;
+        }
+
+        void assign(std::size_t n, const T& value)
+        {
+            m_size = 0;
+            resize(n, value);
+        }
+
+        void clear()
+        {
+            m_size = 0;
+        }
+
+        T& operator[](std::size_t k)
+        {
+            return m_data[k];
+        }
+
+        const T& operator[](std::size_t k) const
+        {
+            return m_data[k];
+        }
+
+        T* data()
+        {
+            return m_data;
+        }
+
+        const T* data() const
+        {
+            return m_data;
+        }
+
+        T* begin()
+        {
+            return m_data;
+        }
+
+        T* end()
+        {
+            return m_data + m_size;
+        }
+
+        const T* begin() const
+        {
+            return m_data;
+        }
+
+        const T* end() const
+        {
+            return m_data + m_size;
+        }
+
+        T& back()
+        {
+            return m_data[m_size - 1];
+        }
+
+        std::size_t size() const
+        {
+            return m_size;
+        }
+
+        std::size_t capacity() const
+        {
+            return m_capacity;
+        }
+
+        bool empty() const
+        {
+            return m_size == 0;
+        }
+
+        // false while the values fit in the object
+        bool uses_heap() const
+        {
+            return !is_inline();
+        }
+
+        Allocator get_allocator() const
+        {
+            return *this;
+        }
+    };
+} // bits
+
+///
+/// Fast operations for a collection of integer values in the range [0; size-1]
+/// Whenever an iterator is required an array of values is generated.
+/// It outperform boost::dynamic_bitset and bounded_set (see below) in repeated iterations over the same set of values. 
+/// In comparison, boost::dynamic_bitset and bounded_set use less memory and outperform the sparse set if repeated iterations are
+/// not required.
+/// The storage is obtained from Allocator (see sparse_set_allocators.h for cache-line aligned and huge page allocators).
+/// With Stats = operation_stats the set counts its operations, sequence rebuilds and scanned words (see stats()).
+/// Bit arrays of up to InlineWords words (two cache lines by default: 1024 values) are kept in the set itself.
+///
+
+template <class Allocator = std::allocator<std::size_t>, class Stats = no_stats, std::size_t InlineWords = 16>
+class basic_sparse_set : private Stats
+{
+    static constexpr std::size_t EmptyIndex = static_cast<std::size_t>(-1);
+    typedef std::size_t base_type;
+    static constexpr unsigned unsigned_bits = std::numeric_limits<base_type>::digits;
+    static constexpr unsigned unsigned_bits_log2 = (unsigned_bits == 64 ? 6 : unsigned_bits == 32 ? 5 : unsigned_bits == 16 ? 4 : 3);
+    static constexpr unsigned unsigned_bits_log2_mask = 0xFFFFFFFF >> (32 - unsigned_bits_log2);
+    static constexpr std::size_t one_bit = 1;
+
+    typedef typename std::allocator_traits<Allocator>::template rebind_alloc<base_type> word_allocator;
+    typedef typename std::allocator_traits<Allocator>::template rebind_alloc<std::size_t> sequence_allocator;
+    typedef bits::small_vector<base_type, InlineWords, word_allocator> bit_array_type;
+    typedef std::vector<std::size_t, sequence_allocator> sequence_type;
+
+    unsigned m_size;
+    bit_array_type m_bit_array;
+    mutable sequence_type m_sequence;
+    mutable bool m_iterator_present;
+
+    void invalidate_sequence()
+    {
+        if (m_iterator_present)
+        {
+            m_iterator_present = false;
+            m_sequence.clear();
+            this->on_sequence_invalidated();
+        }
+    }
+
+    void create_iteration_sequence() const
+    {
+        //if (!m_sequence.empty())
+        //    return;
+
+        this->on_sequence_rebuilt();
+        this->on_iteration_scan(m_bit_array.size());
+
+        if (m_sequence.capacity() != m_size)
+        {
+            m_sequence.reserve(m_size);
+        }
+
+        std::size_t k = 0;
+        for (auto x : m_bit_array)
+        {
+            if (x)
+            {
+                unsigned bit = k;
+                do
+                {
+                    unsigned p = bits::lsb(x);
+                    bit += p;
+                    x >>= p;
+                    m_sequence.push_back(bit);
+                    if (x == 1)
+                        break;
+                    x >>= 1;
+                    bit++;
+                } while (true);
+            }
+            k += unsigned_bits;
+        }
+    }
+
+public:
+    typedef std::size_t value_type;
+    typedef std::size_t key_type;
+    typedef std::size_t size_type;
+    typedef Allocator allocator_type;
+    typedef Stats stats_type;
+    typedef typename sequence_type::const_iterator iterator;
+    typedef iterator const_iterator;
+
+    typedef typename sequence_type::const_reverse_iterator reverse_iterator;
+    typedef reverse_iterator const_reverse_iterator;
+
+    typedef base_type word_type;
+    static constexpr unsigned word_bits = unsigned_bits;
+
+    typedef bits::value_range_iterator<word_type> range_iterator;
+    typedef bits::iterator_range<range_iterator> range_type;
+
+    basic_sparse_set(std::size_t size, const Allocator& alloc = Allocator()) :m_size(size),
+        m_bit_array((m_size + unsigned_bits - 1) / unsigned_bits, base_type(0), word_allocator(alloc)),
+        m_sequence(sequence_allocator(alloc)), m_iterator_present(false)
+    {
+        
+    }
+
+    basic_sparse_set(const Allocator& alloc = Allocator()) :m_size(0),
+        m_bit_array(word_allocator(alloc)), m_sequence(sequence_allocator(alloc)), m_iterator_present(false)
+    {
+    }
+
+    void swap(basic_sparse_set& s)
+    {
+        m_bit_array.swap(s.m_bit_array);
+        m_sequence.swap(s.m_sequence);
+        std::swap(m_iterator_present, s.m_iterator_present);
+        std::swap(m_size, s.m_size);
+    }
+
+    void resize(std::size_t size)
+    {
+        m_size = size;
+        m_bit_array.resize((m_size + unsigned_bits - 1) / unsigned_bits);
+        if (m_size % unsigned_bits != 0) // the elements past a smaller size are gone
+            m_bit_array.back() &= (one_bit << (m_size % unsigned_bits)) - 1;
+        invalidate_sequence();
+    }
+
+    bool insert(value_type i)
+    {
+        invalidate_sequence();
+        base_type& v = m_bit_array[i >> unsigned_bits_log2];
+        base_type x = v;
+        v |= (one_bit << (i & unsigned_bits_log2_mask));
+        this->on_insert(x != v);
+        return x != v;  
+    }
+
+    void erase(value_type i)
+    {
+        m_bit_array[i >> unsigned_bits_log2] &= ~(one_bit << (i & unsigned_bits_log2_mask));
+        this->on_erase();
+        invalidate_sequence();
+    }
+
+    bool test(std::size_t i) const
+    {        
+        return ((m_bit_array[i >> unsigned_bits_log2] >> (i & unsigned_bits_log2_mask)) & 1) != 0;        
+    }
+
+    ///
+    /// Tests n keys at once (see bits::test_batch): bit j of out_mask, which has (n + 63) / 64 words, is set
+    /// if keys[j] is present. Returns the number of keys present. Every key must be less than size().
+    /// The misses of the whole batch overlap, and 32-bit keys are tested with gathers when AVX2 or AVX-512 is enabled.
+    ///
+    std::size_t test_batch(const std::uint32_t* keys, std::size_t n, std::uint64_t* out_mask) const
+    {
+        return bits::test_batch(m_bit_array.data(), keys, n, out_mask);
+    }
+
+    std::size_t test_batch(const std::uint64_t* keys, std::size_t n, std::uint64_t* out_mask) const
+    {
+        return bits::test_batch(m_bit_array.data(), keys, n, out_mask);
+    }
+
+    bool empty() const
+    {        
+        std::size_t scanned = 0;
+        for (auto x : m_bit_array)
+        {
+            scanned++;
+            if (x != 0)
+            {
+                this->on_empty_scan(scanned);
+                return false;
+            }
+        }
+        this->on_empty_scan(scanned);
+        return true;
+    }
+
+    void clear()
+    {
+        invalidate_sequence();
+        std::fill(m_bit_array.begin(), m_bit_array.end(), 0);
+    }
+
+    std::size_t size() const
+    {
+        return m_size;
+    }
+
+    std::size_t count() const
+    {
+        if (m_iterator_present)
+            return m_sequence.size();
+
+        this->on_count_scan(m_bit_array.size());
+        std::size_t count = 0;
+        for (auto x : m_bit_array)
+        {
+            count += bits::count_bits(x);
+        }
+        return count;
+    }
+
+    iterator begin() const
+    {
+        if (!m_iterator_present)
+        {
+            create_iteration_sequence();
+            m_iterator_present = true;
+        }
+        return m_sequence.begin();
+    }
+
+    iterator end() const
+    {
+        if (!m_iterator_present)
+        {
+            create_iteration_sequence();
+            m_iterator_present = true;
+        }
+        return m_sequence.end();
+    }
+
+    reverse_iterator rbegin() const
+    {
+        if (!m_iterator_present)
+        {
+            create_iteration_sequence();
+            m_iterator_present = true;
+        }
+        return m_sequence.rbegin();
+    }
+
+    reverse_iterator rend() const
+    {
+        if (!m_iterator_present)
+        {            
+            create_iteration_sequence();
+            m_iterator_present = true;            
+        }
+        return m_sequence.rend();
+    }
+
+    // lower_bound and upper_bound build the sequence, like begin(); use range() for a narrow window
+    iterator lower_bound(value_type i) const
+    {
+        return std::lower_bound(begin(), end(), i);
+    }
+
+    iterator upper_bound(value_type i) const
+    {
+        return std::upper_bound(begin(), end(), i);
+    }
+
+    ///
+    /// The elements in [first, last). If the sequence is present, they are read from it; otherwise only the words
+    /// covering the range are decoded, and the sequence is not built, so a narrow window costs O(last - first)
+    /// rather than O(size()). The range is invalidated by any modification.
+    ///
+    range_type range(std::size_t first, std::size_t last) const
+    {
+        last = std::min(last, std::size_t(m_size));
+        if (first >= last)
+            return range_type(range_iterator(), range_iterator());
+
+        if (m_iterator_present)
+        {
+            const std::size_t* data = m_sequence.data();
+            std::size_t p1 = std::lower_bound(m_sequence.begin(), m_sequence.end(), first) - m_sequence.begin();
+            std::size_t p2 = std::lower_bound(m_sequence.begin() + p1, m_sequence.end(), last) - m_sequence.begin();
+            return range_type(range_iterator(data + p1, data + p2), range_iterator());
+        }
+
+        this->on_iteration_scan((last + unsigned_bits - 1) / unsigned_bits - first / unsigned_bits);
+        return range_type(range_iterator(m_bit_array.data(), first, last), range_iterator());
+    }
+
+    // the number of elements in [first, last), counted on the words covering the range
+    std::size_t count(std::size_t first, std::size_t last) const
+    {
+        last = std::min(last, std::size_t(m_size));
+        if (first >= last)
+            return 0;
+
+        std::size_t w1 = first >> unsigned_bits_log2;
+        std::size_t w2 = (last - 1) >> unsigned_bits_log2;
+        base_type first_mask = ~base_type(0) << (first & unsigned_bits_log2_mask);
+        base_type last_mask = ~base_type(0) >> (unsigned_bits - 1 - ((last - 1) & unsigned_bits_log2_mask));
+        this->on_count_scan(w2 - w1 + 1);
+
+        if (w1 == w2)
+            return bits::count_bits(m_bit_array[w1] & first_mask & last_mask);
+
+        std::size_t count = bits::count_bits(m_bit_array[w1] & first_mask) + bits::count_bits(m_bit_array[w2] & last_mask);
+        for (std::size_t k = w1 + 1; k < w2; k++)
+        {
+            count += bits::count_bits(m_bit_array[k]);
+        }
+        return count;
+    }
+
+    ///------------------------------------
+    /// Runs: maximal intervals [first, last) of consecutive elements
+    ///------------------------------------
+
+    typedef bits::run run_type;
+    typedef bits::run_iterator<word_type> run_iterator;
+    typedef bits::iterator_range<run_iterator> runs_type;
+
+    // the runs in increasing order, read from the words; the range is invalidated by any modification
+    runs_type runs() const
+    {
+        this->on_iteration_scan(m_bit_array.size());
+        return runs_type(run_iterator(m_bit_array.data(), m_bit_array.size(), m_size), run_iterator());
+    }
+
+    // calls f(first, last) for every run, in increasing order
+    template <class F>
+    void for_each_run(F f) const
+    {
+        for (const run_type& r : runs())
+        {
+            f(r.first, r.last);
+        }
+    }
+
+    // inserts the elements of [first, last), a word at a time
+    void insert_run(std::size_t first, std::size_t last)
+    {
+        last = std::min(last, std::size_t(m_size));
+        if (first >= last)
+            return;
+        invalidate_sequence();
+        bits::fill_bits(m_bit_array.data(), first, last, true);
+    }
+
+    // erases the elements of [first, last), a word at a time
+    void erase_run(std::size_t first, std::size_t last)
+    {
+        last = std::min(last, std::size_t(m_size));
+        if (first >= last)
+            return;
+        invalidate_sequence();
+        bits::fill_bits(m_bit_array.data(), first, last, false);
+    }
+
+    // inserts the runs of [first, last), a sequence of run_type or of anything else with first and last members
+    template <class RunIterator>
+    void insert_runs(RunIterator first, RunIterator last)
+    {
+        for (; first != last; ++first)
+        {
+            insert_run(first->first, first->last);
+        }
+    }
+
+    ///------------------------------------
+    /// Shifts, as when a window of values moves
+    ///------------------------------------
+
+    // erases the elements less than n and moves the others down by n, a word at a time
+    void shift_down(std::size_t n)
+    {
+        invalidate_sequence();
+        if (n >= m_size)
+            std::fill(m_bit_array.begin(), m_bit_array.end(), base_type(0));
+        else if (n != 0)
+            bits::shift_words_down(m_bit_array.data(), m_bit_array.size(), n);
+    }
+
+    // erases the elements not less than size() - n and moves the others up by n, a word at a time
+    void shift_up(std::size_t n)
+    {
+        invalidate_sequence();
+        if (n >= m_size)
+            std::fill(m_bit_array.begin(), m_bit_array.end(), base_type(0));
+        else if (n != 0)
+            bits::shift_words_up(m_bit_array.data(), m_size, n);
+    }
+
+    ///------------------------------------
+    /// The complement: the values of [0, size()) that are absent
+    ///------------------------------------
+
+    typedef bits::complement_iterator<word_type> complement_iterator;
+    typedef bits::iterator_range<complement_iterator> complement_type;
+
+    // the absent values in increasing order, read from the inverted words; the range is invalidated by any modification
+    complement_type complement() const
+    {
+        this->on_iteration_scan(m_bit_array.size());
+        return complement_type(complement_iterator(m_bit_array.data(), m_size), complement_iterator());
+    }
+
+    // calls f(x) for every absent value x, in increasing order
+    template <class F>
+    void for_each_absent(F f) const
+    {
+        for (auto x : complement())
+        {
+            f(x);
+        }
+    }
+
+    // the smallest absent value not less than from, or size() if there is none, as when allocating a free slot;
+    // the words are read from the one holding from, and a full word costs a single comparison
+    std::size_t find_first_absent(std::size_t from = 0) const
+    {
+        if (from >= m_size)
+            return m_size;
+        return std::min(std::size_t(m_size), bits::next_zero(m_bit_array.data(), m_bit_array.size(), from));
+    }
+
+    ///------------------------------------
+    /// Comparisons by content, whatever the sizes of the universes (Set is a bounded set or a sparse set)
+    ///------------------------------------
+
+    // true if s has the same elements; compares the words, stopping at the first block that differs
+    template <class Set>
+    bool equals(const Set& s) const
+    {
+        return bits::equal_words(m_bit_array.data(), m_bit_array.size(), s.words(), s.word_count());
+    }
+
+    // true if every element is in s; stops at the first block of words with an element outside s
+    template <class Set>
+    bool is_subset_of(const Set& s) const
+    {
+        return bits::subset_words(m_bit_array.data(), m_bit_array.size(), s.words(), s.word_count());
+    }
+
+    // true if s has an element in common with this set; stops at the first block of words where it does
+    template <class Set>
+    bool intersects(const Set& s) const
+    {
+        return bits::intersect_words(m_bit_array.data(), m_bit_array.size(), s.words(), s.word_count());
+    }
+
+    ///
+    /// A 64-bit hash of the elements, computed on the words in O(size() / 64): sets with the same elements have the same
+    /// hash whatever their universes. hashed_set (sparse_set_hashed.h) keeps it up to date instead of computing it.
+    ///
+    std::uint64_t hash() const
+    {
+        return bits::hash_words(m_bit_array.data(), m_bit_array.size());
+    }
+
+    ///------------------------------------
+    /// Word access (used by serialization and bulk operations)
+    ///------------------------------------
+
+    std::size_t word_count() const
+    {
+        return m_bit_array.size();
+    }
+
+    const word_type* words() const
+    {
+        return m_bit_array.data();
+    }
+
+    // the bits beyond size() in the last word must be zero
+    void assign_word(std::size_t k, word_type w)
+    {
+        invalidate_sequence();
+        m_bit_array[k] = w;
+    }
+
+    ///------------------------------------
+    /// Operation statistics (all zero unless Stats = operation_stats)
+    ///------------------------------------
+
+    operation_counts stats() const
+    {
+        return Stats::snapshot();
+    }
+
+    void reset_stats()
+    {
+        Stats::reset();
+    }
+};
+
+typedef basic_sparse_set<> sparse_set;
+
+// equality by content: sets over different universes are equal if they have the same elements
+template <class Allocator1, class Stats1, std::size_t InlineWords1, class Allocator2, class Stats2, std::size_t InlineWords2>
+bool operator==(const basic_sparse_set<Allocator1, Stats1, InlineWords1>& a, const basic_sparse_set<Allocator2, Stats2, InlineWords2>& b)
+{
+    return a.equals(b);
+}
+
+template <class Allocator1, class Stats1, std::size_t InlineWords1, class Allocator2, class Stats2, std::size_t InlineWords2>
+bool operator!=(const basic_sparse_set<Allocator1, Stats1, InlineWords1>& a, const basic_sparse_set<Allocator2, Stats2, InlineWords2>& b)
+{
+    return !a.equals(b);
+}
+
+namespace std
+{
+    template <class Allocator, class Stats, std::size_t InlineWords>
+    struct hash<basic_sparse_set<Allocator, Stats, InlineWords> >
+    {
+        std::size_t operator()(const basic_sparse_set<Allocator, Stats, InlineWords>& s) const
+        {
+            return static_cast<std::size_t>(s.hash());
+        }
+    };
+} // std
+
+///
+/// The unordered sparse set is slower than sparse set, except for iteration over the whole set of values.
+/// It uses more memory than sparse set.
+/// With Stats = operation_stats the set counts its inserts and erases (see stats()).
+///
+template <class Allocator = std::allocator<std::size_t>, class Stats = no_stats>
+class basic_unordered_sparse_set : private Stats
+{
+public:
+
+
+    typedef std::vector<std::size_t*, typename std::allocator_traits<Allocator>::template rebind_alloc<std::size_t*> > direct_access_sequence;
+    typedef std::vector<std::size_t, typename std::allocator_traits<Allocator>::template rebind_alloc<std::size_t> >  iteration_sequence;
+
+    direct_access_sequence m_sparse;
+    iteration_sequence m_dense;
+
+private:
+    template <class Key>
+    std::size_t test_keys(const Key* keys, std::size_t n, std::uint64_t* out_mask) const
+    {
+        const std::size_t* const* sparse = m_sparse.data();
+        std::size_t count = 0;
+        for (std::size_t j = 0; j < n; j += 64)
+        {
+            std::size_t stop = std::min(n, j + 64);
+            std::uint64_t mask = 0;
+            for (std::size_t k = j; k < stop; k++)
+            {
+                if (k + bits::prefetch_distance < n)
+                    bits::prefetch(sparse + keys[k + bits::prefetch_distance]);
+                std::uint64_t bit = sparse[keys[k]] != nullptr;
+                mask |= bit << (k - j);
+                count += static_cast<std::size_t>(bit);
+            }
+            out_mask[j / 64] = mask;
+        }
+        return count;
+    }
+
+public:
+    typedef std::size_t value_type;
+    typedef std::size_t size_type;
+    typedef std::size_t key_type;
+    typedef Allocator allocator_type;
+    typedef Stats stats_type;
+    typedef typename iteration_sequence::const_iterator iterator;
+    typedef iterator const_iterator;
+
+    typedef typename iteration_sequence::const_reverse_iterator reverse_iterator;
+    typedef reverse_iterator const_reverse_iterator;
+
+    basic_unordered_sparse_set(std::size_t size, const Allocator& alloc = Allocator())
+        :m_sparse(size, nullptr, typename direct_access_sequence::allocator_type(alloc)),
+        m_dense(typename iteration_sequence::allocator_type(alloc))
+    {
+        m_dense.reserve(size);
+    }
+
+    basic_unordered_sparse_set(const Allocator& alloc = Allocator())
+        :m_sparse(typename direct_access_sequence::allocator_type(alloc)),
+        m_dense(typename iteration_sequence::allocator_type(alloc)) {}
+
+    void resize(std::size_t size)
+    {
+        for (auto x : m_dense) // the slots point into the dense array, which may move
+        {
+            m_sparse[x] = nullptr;
+        }
+        m_dense.clear();
+        m_sparse.resize(size);
+        m_dense.reserve(size);
+    }
+
+    void swap(basic_unordered_sparse_set& s)
+    {
+        m_sparse.swap(s.m_sparse);
+        m_dense.swap(s.m_dense);
+    }
+
+    bool test(std::size_t i) const
+    {
+        return m_sparse[i] != nullptr;
+    }
+
+    ///
+    /// Tests n keys at once: bit j of out_mask, which has (n + 63) / 64 words, is set if keys[j] is present.
+    /// Returns the number of keys present. The slots prefetch_distance keys ahead are prefetched, so that
+    /// the cache misses of the batch overlap.
+    ///
+    std::size_t test_batch(const std::uint32_t* keys, std::size_t n, std::uint64_t* out_mask) const
+    {
+        return test_keys(keys, n, out_mask);
+    }
+
+    std::size_t test_batch(const std::uint64_t* keys, std::size_t n, std::uint64_t* out_mask) const
+    {
+        return test_keys(keys, n, out_mask);
+    }
+
+    bool insert(std::size_t i)
+    {
+        if (m_sparse[i] != nullptr)
+        {
+            this->on_insert(false);
+            return false;
+        }
+        m_dense.push_back(i);
+        m_sparse[i] = &m_dense.back();
+        this->on_insert(true);
+        return true;
+    }
+
+    void erase(std::size_t i)
+    {
+        this->on_erase();
+        if (m_sparse[i] == nullptr)
+            return;
+        std::size_t* v = m_sparse[i];
+        std::size_t p_index = m_dense.back();
+        if (*v != p_index)
+        {
+            *v = p_index;
+            m_sparse[p_index] = v;
+        }
+        m_sparse[i] = nullptr;
+        m_dense.erase(m_dense.end() - 1);
+    }
+
+    void clear()
+    {
+        std::fill(m_sparse.begin(), m_sparse.end(), nullptr);
+        m_dense.clear();
+    }
+
+    std::size_t size() const
+    {
+        return m_sparse.size();
+    }
+
+    std::size_t count() const
+    {
+        return m_dense.size();
+    }
+
+    bool empty() const
+    {
+        return m_dense.empty();
+    }
+
+    iterator begin() const
+    {
+        return m_dense.begin();
+    }
+
+    iterator end() const
+    {
+        return m_dense.end();
+    }
+
+    reverse_iterator rbegin() const
+    {
+        return m_dense.rbegin();
+    }
+
+    reverse_iterator rend() const
+    {
+        return m_dense.rend();
+    }
+
+    iterator lower_bound(value_type i) const
+    {
+        return std::lower_bound(m_dense.begin(), m_dense.end(), i);
+    }
+
+    iterator upper_bound(value_type i) const
+    {
+        return std::upper_bound(m_dense.begin(), m_dense.end(), i);
+    }
+
+    ///------------------------------------
+    /// Operation statistics (all zero unless Stats = operation_stats)
+    ///------------------------------------
+
+    operation_counts stats() const
+    {
+        return Stats::snapshot();
+    }
+
+    void reset_stats()
+    {
+        Stats::reset();
+    }
+};
+
+typedef basic_unordered_sparse_set<> unordered_sparse_set;
+
+///
+/// Paged unordered sparse set for huge universes with clustered elements. The sparse array is split into pages of
+/// PageSize slots, which are listed in a page table: a page is allocated by the first insertion into it and released
+/// when its last element is erased, so the memory grows with the number of touched pages instead of the universe size.
+/// A slot holds the position of its element in the dense array plus one (0: absent), rather than a pointer, so that
+/// the dense array can grow on demand. test() costs two loads: the page table entry and the slot.
+/// Iteration goes through the dense array, as in the unordered sparse set.
+///
+template <std::size_t PageSize = 4096, class Allocator = std::allocator<std::size_t> >
+class basic_paged_unordered_sparse_set
+{
+public:
+    typedef std::vector<std::size_t, typename std::allocator_traits<Allocator>::template rebind_alloc<std::size_t> > iteration_sequence;
+
+    typedef std::size_t value_type;
+    typedef std::size_t size_type;
+    typedef std::size_t key_type;
+    typedef Allocator allocator_type;
+    typedef typename iteration_sequence::const_iterator iterator;
+    typedef iterator const_iterator;
+    typedef typename iteration_sequence::const_reverse_iterator reverse_iterator;
+    typedef reverse_iterator const_reverse_iterator;
+
+    static constexpr std::size_t page_size = PageSize;
+
+private:
+    struct page
+    {
+        std::size_t slots[PageSize];
+        std::size_t count;
+    };
+
+    typedef typename std::allocator_traits<Allocator>::template rebind_alloc<page> page_allocator;
+    typedef std::allocator_traits<page_allocator> page_traits;
+    typedef std::vector<page*, typename std::allocator_traits<Allocator>::template rebind_alloc<page*> > page_table;
+
+    std::size_t m_size;
+    page_table m_pages;
+    iteration_sequence m_dense;
+    page_allocator m_allocator;
+
+    static std::size_t page_table_size(std::size_t size)
+    {
+        return (size + PageSize - 1) / PageSize;
+    }
+
+    // value-initialised: all slots 0
+    page* allocate_page()
+    {
+        page* p = page_traits::allocate(m_allocator, 1);
+        page_traits::construct(m_allocator, p);
+        return p;
+    }
+
+    page* allocate_page(const page& value)
+    {
+        page* p = page_traits::allocate(m_allocator, 1);
+        page_traits::construct(m_allocator, p, value);
+        return p;
+    }
+
+    void release_page(page*& p)
+    {
+        if (p == nullptr)
+            return;
+        page_traits::destroy(m_allocator, p);
+        page_traits::deallocate(m_allocator, p, 1);
+        p = nullptr;
+    }
+
+    void release_pages()
+    {
+        for (auto& p : m_pages)
+        {
+            release_page(p);
+        }
+    }
+
+    std::size_t& slot(std::size_t i) const
+    {
+        return m_pages[i / PageSize]->slots[i % PageSize];
+    }
+
+public:
+    basic_paged_unordered_sparse_set(std::size_t size, const Allocator& alloc = Allocator())
+        : m_size(size), m_pages(page_table_size(size), nullptr, typename page_table::allocator_type(alloc)),
+        m_dense(typename iteration_sequence::allocator_type(alloc)), m_allocator(alloc)
+    {
+    }
+
+    basic_paged_unordered_sparse_set(const Allocator& alloc = Allocator())
+        : m_size(0), m_pages(typename page_table::allocator_type(alloc)),
+        m_dense(typename iteration_sequence::allocator_type(alloc)), m_allocator(alloc)
+    {
+    }
+
+    basic_paged_unordered_sparse_set(const basic_paged_unordered_sparse_set& s)
+        : m_size(s.m_size), m_pages(s.m_pages.size(), nullptr, s.m_pages.get_allocator()), m_dense(s.m_dense),
+        m_allocator(page_traits::select_on_container_copy_construction(s.m_allocator))
+    {
+        for (std::size_t p = 0; p < m_pages.size(); p++)
+        {
+            if (s.m_pages[p] != nullptr)
+                m_pages[p] = allocate_page(*s.m_pages[p]);
+        }
+    }
+
+    basic_paged_unordered_sparse_set(basic_paged_unordered_sparse_set&& s)
+        : m_size(s.m_size), m_pages(std::move(s.m_pages)), m_dense(std::move(s.m_dense)), m_allocator(s.m_allocator)
+    {
+        s.m_size = 0;
+        s.m_pages.clear();
+        s.m_dense.clear();
+    }
+
+    basic_paged_unordered_sparse_set& operator=(basic_paged_unordered_sparse_set s)
+    {
+        swap(s);
+        return *this;
+    }
+
+    ~basic_paged_unordered_sparse_set()
+    {
+        release_pages();
+    }
+
+    void swap(basic_paged_unordered_sparse_set& s)
+    {
+        std::swap(m_size, s.m_size);
+        m_pages.swap(s.m_pages);
+        m_dense.swap(s.m_dense);
+        std::swap(m_allocator, s.m_allocator);
+    }
+
+    void resize(std::size_t size)
+    {
+        release_pages();
+        m_pages.assign(page_table_size(size), nullptr);
+        m_dense.clear();
+        m_size = size;
+    }
+
+    bool test(std::size_t i) const
+    {
+        const page* pg = m_pages[i / PageSize];
+        return pg != nullptr && pg->slots[i % PageSize] != 0;
+    }
+
+    bool insert(std::size_t i)
+    {
+        page*& pg = m_pages[i / PageSize];
+        if (pg == nullptr)
+        {
+            pg = allocate_page();
+        }
+        std::size_t& v = pg->slots[i % PageSize];
+        if (v != 0)
+            return false;
+        m_dense.push_back(i);
+        v = m_dense.size();
+        pg->count++;
+        return true;
+    }
+
+    void erase(std::size_t i)
+    {
+        page*& pg = m_pages[i / PageSize];
+        if (pg == nullptr)
+            return;
+        std::size_t& v = pg->slots[i % PageSize];
+        if (v == 0)
+            return;
+
+        // the last element moves into the place of the erased one
+        std::size_t last = m_dense.back();
+        m_dense[v - 1] = last;
+        slot(last) = v;
+        v = 0;
+        m_dense.pop_back();
+        if (--pg->count == 0)
+        {
+            release_page(pg);
+        }
+    }
+
+    void clear()
+    {
+        release_pages();
+        m_dense.clear();
+    }
+
+    std::size_t size() const
+    {
+        return m_size;
+    }
+
+    std::size_t count() const
+    {
+        return m_dense.size();
+    }
+
+    bool empty() const
+    {
+        return m_dense.empty();
+    }
+
+    iterator begin() const
+    {
+        return m_dense.begin();
+    }
+
+    iterator end() const
+    {
+        return m_dense.end();
+    }
+
+    reverse_iterator rbegin() const
+    {
+        return m_dense.rbegin();
+    }
+
+    reverse_iterator rend() const
+    {
+        return m_dense.rend();
+    }
+
+    ///------------------------------------
+    /// Page access
+    ///------------------------------------
+
+    std::size_t page_count() const
+    {
+        return m_pages.size();
+    }
+
+    std::size_t allocated_page_count() const
+    {
+        std::size_t count = 0;
+        for (auto pg : m_pages)
+        {
+            if (pg != nullptr)
+                count++;
+        }
+        return count;
+    }
+
+    // the bytes used by the page table, the allocated pages and the dense array
+    std::size_t memory_usage() const
+    {
+        return m_pages.size() * sizeof(page*) + allocated_page_count() * sizeof(page) + m_dense.capacity() * sizeof(std::size_t);
+    }
+}; // paged unordered sparse set
+
+typedef basic_paged_unordered_sparse_set<> paged_unordered_sparse_set;
+
+///
+/// Sparse map: a map from the integers in [0; size-1] to values of type T, built on the unordered sparse set.
+/// The values are kept in a dense array in step with the dense array of keys: value k belongs to key k, so that
+/// keys() and values() can be scanned as contiguous arrays (for example by SIMD loops), and a lookup costs one access
+/// to the sparse array. Erasing moves the last key and value into the hole (swap and pop), so the order is not kept.
+/// Pointers to values are invalidated by insertions and erasures.
+///
+template <class T, class Allocator = std::allocator<std::size_t> >
+class basic_sparse_map
+{
+    typedef basic_unordered_sparse_set<Allocator> key_set;
+    typedef std::vector<T, typename std::allocator_traits<Allocator>::template rebind_alloc<T> > value_sequence;
+
+    key_set m_keys;
+    value_sequence m_values;
+
+    std::size_t index_of(const std::size_t* slot) const
+    {
+        return static_cast<std::size_t>(slot - m_keys.m_dense.data());
+    }
+
+public:
+    typedef std::size_t key_type;
+    typedef T mapped_type;
+    typedef std::size_t size_type;
+    typedef Allocator allocator_type;
+
+    basic_sparse_map(std::size_t size, const Allocator& alloc = Allocator())
+        : m_keys(size, alloc), m_values(typename value_sequence::allocator_type(alloc))
+    {
+    }
+
+    basic_sparse_map(const Allocator& alloc = Allocator())
+        : m_keys(alloc), m_values(typename value_sequence::allocator_type(alloc))
+    {
+    }
+
+    // the keys of a copy point into the copy's own dense array
+    basic_sparse_map(const basic_sparse_map& m)
+        : m_keys(m.size(), m.m_keys.m_dense.get_allocator()), m_values(m.m_values)
+    {
+        for (auto k : m.m_keys)
+        {
+            m_keys.insert(k);
+        }
+    }
+
+    basic_sparse_map(basic_sparse_map&&) = default;
+
+    basic_sparse_map& operator=(basic_sparse_map m)
+    {
+        swap(m);
+        return *this;
+    }
+
+    void swap(basic_sparse_map& m)
+    {
+        m_keys.swap(m.m_keys);
+        m_values.swap(m.m_values);
+    }
+
+    void resize(std::size_t size)
+    {
+        m_keys.resize(size);
+        m_values.clear();
+    }
+
+    bool test(std::size_t key) const
+    {
+        return m_keys.test(key);
+    }
+
+    // nullptr if the key is not present
+    T* find(std::size_t key)
+    {
+        const std::size_t* slot = m_keys.m_sparse[key];
+        return slot != nullptr ? &m_values[index_of(slot)] : nullptr;
+    }
+
+    const T* find(std::size_t key) const
+    {
+        const std::size_t* slot = m_keys.m_sparse[key];
+        return slot != nullptr ? &m_values[index_of(slot)] : nullptr;
+    }
+
+    T& at(std::size_t key)
+    {
+        T* v = key < size() ? find(key) : nullptr;
+        if (v == nullptr)
+            throw std::out_of_range("sparse_map::at: the key is not present");
+        return *v;
+    }
+
+    const T& at(std::size_t key) const
+    {
+        const T* v = key < size() ? find(key) : nullptr;
+        if (v == nullptr)
+            throw std::out_of_range("sparse_map::at: the key is not present");
+        return *v;
+    }
+
+    // constructs the value from args if the key is not present; returns the value and whether it was inserted
+    template <class... Args>
+    std::pair<T*, bool> try_emplace(std::size_t key, Args&&... args)
+    {
+        T* v = find(key);
+        if (v != nullptr)
+            return std::pair<T*, bool>(v, false);
+
+        m_values.emplace_back(std::forward<Args>(args)...); // first, so that a throwing constructor leaves the map unchanged
+        m_keys.insert(key);
+        return std::pair<T*, bool>(&m_values.back(), true);
+    }
+
+    T& operator[](std::size_t key)
+    {
+        return *try_emplace(key).first;
+    }
+
+    // swap and pop: the last key and value are moved into the place of the erased ones
+    bool erase(std::size_t key)
+    {
+        const std::size_t* slot = m_keys.m_sparse[key];
+        if (slot == nullptr)
+            return false;
+
+        std::size_t index = index_of(slot);
+        if (index + 1 != m_values.size())
+            m_values[index] = std::move(m_values.back());
+        m_values.pop_back();
+        m_keys.erase(key);
+        return true;
+    }
+
+    void clear()
+    {
+        m_keys.clear();
+        m_values.clear();
+    }
+
+    std::size_t size() const
+    {
+        return m_keys.size();
+    }
+
+    std::size_t count() const
+    {
+        return m_values.size();
+    }
+
+    bool empty() const
+    {
+        return m_values.empty();
+    }
+
+    ///------------------------------------
+    /// Dense arrays: key k and value k form a pair, for k in [0; count()-1]
+    ///------------------------------------
+
+    const std::size_t* key_data() const
+    {
+        return m_keys.m_dense.data();
+    }
+
+    T* value_data()
+    {
+        return m_values.data();
+    }
+
+    const T* value_data() const
+    {
+        return m_values.data();
+    }
+
+    bits::iterator_range<const std::size_t*> keys() const
+    {
+        return bits::iterator_range<const std::size_t*>(key_data(), key_data() + count());
+    }
+
+    bits::iterator_range<T*> values()
+    {
+        return bits::iterator_range<T*>(value_data(), value_data() + count());
+    }
+
+    bits::iterator_range<const T*> values() const
+    {
+        return bits::iterator_range<const T*>(value_data(), value_data() + count());
+    }
+};
+
+template <class T>
+using sparse_map = basic_sparse_map<T>;
+
+///
+/// Handle set: a sparse set that allocates its own IDs and recycles them safely. A handle packs the index of an ID
+/// (low 32 bits) with the version of the index (high 32 bits); the version is bumped when the ID is erased, so that
+/// a stale handle held elsewhere no longer tests as present once its index is reused. The version is stored inline
+/// in the sparse array, next to the position in the dense array, so test() costs one access. The free indices form
+/// a list threaded through the sparse array: insert() pops the most recently freed index, or appends a new one,
+/// in O(1) without searching. Versions wrap around after 2^32 reuses of the same index.
+///
+template <class Allocator = std::allocator<std::size_t> >
+class basic_handle_set
+{
+public:
+    typedef std::uint64_t handle_type;
+
+private:
+    struct slot
+    {
+        std::uint32_t version;
+        std::uint32_t link;    // the position in the dense array, or free_bit and the next free index
+    };
+
+    static constexpr std::uint32_t free_bit = 0x80000000u;
+    static constexpr std::uint32_t no_index = 0x7FFFFFFFu;
+
+    typedef std::vector<slot, typename std::allocator_traits<Allocator>::template rebind_alloc<slot> > direct_access_sequence;
+    typedef std::vector<handle_type, typename std::allocator_traits<Allocator>::template rebind_alloc<handle_type> > iteration_sequence;
+
+    direct_access_sequence m_sparse;
+    iteration_sequence m_dense;
+    std::uint32_t m_free;          // the first free index, or no_index
+
+public:
+    typedef handle_type value_type;
+    typedef std::size_t size_type;
+    typedef Allocator allocator_type;
+    typedef typename iteration_sequence::const_iterator iterator;
+    typedef iterator const_iterator;
+
+    // the largest number of indices
+    static constexpr std::size_t max_size = no_index;
+
+    static handle_type make_handle(std::uint32_t index, std::uint32_t version)
+    {
+        return (static_cast<handle_type>(version) << 32) | index;
+    }
+
+    static std::uint32_t index_of(handle_type h)
+    {
+        return static_cast<std::uint32_t>(h);
+    }
+
+    static std::uint32_t version_of(handle_type h)
+    {
+        return static_cast<std::uint32_t>(h >> 32);
+    }
+
+    // capacity: the number of indices to reserve space for
+    basic_handle_set(std::size_t capacity, const Allocator& alloc = Allocator())
+        : m_sparse(typename direct_access_sequence::allocator_type(alloc)),
+        m_dense(typename iteration_sequence::allocator_type(alloc)), m_free(no_index)
+    {
+        reserve(capacity);
+    }
+
+    basic_handle_set(const Allocator& alloc = Allocator())
+        : m_sparse(typename direct_access_sequence::allocator_type(alloc)),
+        m_dense(typename iteration_sequence::allocator_type(alloc)), m_free(no_index)
+    {
+    }
+
+    void reserve(std::size_t capacity)
+    {
+        m_sparse.reserve(capacity);
+        m_dense.reserve(capacity);
+    }
+
+    void swap(basic_handle_set& s)
+    {
+        m_sparse.swap(s.m_sparse);
+        m_dense.swap(s.m_dense);
+        std::swap(m_free, s.m_free);
+    }
+
+    // allocates an ID: a recycled index with its new version, or a new index with version 0
+    handle_type insert()
+    {
+        std::uint32_t index = m_free;
+        if (index != no_index)
+        {
+            m_free = m_sparse[index].link & ~free_bit;
+        }
+        else
+        {
+            if (m_sparse.size() >= max_size)
+                throw std::length_error("handle_set::insert: no more indices");
+            index = static_cast<std::uint32_t>(m_sparse.size());
+            m_sparse.push_back(slot{ 0, 0 });
+        }
+
+        slot& s = m_sparse[index];
+        s.link = static_cast<std::uint32_t>(m_dense.size());
+        handle_type h = make_handle(index, s.version);
+        m_dense.push_back(h);
+        return h;
+    }
+
+    bool test(handle_type h) const
+    {
+        std::uint32_t index = index_of(h);
+        if (index >= m_sparse.size())
+            return false;
+        const slot& s = m_sparse[index];
+        return s.version == version_of(h) && (s.link & free_bit) == 0;
+    }
+
+    // returns false if the handle is stale (or was never allocated)
+    bool erase(handle_type h)
+    {
+        if (!test(h))
+            return false;
+
+        std::uint32_t index = index_of(h);
+        slot& s = m_sparse[index];
+        handle_type last = m_dense.back();
+        m_dense[s.link] = last;
+        m_sparse[index_of(last)].link = s.link;
+        m_dense.pop_back();
+
+        s.version++;
+        s.link = free_bit | m_free;
+        m_free = index;
+        return true;
+    }
+
+    // erases every ID: all the handles become stale
+    void clear()
+    {
+        for (auto h : m_dense)
+        {
+            slot& s = m_sparse[index_of(h)];
+            s.version++;
+            s.link = free_bit | m_free;
+            m_free = index_of(h);
+        }
+        m_dense.clear();
+    }
+
+    // the number of indices allocated so far, live or free
+    std::size_t size() const
+    {
+        return m_sparse.size();
+    }
+
+    // the number of live IDs
+    std::size_t count() const
+    {
+        return m_dense.size();
+    }
+
+    bool empty() const
+    {
+        return m_dense.empty();
+    }
+
+    // the live handles, in no particular order
+    iterator begin() const
+    {
+        return m_dense.begin();
+    }
+
+    iterator end() const
+    {
+        return m_dense.end();
+    }
+
+    const handle_type* data() const
+    {
+        return m_dense.data();
+    }
+};
+
+typedef basic_handle_set<> handle_set;
+
+/// 
+/// The bounded set is very close to boost::dynamic_bitset
+/// It performs practically with the same speed
+/// In terms of functinality, it has different member functions (which are similar to those in std::set) and provides an iterator
+/// The speed is similar to that of the sparse set, but the repeated iterations over the same set of values are slower.
+/// It also uses less memory than sparse set: there is no memory allocation for a vector of values, which is need for the sparse set iterator
+/// With Stats = operation_stats the set counts its operations and the words scanned by count(), empty() and its iterators (see stats()).
+/// Bit arrays of up to InlineWords words (two cache lines by default: 1024 values) are kept in the set itself, so small sets
+/// make no heap allocations.
+///
+template <class Allocator = std::allocator<std::size_t>, class Stats = no_stats, std::size_t InlineWords = 16>
+class basic_bounded_set : private Stats
+{
+private:
+    static constexpr std::size_t EmptyIndex = static_cast<std::size_t>(-1);
+    typedef std::size_t base_type;
+    static constexpr unsigned unsigned_bits = std::numeric_limits<base_type>::digits;
+    static constexpr unsigned unsigned_bits_log2 = (unsigned_bits == 64 ? 6 : unsigned_bits == 32 ? 5 : unsigned_bits == 16 ? 4 : 3);
+    static constexpr unsigned unsigned_bits_log2_mask = 0xFFFFFFFF >> (32 - unsigned_bits_log2);
+    static constexpr base_type one_bit = 1;
+
+    typedef typename std::allocator_traits<Allocator>::template rebind_alloc<base_type> word_allocator;
+    typedef bits::small_vector<base_type, InlineWords, word_allocator> bit_array_type;
+
+    unsigned m_size;
+    bit_array_type m_bit_array;
+
+public:
+    typedef std::size_t value_type;
+    typedef std::size_t key_type;
+    typedef std::size_t size_type;
+
+    typedef Allocator allocator_type;
+    typedef Stats stats_type;
+    typedef base_type word_type;
+    static constexpr unsigned word_bits = unsigned_bits;
+
+    basic_bounded_set(std::size_t size, const Allocator& alloc = Allocator()) :m_size(size),
+        m_bit_array((m_size + unsigned_bits - 1) / unsigned_bits, base_type(0), word_allocator(alloc))
+    {
+    }
+
+    basic_bounded_set(const Allocator& alloc = Allocator()) :m_size(0),
+        m_bit_array(word_allocator(alloc))
+    {
+    }
+
+    void swap(basic_bounded_set& s)
+    {
+        m_bit_array.swap(s.m_bit_array);
+        std::swap(m_size, s.m_size);
+    }
+
+    void resize(std::size_t size)
+    {
+        m_size = size;
+        m_bit_array.resize((m_size + unsigned_bits - 1) / unsigned_bits);
+        if (m_size % unsigned_bits != 0) // the elements past a smaller size are gone
+            m_bit_array.back() &= (one_bit << (m_size % unsigned_bits)) - 1;
+    }
+
+    bool insert(std::size_t i)
+    {        
+        base_type& v = m_bit_array[i >> unsigned_bits_log2];
+        base_type x = v;
+        v |= (one_bit << (i & unsigned_bits_log2_mask));
+        this->on_insert(x != v);
+        return x != v;                
+    }
+
+    void erase(std::size_t i)
+    {
+        m_bit_array[i >> unsigned_bits_log2] &= ~(one_bit << (i & unsigned_bits_log2_mask));        
+        this->on_erase();
+    }
+
+    bool test(std::size_t i) const
+    {              
+        return ((m_bit_array[i >> unsigned_bits_log2] >> (i & unsigned_bits_log2_mask)) & 1) != 0;
+    }
+
+    ///
+    /// Tests n keys at once (see bits::test_batch): bit j of out_mask, which has (n + 63) / 64 words, is set
+    /// if keys[j] is present. Returns the number of keys present. Every key must be less than size().
+    /// The misses of the whole batch overlap, and 32-bit keys are tested with gathers when AVX2 or AVX-512 is enabled.
+    ///
+    std::size_t test_batch(const std::uint32_t* keys, std::size_t n, std::uint64_t* out_mask) const
+    {
+        return bits::test_batch(m_bit_array.data(), keys, n, out_mask);
+    }
+
+    std::size_t test_batch(const std::uint64_t* keys, std::size_t n, std::uint64_t* out_mask) const
+    {
+        return bits::test_batch(m_bit_array.data(), keys, n, out_mask);
+    }
+
+    struct iterator : private bits::stats_handle<Stats>
+    {
+        friend basic_bounded_set;
+        typedef std::forward_iterator_tag
+            iterator_category;
+        typedef unsigned value_type;
+        typedef std::ptrdiff_t
+            difference_type;
+
+    private:
+        bool test() const
+        {
+            return ((m_bit_array[m_slot_index] >> m_bit_index) & 1) != 0;
+        }        
+
+        bool next()
+        {
+            m_current_slot >>= 1;
+
+            if (m_current_slot == 0)
+            {
+                m_bit_index = 0;
+                ++m_slot_index;
+
+                std::size_t first_slot = m_slot_index;
+                while (m_slot_index < m_bit_array_size && (m_current_slot = m_bit_array[m_slot_index]) == 0)
+                {
+                    ++m_slot_index;
+                }
+                this->on_iteration_scan(m_slot_index - first_slot + (m_slot_index < m_bit_array_size ? 1 : 0));
+
+                if (m_current_slot == 0)
+                {
+                    m_slot_index = EmptyIndex;
+                    m_bit_index = 0;
+                    m_current_slot = 0;
+                    return false;
+                }
+            }
+            else
+            {
+                ++m_bit_index;
+                if (m_slot_index == m_bit_array_size - 1 && m_bit_index > m_last_bit)
+                {
+                    m_slot_index = EmptyIndex;
+                    m_bit_index = 0;
+                    m_current_slot = 0;
+                    return false;
+                }
+            }            
+
+            unsigned shift = bits::lsb(m_current_slot);
+            m_current_slot >>= shift;
+            m_bit_index += shift;
+
+            return true;
+        }
+
+        iterator(unsigned size, const bit_array_type&  bit_array, std::size_t pos, const Stats* stats)
+            : bits::stats_handle<Stats>(stats), m_size(size), m_bit_array_size(bit_array.size()), m_bit_array(size ? &bit_array[0] : nullptr),
+            m_slot_index(pos >> unsigned_bits_log2), m_current_slot(0), m_bit_index(pos & unsigned_bits_log2_mask),
+            m_last_bit((size - 1) &  unsigned_bits_log2_mask)
+        {
+            if (pos < m_size)
+            {
+                m_current_slot = m_bit_array[m_slot_index] >> m_bit_index;
+                this->on_iteration_scan(1);
+            }
+
+            if (!test())
+            {
+                next();
+            }
+        }
+
+    public:
+
+        iterator(unsigned size, const bit_array_type&  bit_array, const Stats* stats = nullptr)
+            : bits::stats_handle<Stats>(stats), m_size(size), m_bit_array_size(bit_array.size()), m_bit_array(size ? &bit_array[0] : nullptr), m_slot_index(0), m_current_slot(0), m_bit_index(0),
+            m_last_bit((size - 1) &  unsigned_bits_log2_mask)
+        {
+            if (m_size != 0)
+            {
+                m_current_slot = m_bit_array[0];
+                this->on_iteration_scan(1);
+            }
+
+            if (m_size == 0)
+            {
+                m_slot_index = EmptyIndex; // a set of size 0 begins at its end
+            }
+            else if (!test())
+            {
+                next();
+            }
+        }
+
+        iterator() // empty
+            : m_size(0), m_bit_array(nullptr), m_slot_index(EmptyIndex), m_current_slot(0), m_bit_index(0), m_last_bit(0)
+        {}
+
+        unsigned operator*() const
+        {
+            return (m_slot_index << unsigned_bits_log2) + m_bit_index;
+        }
+
+        iterator& operator++()
+        {
+            next();
+            return *this;
+        }
+
+        iterator operator++(int)
+        {
+            iterator tmp(*this);
+            ++*this;
+            return tmp;
+        }
+
+        bool operator==(const iterator& y) const
+        {
+            return (m_slot_index == y.m_slot_index) && (m_bit_index == y.m_bit_index);
+        }
+
+        bool operator!=(const iterator& y) const
+        {
+            return (m_slot_index != y.m_slot_index) || (m_bit_index != y.m_bit_index);
+        }
+
+    private:
+        unsigned m_size;
+        std::size_t m_bit_array_size;
+        const base_type* m_bit_array;
+        std::size_t m_slot_index;
+        base_type m_current_slot;
+        unsigned m_bit_index;
+        unsigned m_last_bit;
+    };
+
+    typedef iterator const_iterator;
+
+    iterator begin() const
+    {
+        return iterator(m_size, m_bit_array, this);
+    }
+
+    iterator end() const
+    {
+        return iterator();
+    }
+
+    iterator find(unsigned i) const
+    {
+        if (test(i))
+        {
+            return iterator(m_size, m_bit_array, i, this);
+        }
+        return iterator();
+    }
+
+    iterator lower_bound(std::size_t i) const
+    {
+        return iterator(m_size, m_bit_array, i, this);        
+    }
+
+    iterator upper_bound(std::size_t i) const
+    {
+        if (i + 1 >= m_size)
+            return iterator();        
+        return iterator(m_size, m_bit_array, i+1, this);
+    }
+
+    void erase(const iterator& it)
+    {
+        erase(*it);
+    }
+
+    bool empty() const
+    {
+        std::size_t scanned = 0;
+        for (auto x : m_bit_array)
+        {
+            scanned++;
+            if (x != 0)
+            {
+                this->on_empty_scan(scanned);
+                return false;
+            }
+        }
+        this->on_empty_scan(scanned);
+        return true;
+    }
+
+    void clear()
+    {
+        std::fill(m_bit_array.begin(), m_bit_array.end(), 0);
+    }
+
+    std::size_t size() const
+    {
+        return m_size;
+    }
+
+    std::size_t count() const
+    {
+        this->on_count_scan(m_bit_array.size());
+        std::size_t count = 0;
+        for (auto x : m_bit_array)
+        {
+            count += bits::count_bits(x);
+        }
+        return count;
+    }
+
+    ///------------------------------------
+    /// Runs: maximal intervals [first, last) of consecutive elements
+    ///------------------------------------
+
+    typedef bits::run run_type;
+    typedef bits::run_iterator<word_type> run_iterator;
+    typedef bits::iterator_range<run_iterator> runs_type;
+
+    // the runs in increasing order, read from the words; the range is invalidated by any modification
+    runs_type runs() const
+    {
+        this->on_iteration_scan(m_bit_array.size());
+        return runs_type(run_iterator(m_bit_array.data(), m_bit_array.size(), m_size), run_iterator());
+    }
+
+    // calls f(first, last) for every run, in increasing order
+    template <class F>
+    void for_each_run(F f) const
+    {
+        for (const run_type& r : runs())
+        {
+            f(r.first, r.last);
+        }
+    }
+
+    // inserts the elements of [first, last), a word at a time
+    void insert_run(std::size_t first, std::size_t last)
+    {
+        last = std::min(last, std::size_t(m_size));
+        if (first >= last)
+            return;
+        bits::fill_bits(m_bit_array.data(), first, last, true);
+    }
+
+    // erases the elements of [first, last), a word at a time
+    void erase_run(std::size_t first, std::size_t last)
+    {
+        last = std::min(last, std::size_t(m_size));
+        if (first >= last)
+            return;
+        bits::fill_bits(m_bit_array.data(), first, last, false);
+    }
+
+    // inserts the runs of [first, last), a sequence of run_type or of anything else with first and last members
+    template <class RunIterator>
+    void insert_runs(RunIterator first, RunIterator last)
+    {
+        for (; first != last; ++first)
+        {
+            insert_run(first->first, first->last);
+        }
+    }
+
+    ///------------------------------------
+    /// Shifts, as when a window of values moves
+    ///------------------------------------
+
+    // erases the elements less than n and moves the others down by n, a word at a time
+    void shift_down(std::size_t n)
+    {
+        if (n >= m_size)
+            std::fill(m_bit_array.begin(), m_bit_array.end(), base_type(0));
+        else if (n != 0)
+            bits::shift_words_down(m_bit_array.data(), m_bit_array.size(), n);
+    }
+
+    // erases the elements not less than size() - n and moves the others up by n, a word at a time
+    void shift_up(std::size_t n)
+    {
+        if (n >= m_size)
+            std::fill(m_bit_array.begin(), m_bit_array.end(), base_type(0));
+        else if (n != 0)
+            bits::shift_words_up(m_bit_array.data(), m_size, n);
+    }
+
+    ///------------------------------------
+    /// The complement: the values of [0, size()) that are absent
+    ///------------------------------------
+
+    typedef bits::complement_iterator<word_type> complement_iterator;
+    typedef bits::iterator_range<complement_iterator> complement_type;
+
+    // the absent values in increasing order, read from the inverted words; the range is invalidated by any modification
+    complement_type complement() const
+    {
+        this->on_iteration_scan(m_bit_array.size());
+        return complement_type(complement_iterator(m_bit_array.data(), m_size), complement_iterator());
+    }
+
+    // calls f(x) for every absent value x, in increasing order
+    template <class F>
+    void for_each_absent(F f) const
+    {
+        for (auto x : complement())
+        {
+            f(x);
+        }
+    }
+
+    // the smallest absent value not less than from, or size() if there is none, as when allocating a free slot;
+    // the words are read from the one holding from, and a full word costs a single comparison
+    std::size_t find_first_absent(std::size_t from = 0) const
+    {
+        if (from >= m_size)
+            return m_size;
+        return std::min(std::size_t(m_size), bits::next_zero(m_bit_array.data(), m_bit_array.size(), from));
+    }
+
+    ///------------------------------------
+    /// Comparisons by content, whatever the sizes of the universes (Set is a bounded set or a sparse set)
+    ///------------------------------------
+
+    // true if s has the same elements; compares the words, stopping at the first block that differs
+    template <class Set>
+    bool equals(const Set& s) const
+    {
+        return bits::equal_words(m_bit_array.data(), m_bit_array.size(), s.words(), s.word_count());
+    }
+
+    // true if every element is in s; stops at the first block of words with an element outside s
+    template <class Set>
+    bool is_subset_of(const Set& s) const
+    {
+        return bits::subset_words(m_bit_array.data(), m_bit_array.size(), s.words(), s.word_count());
+    }
+
+    // true if s has an element in common with this set; stops at the first block of words where it does
+    template <class Set>
+    bool intersects(const Set& s) const
+    {
+        return bits::intersect_words(m_bit_array.data(), m_bit_array.size(), s.words(), s.word_count());
+    }
+
+    ///
+    /// A 64-bit hash of the elements, computed on the words in O(size() / 64): sets with the same elements have the same
+    /// hash whatever their universes. hashed_set (sparse_set_hashed.h) keeps it up to date instead of computing it.
+    ///
+    std::uint64_t hash() const
+    {
+        return bits::hash_words(m_bit_array.data(), m_bit_array.size());
+    }
+
+    ///------------------------------------
+    /// Word access (used by serialization and bulk operations)
+    ///------------------------------------
+
+    std::size_t word_count() const
+    {
+        return m_bit_array.size();
+    }
+
+    const word_type* words() const
+    {
+        return m_bit_array.data();
+    }
+
+    // the bits beyond size() in the last word must be zero
+    void assign_word(std::size_t k, word_type w)
+    {
+        m_bit_array[k] = w;
+    }
+
+    ///------------------------------------
+    /// Operation statistics (all zero unless Stats = operation_stats)
+    ///------------------------------------
+
+    operation_counts stats() const
+    {
+        return Stats::snapshot();
+    }
+
+    void reset_stats()
+    {
+        Stats::reset();
+    }
+}; // bounded set
+
+typedef basic_bounded_set<> bounded_set;
+
+// equality by content: sets over different universes are equal if they have the same elements
+template <class Allocator1, class Stats1, std::size_t InlineWords1, class Allocator2, class Stats2, std::size_t InlineWords2>
+bool operator==(const basic_bounded_set<Allocator1, Stats1, InlineWords1>& a, const basic_bounded_set<Allocator2, Stats2, InlineWords2>& b)
+{
+    return a.equals(b);
+}
+
+template <class Allocator1, class Stats1, std::size_t InlineWords1, class Allocator2, class Stats2, std::size_t InlineWords2>
+bool operator!=(const basic_bounded_set<Allocator1, Stats1, InlineWords1>& a, const basic_bounded_set<Allocator2, Stats2, InlineWords2>& b)
+{
+    return !a.equals(b);
+}
+
+namespace std
+{
+    template <class Allocator, class Stats, std::size_t InlineWords>
+    struct hash<basic_bounded_set<Allocator, Stats, InlineWords> >
+    {
+        std::size_t operator()(const basic_bounded_set<Allocator, Stats, InlineWords>& s) const
+        {
+            return static_cast<std::size_t>(s.hash());
+        }
+    };
+} // std
+
+namespace bits
+{
+    ///
+    /// Forward iterator over the elements of a set whose bit array is split into pages.
+    /// PagedSet provides page_count() and page_words(p), which returns nullptr for a page with no elements;
+    /// such pages are skipped without looking at their words.
+    ///
+    template <class PagedSet>
+    class page_iterator
+    {
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef std::size_t value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const std::size_t* pointer;
+        typedef const std::size_t& reference;
+
+    private:
+        typedef typename PagedSet::word_type word_type;
+        static constexpr std::size_t words_per_page = PagedSet::words_per_page;
+        static constexpr unsigned word_bits = PagedSet::word_bits;
+
+        const PagedSet* m_set;
+        std::size_t m_page_index;
+        const word_type* m_words;
+        std::size_t m_word_index;
+        word_type m_current;
+        std::size_t m_value;
+
+        void next()
+        {
+            for (;;)
+            {
+                if (m_current != 0)
+                {
+                    unsigned p = lsb(m_current);
+                    m_current &= m_current - 1;
+                    m_value = (m_page_index * words_per_page + m_word_index) * word_bits + p;
+                    return;
+                }
+
+                if (m_words != nullptr && ++m_word_index < words_per_page)
+                {
+                    m_current = m_words[m_word_index];
+                    continue;
+                }
+
+                do
+                {
+                    if (++m_page_index >= m_set->page_count())
+                    {
+                        m_set = nullptr;
+                        m_value = 0;
+                        return;
+                    }
+                    m_words = m_set->page_words(m_page_index);
+                } while (m_words == nullptr);
+
+                m_word_index = 0;
+                m_current = m_words[0];
+            }
+        }
+
+    public:
+        // the first element >= pos
+        page_iterator(const PagedSet& s, std::size_t pos)
+            : m_set(&s), m_page_index(pos / (words_per_page * word_bits)), m_words(nullptr),
+            m_word_index((pos / word_bits) % words_per_page), m_current(0), m_value(0)
+        {
+            if (pos >= s.size())
+            {
+                m_set = nullptr;
+                return;
+            }
+
+            m_words = s.page_words(m_page_index);
+            if (m_words != nullptr)
+            {
+                unsigned bit = pos % word_bits;
+                m_current = (m_words[m_word_index] >> bit) << bit;
+            }
+            next();
+        }
+
+        page_iterator() // end
+            : m_set(nullptr), m_page_index(0), m_words(nullptr), m_word_index(0), m_current(0), m_value(0)
+        {
+        }
+
+        const std::size_t& operator*() const
+        {
+            return m_value;
+        }
+
+        page_iterator& operator++()
+        {
+            next();
+            return *this;
+        }
+
+        page_iterator operator++(int)
+        {
+            page_iterator tmp(*this);
+            next();
+            return tmp;
+        }
+
+        bool operator==(const page_iterator& y) const
+        {
+            return m_set == y.m_set && m_value == y.m_value;
+        }
+
+        bool operator!=(const page_iterator& y) const
+        {
+            return !(*this == y);
+        }
+    };
+} // bits
+
+///
+/// Copy-on-write bounded set. The bit array is split into fixed-size reference counted pages (PageBits bits each):
+/// copying the set, e.g. to take a snapshot, copies only the page pointers, and a modification clones the page it touches
+/// only if that page is still shared with a snapshot. Pages that have never been written to are not allocated.
+/// A snapshot can be read from other threads while the original keeps changing, provided the snapshot itself is taken
+/// under the same lock as the modifications.
+///
+template <std::size_t PageBits = 32768, class Allocator = std::allocator<std::size_t> >
+class basic_cow_bounded_set
+{
+    typedef std::size_t base_type;
+    static constexpr unsigned unsigned_bits = std::numeric_limits<base_type>::digits;
+    static constexpr base_type one_bit = 1;
+
+public:
+    typedef std::size_t value_type;
+    typedef std::size_t key_type;
+    typedef std::size_t size_type;
+    typedef Allocator allocator_type;
+    typedef base_type word_type;
+    static constexpr unsigned word_bits = unsigned_bits;
+    static constexpr std::size_t page_bits = PageBits;
+    static constexpr std::size_t words_per_page = PageBits / unsigned_bits;
+
+    static_assert(PageBits % unsigned_bits == 0, "a page must hold a whole number of words");
+
+    typedef bits::page_iterator<basic_cow_bounded_set> iterator;
+    typedef iterator const_iterator;
+
+private:
+    struct page
+    {
+        base_type words[words_per_page];
+    };
+
+    typedef typename std::allocator_traits<Allocator>::template rebind_alloc<page> page_allocator;
+    typedef std::shared_ptr<page> page_pointer;
+    typedef std::vector<page_pointer, typename std::allocator_traits<Allocator>::template rebind_alloc<page_pointer> > page_table;
+
+    std::size_t m_size;
+    page_table m_pages;
+    Allocator m_allocator;
+
+    static std::size_t page_table_size(std::size_t size)
+    {
+        return (size + PageBits - 1) / PageBits;
+    }
+
+    // the page for writing: allocated if missing, cloned if shared with a copy
+    base_type* writable_page(std::size_t p)
+    {
+        page_pointer& pg = m_pages[p];
+        if (!pg)
+        {
+            pg = std::allocate_shared<page>(page_allocator(m_allocator), page());
+        }
+        else if (pg.use_count() != 1)
+        {
+            pg = std::allocate_shared<page>(page_allocator(m_allocator), *pg);
+        }
+        else
+        {
+            // use_count() is a relaxed load: without this fence the reads of a snapshot that has just released the
+            // page on another thread need not happen before the writes made here in place
+            std::atomic_thread_fence(std::memory_order_acquire);
+        }
+        return pg->words;
+    }
+
+public:
+    basic_cow_bounded_set(std::size_t size, const Allocator& alloc = Allocator())
+        : m_size(size), m_pages(page_table_size(size), page_pointer(), typename page_table::allocator_type(alloc)), m_allocator(alloc)
+    {
+    }
+
+    basic_cow_bounded_set(const Allocator& alloc = Allocator())
+        : m_size(0), m_pages(typename page_table::allocator_type(alloc)), m_allocator(alloc)
+    {
+    }
+
+    // a copy sharing all the pages with this set; O(number of pages)
+    basic_cow_bounded_set snapshot() const
+    {
+        return *this;
+    }
+
+    void swap(basic_cow_bounded_set& s)
+    {
+        m_pages.swap(s.m_pages);
+        std::swap(m_size, s.m_size);
+        std::swap(m_allocator, s.m_allocator);
+    }
+
+    void resize(std::size_t size)
+    {
+        std::size_t old_size = m_size;
+        m_size = size;
+        m_pages.resize(page_table_size(size));
+
+        // drop the elements beyond the new size in the last page
+        if (size < old_size && size % PageBits != 0 && m_pages.back())
+        {
+            base_type* w = writable_page(m_pages.size() - 1);
+            std::size_t first = (size % PageBits) / unsigned_bits;
+            unsigned bit = size % unsigned_bits;
+            if (bit != 0)
+            {
+                w[first] &= (one_bit << bit) - 1;
+                ++first;
+            }
+            std::fill(w + first, w + words_per_page, base_type(0));
+        }
+    }
+
+    bool insert(std::size_t i)
+    {
+        const page_pointer& pg = m_pages[i / PageBits];
+        base_type mask = one_bit << (i % unsigned_bits);
+        if (pg && (pg->words[(i % PageBits) / unsigned_bits] & mask) != 0)
+            return false;
+        writable_page(i / PageBits)[(i % PageBits) / unsigned_bits] |= mask;
+        return true;
+    }
+
+    void erase(std::size_t i)
+    {
+        const page_pointer& pg = m_pages[i / PageBits];
+        base_type mask = one_bit << (i % unsigned_bits);
+        if (!pg || (pg->words[(i % PageBits) / unsigned_bits] & mask) == 0)
+            return;
+        writable_page(i / PageBits)[(i % PageBits) / unsigned_bits] &= ~mask;
+    }
+
+    void erase(const iterator& it)
+    {
+        erase(*it);
+    }
+
+    bool test(std::size_t i) const
+    {
+        const page_pointer& pg = m_pages[i / PageBits];
+        return pg && ((pg->words[(i % PageBits) / unsigned_bits] >> (i % unsigned_bits)) & 1) != 0;
+    }
+
+    bool empty() const
+    {
+        for (auto& pg : m_pages)
+        {
+            if (!pg)
+                continue;
+            for (auto x : pg->words)
+            {
+                if (x != 0)
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    // releases all the pages; the snapshots keep theirs
+    void clear()
+    {
+        std::fill(m_pages.begin(), m_pages.end(), page_pointer());
+    }
+
+    std::size_t size() const
+    {
+        return m_size;
+    }
+
+    std::size_t count() const
+    {
+        std::size_t count = 0;
+        for (auto& pg : m_pages)
+        {
+            if (!pg)
+                continue;
+            for (auto x : pg->words)
+            {
+                count += bits::count_bits(x);
+            }
+        }
+        return count;
+    }
+
+    iterator begin() const
+    {
+        return iterator(*this, 0);
+    }
+
+    iterator end() const
+    {
+        return iterator();
+    }
+
+    iterator find(std::size_t i) const
+    {
+        if (i < m_size && test(i))
+            return iterator(*this, i);
+        return iterator();
+    }
+
+    iterator lower_bound(std::size_t i) const
+    {
+        return iterator(*this, i);
+    }
+
+    iterator upper_bound(std::size_t i) const
+    {
+        return iterator(*this, i + 1);
+    }
+
+    ///------------------------------------
+    /// Page access
+    ///------------------------------------
+
+    std::size_t page_count() const
+    {
+        return m_pages.size();
+    }
+
+    // nullptr if the page has never been written to
+    const word_type* page_words(std::size_t p) const
+    {
+        return m_pages[p] ? m_pages[p]->words : nullptr;
+    }
+
+    // the number of allocated pages that are shared with other copies
+    std::size_t shared_page_count() const
+    {
+        std::size_t count = 0;
+        for (auto& pg : m_pages)
+        {
+            if (pg && pg.use_count() > 1)
+                count++;
+        }
+        return count;
+    }
+}; // copy-on-write bounded set
+
+typedef basic_cow_bounded_set<> cow_bounded_set;
+
+///
+/// Paged bounded set for huge universes with few elements. The bit array is split into pages of PageBits bits,
+/// which are listed in a page table: a page is allocated by the first insertion into it and released when its last
+/// element is erased. The memory is proportional to the number of occupied pages rather than to the universe size,
+/// and iteration, count() and empty() skip missing pages without looking at them.
+/// The universe size is not limited to 32 bits.
+///
+template <std::size_t PageBits = 32768, class Allocator = std::allocator<std::size_t> >
+class basic_paged_bounded_set
+{
+    typedef std::size_t base_type;
+    static constexpr unsigned unsigned_bits = std::numeric_limits<base_type>::digits;
+    static constexpr base_type one_bit = 1;
+
+public:
+    typedef std::size_t value_type;
+    typedef std::size_t key_type;
+    typedef std::size_t size_type;
+    typedef Allocator allocator_type;
+    typedef base_type word_type;
+    static constexpr unsigned word_bits = unsigned_bits;
+    static constexpr std::size_t page_bits = PageBits;
+    static constexpr std::size_t words_per_page = PageBits / unsigned_bits;
+
+    static_assert(PageBits % unsigned_bits == 0, "a page must hold a whole number of words");
+
+    typedef bits::page_iterator<basic_paged_bounded_set> iterator;
+    typedef iterator const_iterator;
+
+private:
+    struct page
+    {
+        base_type words[words_per_page];
+        std::size_t count;
+    };
+
+    typedef typename std::allocator_traits<Allocator>::template rebind_alloc<page> page_allocator;
+    typedef std::allocator_traits<page_allocator> page_traits;
+    typedef std::vector<page*, typename std::allocator_traits<Allocator>::template rebind_alloc<page*> > page_table;
+
+    std::size_t m_size;
+    page_table m_pages;
+    page_allocator m_allocator;
+
+    static std::size_t page_table_size(std::size_t size)
+    {
+        return (size + PageBits - 1) / PageBits;
+    }
+
+    page* allocate_page(const page& value)
+    {
+        page* p = page_traits::allocate(m_allocator, 1);
+        page_traits::construct(m_allocator, p, value);
+        return p;
+    }
+
+    void release_page(page*& p)
+    {
+        if (p == nullptr)
+            return;
+        page_traits::destroy(m_allocator, p);
+        page_traits::deallocate(m_allocator, p, 1);
+        p = nullptr;
+    }
+
+    void release_pages()
+    {
+        for (auto& p : m_pages)
+        {
+            release_page(p);
+        }
+    }
+
+public:
+    basic_paged_bounded_set(std::size_t size, const Allocator& alloc = Allocator())
+        : m_size(size), m_pages(page_table_size(size), nullptr, typename page_table::allocator_type(alloc)), m_allocator(alloc)
+    {
+    }
+
+    basic_paged_bounded_set(const Allocator& alloc = Allocator())
+        : m_size(0), m_pages(typename page_table::allocator_type(alloc)), m_allocator(alloc)
+    {
+    }
+
+    basic_paged_bounded_set(const basic_paged_bounded_set& s)
+        : m_size(s.m_size), m_pages(s.m_pages.size(), nullptr, s.m_pages.get_allocator()),
+        m_allocator(page_traits::select_on_container_copy_construction(s.m_allocator))
+    {
+        for (std::size_t p = 0; p < m_pages.size(); p++)
+        {
+            if (s.m_pages[p] != nullptr)
+                m_pages[p] = allocate_page(*s.m_pages[p]);
+        }
+    }
+
+    basic_paged_bounded_set(basic_paged_bounded_set&& s)
+        : m_size(s.m_size), m_pages(std::move(s.m_pages)), m_allocator(s.m_allocator)
+    {
+        s.m_size = 0;
+        s.m_pages.clear();
+    }
+
+    basic_paged_bounded_set& operator=(basic_paged_bounded_set s)
+    {
+        swap(s);
+        return *this;
+    }
+
+    ~basic_paged_bounded_set()
+    {
+        release_pages();
+    }
+
+    void swap(basic_paged_bounded_set& s)
+    {
+        m_pages.swap(s.m_pages);
+        std::swap(m_size, s.m_size);
+        std::swap(m_allocator, s.m_allocator);
+    }
+
+    void resize(std::size_t size)
+    {
+        std::size_t new_page_count = page_table_size(size);
+        for (std::size_t p = new_page_count; p < m_pages.size(); p++)
+        {
+            release_page(m_pages[p]);
+        }
+        m_pages.resize(new_page_count, nullptr);
+
+        // drop the elements beyond the new size in the last page
+        if (size < m_size && size % PageBits != 0 && m_pages.back() != nullptr)
+        {
+            for (std::size_t i = size, iStop = std::min(m_size, new_page_count * PageBits); i < iStop; i++)
+            {
+                erase(i);
+            }
+        }
+        m_size = size;
+    }
+
+    bool insert(std::size_t i)
+    {
+        page*& pg = m_pages[i / PageBits];
+        if (pg == nullptr)
+        {
+            pg = allocate_page(page());
+        }
+        base_type& v = pg->words[(i % PageBits) / unsigned_bits];
+        base_type x = v;
+        v |= one_bit << (i % unsigned_bits);
+        if (x == v)
+            return false;
+        pg->count++;
+        return true;
+    }
+
+    void erase(std::size_t i)
+    {
+        page*& pg = m_pages[i / PageBits];
+        if (pg == nullptr)
+            return;
+        base_type& v = pg->words[(i % PageBits) / unsigned_bits];
+        base_type x = v;
+        v &= ~(one_bit << (i % unsigned_bits));
+        if (x != v && --pg->count == 0)
+        {
+            release_page(pg);
+        }
+    }
+
+    void erase(const iterator& it)
+    {
+        erase(*it);
+    }
+
+    bool test(std::size_t i) const
+    {
+        const page* pg = m_pages[i / PageBits];
+        return pg != nullptr && ((pg->words[(i % PageBits) / unsigned_bits] >> (i % unsigned_bits)) & 1) != 0;
+    }
+
+    bool empty() const
+    {
+        for (auto pg : m_pages)
+        {
+            if (pg != nullptr)
+                return false;
+        }
+        return true;
+    }
+
+    void clear()
+    {
+        release_pages();
+    }
+
+    std::size_t size() const
+    {
+        return m_size;
+    }
+
+    std::size_t count() const
+    {
+        std::size_t count = 0;
+        for (auto pg : m_pages)
+        {
+            if (pg != nullptr)
+                count += pg->count;
+        }
+        return count;
+    }
+
+    iterator begin() const
+    {
+        return iterator(*this, 0);
+    }
+
+    iterator end() const
+    {
+        return iterator();
+    }
+
+    iterator find(std::size_t i) const
+    {
+        if (i < m_size && test(i))
+            return iterator(*this, i);
+        return iterator();
+    }
+
+    iterator lower_bound(std::size_t i) const
+    {
+        return iterator(*this, i);
+    }
+
+    iterator upper_bound(std::size_t i) const
+    {
+        return iterator(*this, i + 1);
+    }
+
+    ///------------------------------------
+    /// Page access
+    ///------------------------------------
+
+    std::size_t page_count() const
+    {
+        return m_pages.size();
+    }
+
+    // nullptr if the page holds no elements
+    const word_type* page_words(std::size_t p) const
+    {
+        return m_pages[p] != nullptr ? m_pages[p]->words : nullptr;
+    }
+
+    std::size_t allocated_page_count() const
+    {
+        std::size_t count = 0;
+        for (auto pg : m_pages)
+        {
+            if (pg != nullptr)
+                count++;
+        }
+        return count;
+    }
+
+    // the bytes used by the page table and the allocated pages
+    std::size_t memory_usage() const
+    {
+        return m_pages.size() * sizeof(page*) + allocated_page_count() * sizeof(page);
+    }
+}; // paged bounded set
+
+typedef basic_paged_bounded_set<> paged_bounded_set;
+
+///
+/// Adaptive set: a set whose representation follows its density and the mix of operations it sees.
+///   sorted_array    few elements in a large universe (at least min_sorted_size): a sorted vector of values,
+///                   with no memory proportional to the universe size
+///   bitmap          a bit array, scanned word by word like the bounded set
+///   indexed_bitmap  a bit array with a cached sequence of values, like the sparse set, when the set is scanned
+///                   repeatedly between writes
+/// A sorted array becomes a bitmap when it holds more than sorted_limit() elements, or when the writes to it (which
+/// are slower than on a bitmap) have paid for the conversion. Tests never convert it: a bitmap could not return to a
+/// sorted array without writes, so a set that is only read would be left with a bit array as large as the universe.
+/// Each change has a hysteresis band, so that a set close to a threshold does not convert back and forth: a bitmap
+/// returns to a sorted array only below a quarter of sorted_limit() and after as many writes as it has words; the
+/// sequence is cached once the set has been scanned 3 times without a write (or 3 times per write on average) and
+/// dropped below 1.5 scans per write.
+/// Like the sparse set, begin() may change the representation (caching or dropping the sequence), so concurrent readers
+/// need a lock. Iterators are invalidated by any modification, and by begin() when the representation changes.
+///
+template <class Allocator = std::allocator<std::size_t> >
+class basic_adaptive_set
+{
+    typedef std::size_t base_type;
+    static constexpr unsigned unsigned_bits = std::numeric_limits<base_type>::digits;
+    static constexpr base_type one_bit = 1;
+
+    typedef typename std::allocator_traits<Allocator>::template rebind_alloc<base_type> word_allocator;
+    typedef typename std::allocator_traits<Allocator>::template rebind_alloc<std::size_t> sequence_allocator;
+    typedef std::vector<base_type, word_allocator> bit_array_type;
+    typedef std::vector<std::size_t, sequence_allocator> sequence_type;
+
+public:
+    typedef std::size_t value_type;
+    typedef std::size_t key_type;
+    typedef std::size_t size_type;
+    typedef Allocator allocator_type;
+
+    enum representation_type { sorted_array, bitmap, indexed_bitmap };
+
+    static constexpr std::size_t min_sorted_size = 1 << 20; // below that, the bitmap is small enough to be used throughout
+    static constexpr std::size_t max_sorted_count = 4096;
+    static constexpr unsigned cache_scans = 48;   // scans per write, in sixteenths, from which the sequence is cached
+    static constexpr unsigned uncache_scans = 24; // and below which it is dropped
+
+    typedef bits::value_range_iterator<base_type> iterator;
+    typedef iterator const_iterator;
+
+private:
+    std::size_t m_size;
+    std::size_t m_count;
+    mutable representation_type m_representation; // begin() may change the representation
+    mutable sequence_type m_values;               // sorted_array: the elements
+    mutable bit_array_type m_bit_array;           // bitmap, indexed_bitmap
+    mutable sequence_type m_sequence;             // indexed_bitmap: the cached elements
+    mutable bool m_sequence_present;
+    mutable unsigned m_epoch_scans;               // scans since the last write
+    mutable unsigned m_scan_average;              // scans per write, in sixteenths, exponentially averaged
+    mutable std::size_t m_operations;             // since the last conversion: writes
+    mutable std::size_t m_conversions;
+
+    static std::size_t word_count(std::size_t size)
+    {
+        return (size + unsigned_bits - 1) / unsigned_bits;
+    }
+
+    std::size_t sorted_limit() const
+    {
+        if (m_size < min_sorted_size)
+            return 0;
+        return std::min(std::size_t(max_sorted_count), m_size / 64); // a sorted array larger than that takes more memory than the bitmap
+    }
+
+    // the writes to a sorted array that pay for its conversion to a bitmap
+    std::size_t conversion_cost() const
+    {
+        return word_count(m_size) / 4;
+    }
+
+    void drop_sequence() const
+    {
+        if (m_sequence_present)
+        {
+            m_sequence_present = false;
+            m_sequence.clear();
+        }
+    }
+
+    void create_iteration_sequence() const
+    {
+        m_sequence.reserve(m_count);
+        for (std::size_t k = 0; k < m_bit_array.size(); k++)
+        {
+            for (base_type x = m_bit_array[k]; x != 0; x &= x - 1)
+            {
+                m_sequence.push_back(k * unsigned_bits + bits::lsb(x));
+            }
+        }
+        m_sequence_present = true;
+    }
+
+    // called before every modification: closes the current scan epoch (a sequence is only present after a scan)
+    void written()
+    {
+        if (m_epoch_scans != 0)
+        {
+            int scans = static_cast<int>(m_epoch_scans) * 16;
+            int average = static_cast<int>(m_scan_average);
+            m_scan_average = static_cast<unsigned>(average + (scans - average) / 4);
+            m_epoch_scans = 0;
+            drop_sequence();
+        }
+    }
+
+    // called by begin(): chooses between bitmap and indexed_bitmap
+    void scanned() const
+    {
+        if (m_epoch_scans < 64)
+            m_epoch_scans++;
+
+        if (m_representation == bitmap && (m_epoch_scans >= 3 || m_scan_average >= cache_scans))
+        {
+            m_representation = indexed_bitmap;
+            m_conversions++;
+        }
+        else if (m_representation == indexed_bitmap && m_epoch_scans < 3 && m_scan_average < uncache_scans)
+        {
+            m_representation = bitmap;
+            drop_sequence();
+            m_conversions++;
+        }
+    }
+
+    void to_bitmap() const
+    {
+        m_bit_array.assign(word_count(m_size), base_type(0));
+        for (auto x : m_values)
+        {
+            m_bit_array[x / unsigned_bits] |= one_bit << (x % unsigned_bits);
+        }
+        m_values.clear();
+        m_values.shrink_to_fit();
+        m_representation = bitmap;
+        m_operations = 0;
+        m_conversions++;
+    }
+
+    void to_sorted_array()
+    {
+        m_values.clear();
+        m_values.reserve(sorted_limit());
+        for (std::size_t k = 0; k < m_bit_array.size(); k++)
+        {
+            for (base_type x = m_bit_array[k]; x != 0; x &= x - 1)
+            {
+                m_values.push_back(k * unsigned_bits + bits::lsb(x));
+            }
+        }
+        m_bit_array.clear();
+        m_bit_array.shrink_to_fit();
+        drop_sequence();
+        m_sequence.shrink_to_fit();
+        m_representation = sorted_array;
+        m_operations = 0;
+        m_conversions++;
+    }
+
+    iterator sequence_iterator(const sequence_type& s, std::size_t i) const
+    {
+        return iterator(s.data() + (std::lower_bound(s.begin(), s.end(), i) - s.begin()), s.data() + s.size());
+    }
+
+public:
+    basic_adaptive_set(std::size_t size, const Allocator& alloc = Allocator())
+        : m_size(size), m_count(0), m_representation(sorted_array), m_values(sequence_allocator(alloc)),
+        m_bit_array(word_allocator(alloc)), m_sequence(sequence_allocator(alloc)), m_sequence_present(false),
+        m_epoch_scans(0), m_scan_average(0), m_operations(0), m_conversions(0)
+    {
+        if (sorted_limit() == 0)
+            to_bitmap();
+    }
+
+    basic_adaptive_set(const Allocator& alloc = Allocator())
+        : basic_adaptive_set(0, alloc)
+    {
+    }
+
+    void swap(basic_adaptive_set& s)
+    {
+        std::swap(m_size, s.m_size);
+        std::swap(m_count, s.m_count);
+        std::swap(m_representation, s.m_representation);
+        m_values.swap(s.m_values);
+        m_bit_array.swap(s.m_bit_array);
+        m_sequence.swap(s.m_sequence);
+        std::swap(m_sequence_present, s.m_sequence_present);
+        std::swap(m_epoch_scans, s.m_epoch_scans);
+        std::swap(m_scan_average, s.m_scan_average);
+        std::swap(m_operations, s.m_operations);
+        std::swap(m_conversions, s.m_conversions);
+    }
+
+    void resize(std::size_t size)
+    {
+        written();
+        if (m_representation == sorted_array)
+        {
+            m_values.erase(std::lower_bound(m_values.begin(), m_values.end(), size), m_values.end());
+            m_count = m_values.size();
+            m_size = size;
+            if (m_count > sorted_limit())
+                to_bitmap();
+            return;
+        }
+
+        m_bit_array.resize(word_count(size), base_type(0));
+        if (size % unsigned_bits != 0)
+            m_bit_array.back() &= (one_bit << (size % unsigned_bits)) - 1;
+        m_size = size;
+        m_count = 0;
+        for (auto x : m_bit_array)
+        {
+            m_count += bits::count_bits(x);
+        }
+        if (m_count < sorted_limit() / 4)
+            to_sorted_array();
+    }
+
+    bool insert(std::size_t i)
+    {
+        if (m_representation == sorted_array)
+        {
+            auto it = std::lower_bound(m_values.begin(), m_values.end(), i);
+            if (it != m_values.end() && *it == i)
+                return false;
+            written();
+            m_values.insert(it, i);
+            m_count++;
+            if (m_count > sorted_limit() || ++m_operations > conversion_cost())
+                to_bitmap();
+            return true;
+        }
+
+        base_type& v = m_bit_array[i / unsigned_bits];
+        base_type x = v;
+        v |= one_bit << (i % unsigned_bits);
+        if (x == v)
+            return false;
+        written();
+        m_count++;
+        m_operations++;
+        return true;
     }
 
     void erase(std::size_t i)
     {
-        if (m_sparse[i] == nullptr)
+        if (m_representation == sorted_array)
+        {
+            auto it = std::lower_bound(m_values.begin(), m_values.end(), i);
+            if (it == m_values.end() || *it != i)
+                return;
+            written();
+            m_values.erase(it);
+            m_count--;
+            if (++m_operations > conversion_cost())
+                to_bitmap();
             return;
-        std::size_t* v = m_sparse[i];
-        std::size_t p_index = m_dense.back();
-        if (*v != p_index)
+        }
+
+        base_type& v = m_bit_array[i / unsigned_bits];
+        base_type x = v;
+        v &= ~(one_bit << (i % unsigned_bits));
+        if (x == v)
+            return;
+        written();
+        m_count--;
+        if (++m_operations > word_count(m_size) && m_count < sorted_limit() / 4)
+            to_sorted_array();
+    }
+
+    void erase(const iterator& it)
+    {
+        erase(*it);
+    }
+
+    bool test(std::size_t i) const
+    {
+        if (m_representation == sorted_array)
         {
-            *v = p_index;
-            m_sparse[p_index] = v;
+            return std::binary_search(m_values.begin(), m_values.end(), i);
         }
-        m_sparse[i] = nullptr;
-        m_dense.erase(m_dense.end() - 1);
+        return ((m_bit_array[i / unsigned_bits] >> (i % unsigned_bits)) & 1) != 0;
+    }
+
+    bool empty() const
+    {
+        return m_count == 0;
     }
 
     void clear()
     {
-        std::fill(m_sparse.begin(), m_sparse.end(), nullptr);
-        m_dense.clear();
+        written();
+        m_count = 0;
+        m_values.clear();
+        if (m_representation != sorted_array && sorted_limit() != 0)
+        {
+            m_bit_array.clear();
+            m_bit_array.shrink_to_fit();
+            m_representation = sorted_array;
+            m_conversions++;
+        }
+        m_operations = 0;
+        std::fill(m_bit_array.begin(), m_bit_array.end(), base_type(0));
     }
 
     std::size_t size() const
     {
-        return m_sparse.size();
+        return m_size;
     }
 
     std::size_t count() const
     {
-        return m_dense.size();
+        return m_count;
     }
 
-    bool empty() const
+    iterator begin() const
     {
-        return m_dense.empty();
+        scanned();
+        switch (m_representation)
+        {
+        case sorted_array:
+            return iterator(m_values.data(), m_values.data() + m_values.size());
+        case bitmap:
+            return iterator(m_bit_array.data(), 0, m_size);
+        default:
+            if (!m_sequence_present)
+                create_iteration_sequence();
+            return iterator(m_sequence.data(), m_sequence.data() + m_sequence.size());
+        }
+    }
+
+    iterator end() const
+    {
+        return iterator();
+    }
+
+    iterator find(std::size_t i) const
+    {
+        if (i < m_size && test(i))
+            return lower_bound(i);
+        return iterator();
+    }
+
+    iterator lower_bound(std::size_t i) const
+    {
+        if (m_representation == sorted_array)
+            return sequence_iterator(m_values, i);
+        if (m_sequence_present)
+            return sequence_iterator(m_sequence, i);
+        return iterator(m_bit_array.data(), i, m_size);
+    }
+
+    iterator upper_bound(std::size_t i) const
+    {
+        return i + 1 >= m_size ? iterator() : lower_bound(i + 1);
+    }
+
+    ///------------------------------------
+    /// Representation
+    ///------------------------------------
+
+    representation_type representation() const
+    {
+        return m_representation;
+    }
+
+    static const char* representation_name(representation_type r)
+    {
+        return r == sorted_array ? "sorted array" : r == bitmap ? "bitmap" : "indexed bitmap";
+    }
+
+    std::size_t conversion_count() const
+    {
+        return m_conversions;
+    }
+
+    std::size_t memory_usage() const
+    {
+        return (m_values.capacity() + m_sequence.capacity()) * sizeof(std::size_t) + m_bit_array.capacity() * sizeof(base_type);
+    }
+}; // adaptive set
+
+typedef basic_adaptive_set<> adaptive_set;
+
+namespace bits
+{
+    ///------------------------------------
+    /// Bit matrix kernels
+    ///------------------------------------
+
+    // transposes a 64 x 64 bit matrix in place: bit c of a[r] becomes bit r of a[c]
+    inline void transpose64(std::uint64_t* a)
+    {
+        std::uint64_t m = 0x00000000FFFFFFFFull;
+        for (unsigned j = 32; j != 0; j >>= 1, m ^= m << j)
+        {
+            for (unsigned k = 0; k < 64; k = ((k | j) + 1) & ~j)
+            {
+                std::uint64_t t = ((a[k] >> j) ^ a[k | j]) & m;
+                a[k] ^= t << j;
+                a[k | j] ^= t;
+            }
+        }
     }
 
-    iterator begin() const
+    // dst[i] |= src[i] for i in [0, n)
+    inline void or_words(std::uint64_t* dst, const std::uint64_t* src, std::size_t n)
     {
-        return m_dense.begin();
+        std::size_t i = 0;
+#if defined(__AVX2__)
+        for (; i + 4 <= n; i += 4)
+        {
+            __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));
+            __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_or_si256(x, y));
+        }
+#endif
+        for (; i < n; i++)
+        {
+            dst[i] |= src[i];
+        }
     }
 
-    iterator end() const
+    // dst[i] &= src[i] for i in [0, n)
+    inline void and_words(std::uint64_t* dst, const std::uint64_t* src, std::size_t n)
     {
-        return m_dense.end();
+        std::size_t i = 0;
+#if defined(__AVX2__)
+        for (; i + 4 <= n; i += 4)
+        {
+            __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));
+            __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_and_si256(x, y));
+        }
+#endif
+        for (; i < n; i++)
+        {
+            dst[i] &= src[i];
+        }
     }
+} // bits
 
-    reverse_iterator rbegin() const
+///
+/// Set family: set_count() sets over the same universe [0; size-1], stored together as a bit matrix with one row per
+/// set and one column per element. Two layouts are provided, and transpose() converts between them:
+///   row_major     each set is a bit array, as in the bounded set: fast per-set iteration and row operations
+///                 (unions and intersections of whole sets, word by word with SIMD)
+///   column_major  each element has its membership vector of set_count() bits, padded to a power of two words
+///                 (up to 8 words): "which sets contain x" reads one cache line for up to 512 sets instead of one line
+///                 per set. The columns are laid out in blocks of 64 elements, so that transpose() works on 64 x 64 tiles.
+/// Membership vectors and rows are arrays of 64-bit words, bit j of word w standing for set (or element) w * 64 + j.
+///
+template <class Allocator = std::allocator<std::size_t> >
+class basic_set_family
+{
+public:
+    typedef std::uint64_t word_type;
+    typedef std::size_t value_type;
+    typedef std::size_t size_type;
+    typedef Allocator allocator_type;
+    typedef bits::value_range_iterator<word_type> iterator;
+    typedef bits::iterator_range<iterator> row_range;
+
+    enum layout_type { row_major, column_major };
+
+    static constexpr unsigned word_bits = 64;
+
+private:
+    typedef std::vector<word_type, typename std::allocator_traits<Allocator>::template rebind_alloc<word_type> > word_sequence;
+
+    std::size_t m_set_count;
+    std::size_t m_size;
+    std::size_t m_row_words;    // words per row: per set in row_major
+    std::size_t m_vector_words; // words of a membership vector
+    std::size_t m_column_words; // words per column in column_major: m_vector_words padded
+    layout_type m_layout;
+    word_sequence m_words;
+
+    static std::size_t column_words_for(std::size_t vector_words)
     {
-        return m_dense.rbegin();
+        if (vector_words > 8)
+            return vector_words;
+        std::size_t w = 1;
+        while (w < vector_words)
+        {
+            w *= 2;
+        }
+        return w;
     }
 
-    reverse_iterator rend() const
+    std::size_t storage_words(layout_type layout) const
     {
-        return m_dense.rend();
+        return layout == row_major ? m_set_count * m_row_words : m_row_words * word_bits * m_column_words;
     }
 
-    iterator lower_bound(value_type i) const
+    std::size_t word_index(std::size_t set, std::size_t i) const
     {
-        return std::lower_bound(m_dense.begin(), m_dense.end(), i);
+        return m_layout == row_major ? set * m_row_words + i / word_bits : i * m_column_words + set / word_bits;
     }
 
-    iterator upper_bound(value_type i) const
+    word_type bit(std::size_t set, std::size_t i) const
     {
-        return std::upper_bound(m_dense.begin(), m_dense.end(), i);
+        return word_type(1) << (m_layout == row_major ? i % word_bits : set % word_bits);
     }
-};
-
-/// 
-/// The bounded set is very close to boost::dynamic_bitset
-/// It performs practically with the same speed
-/// In terms of functinality, it has different member functions (which are similar to those in std::set) and provides an iterator
-/// The speed is similar to that of the sparse set, but the repeated iterations over the same set of values are slower.
-/// It also uses less memory than sparse set: there is no memory allocation for a vector of values, which is need for the sparse set iterator
-///
-class bounded_set
-{
-private:
-    static constexpr std::size_t EmptyIndex = static_cast<std::size_t>(-1);
-    typedef std::size_t base_type;
-    static constexpr unsigned unsigned_bits = std::numeric_limits<base_type>::digits;
-    static constexpr unsigned unsigned_bits_log2 = (unsigned_bits == 64 ? 6 : unsigned_bits == 32 ? 5 : unsigned_bits == 16 ? 4 : 3);
-    static constexpr unsigned unsigned_bits_log2_mask = 0xFFFFFFFF >> (32 - unsigned_bits_log2);
-    static constexpr base_type one_bit = 1;
-
-    unsigned m_size;
-    std::vector<base_type> m_bit_array;
 
 public:
-    typedef std::size_t value_type;
-    typedef std::size_t key_type;
-    typedef std::size_t size_type;
-
-    bounded_set(std::size_t size) :m_size(size),
-        m_bit_array((m_size + unsigned_bits - 1) / unsigned_bits)
+    basic_set_family(std::size_t set_count, std::size_t size, layout_type layout = row_major, const Allocator& alloc = Allocator())
+        : m_set_count(set_count), m_size(size), m_row_words((size + word_bits - 1) / word_bits),
+        m_vector_words((set_count + word_bits - 1) / word_bits), m_column_words(column_words_for(m_vector_words)),
+        m_layout(layout), m_words(typename word_sequence::allocator_type(alloc))
     {
+        m_words.resize(storage_words(layout));
     }
 
-    bounded_set() :m_size(0),
-        m_bit_array(0)
+    basic_set_family(const Allocator& alloc = Allocator())
+        : m_set_count(0), m_size(0), m_row_words(0), m_vector_words(0), m_column_words(1), m_layout(row_major),
+        m_words(typename word_sequence::allocator_type(alloc))
     {
     }
 
-    void swap(bounded_set& s)
+    void swap(basic_set_family& s)
     {
-        m_bit_array.swap(s.m_bit_array);
+        std::swap(m_set_count, s.m_set_count);
         std::swap(m_size, s.m_size);
+        std::swap(m_row_words, s.m_row_words);
+        std::swap(m_vector_words, s.m_vector_words);
+        std::swap(m_column_words, s.m_column_words);
+        std::swap(m_layout, s.m_layout);
+        m_words.swap(s.m_words);
     }
 
-    void resize(std::size_t size)
+    bool insert(std::size_t set, std::size_t i)
     {
-        m_size = size;
-        m_bit_array.resize((m_size + unsigned_bits - 1) / unsigned_bits);
+        word_type& w = m_words[word_index(set, i)];
+        word_type b = bit(set, i);
+        if ((w & b) != 0)
+            return false;
+        w |= b;
+        return true;
     }
 
-    bool insert(std::size_t i)
-    {        
-        base_type& v = m_bit_array[i >> unsigned_bits_log2];
-        base_type x = v;
-        v |= (one_bit << (i & unsigned_bits_log2_mask));
-        return x != v;                
+    void erase(std::size_t set, std::size_t i)
+    {
+        m_words[word_index(set, i)] &= ~bit(set, i);
     }
 
-    void erase(std::size_t i)
+    bool test(std::size_t set, std::size_t i) const
     {
-        m_bit_array[i >> unsigned_bits_log2] &= ~(one_bit << (i & unsigned_bits_log2_mask));        
+        return (m_words[word_index(set, i)] & bit(set, i)) != 0;
     }
 
-    bool test(std::size_t i) const
-    {              
-        return ((m_bit_array[i >> unsigned_bits_log2] >> (i & unsigned_bits_log2_mask)) & 1) != 0;
+    void clear()
+    {
+        std::fill(m_words.begin(), m_words.end(), word_type(0));
     }
 
-    struct iterator
+    // the number of sets
+    std::size_t set_count() const
     {
-        friend bounded_set;
-        typedef std::forward_iterator_tag
-            iterator_category;
-        typedef unsigned value_type;
-        typedef std::ptrdiff_t
-            difference_type;
+        return m_set_count;
+    }
 
-    private:
-        bool test() const
-        {
-            return ((m_bit_array[m_slot_index] >> m_bit_index) & 1) != 0;
-        }        
+    // the universe size
+    std::size_t size() const
+    {
+        return m_size;
+    }
 
-        bool next()
+    // the number of elements of one set
+    std::size_t count(std::size_t set) const
+    {
+        std::size_t counter = 0;
+        if (m_layout == row_major)
         {
-            m_current_slot >>= 1;
-
-            if (m_current_slot == 0)
+            const word_type* row = m_words.data() + set * m_row_words;
+            for (std::size_t w = 0; w < m_row_words; w++)
             {
-                m_bit_index = 0;
-                ++m_slot_index;
-
-                while (m_slot_index < m_bit_array_size && (m_current_slot = m_bit_array[m_slot_index]) == 0)
-                {
-                    ++m_slot_index;
-                }
-
-                if (m_current_slot == 0)
-                {
-                    m_slot_index = EmptyIndex;
-                    m_bit_index = 0;
-                    m_current_slot = 0;
-                    return false;
-                }
+                counter += bits::count_bits(row[w]);
             }
-            else
-            {
-                ++m_bit_index;
-                if (m_slot_index == m_bit_array_size - 1 && m_bit_index > m_last_bit)
-                {
-                    m_slot_index = EmptyIndex;
-                    m_bit_index = 0;
-                    m_current_slot = 0;
-                    return false;
-                }
-            }            
-
-            unsigned shift = bits::lsb(m_current_slot);
-            m_current_slot >>= shift;
-            m_bit_index += shift;
-
-            return true;
         }
-
-        iterator(unsigned size, const std::vector<base_type>&  bit_array, std::size_t pos)
-            : m_size(size), m_bit_array_size(bit_array.size()), m_bit_array(size ? &bit_array[0] : nullptr),
-            m_slot_index(pos >> unsigned_bits_log2), m_current_slot(0), m_bit_index(pos & unsigned_bits_log2_mask),
-            m_last_bit((size - 1) &  unsigned_bits_log2_mask)
+        else
         {
-            if (pos < m_size)
-                m_current_slot = m_bit_array[m_slot_index] >> m_bit_index;
-
-            if (!test())
+            for (std::size_t i = 0; i < m_size; i++)
             {
-                next();
+                counter += test(set, i);
             }
         }
+        return counter;
+    }
 
-    public:
-
-        iterator(unsigned size, const std::vector<base_type>&  bit_array)
-            : m_size(size), m_bit_array_size(bit_array.size()), m_bit_array(size ? &bit_array[0] : nullptr), m_slot_index(0), m_current_slot(0), m_bit_index(0),
-            m_last_bit((size - 1) &  unsigned_bits_log2_mask)
-        {
-            if (m_size != 0)
-                m_current_slot = m_bit_array[0];
+    ///------------------------------------
+    /// Columns: which sets contain an element
+    ///------------------------------------
 
-            if (m_size != 0 && !test())
-            {
-                next();
-            }
-        }
+    // the words of a membership vector: (set_count() + 63) / 64
+    std::size_t vector_words() const
+    {
+        return m_vector_words;
+    }
 
-        iterator() // empty
-            : m_size(0), m_bit_array(nullptr), m_slot_index(EmptyIndex), m_current_slot(0), m_bit_index(0), m_last_bit(0)
-        {}
+    // the membership vector of element i, in column_major: a single cache line for up to 512 sets
+    const word_type* column(std::size_t i) const
+    {
+        return m_words.data() + i * m_column_words;
+    }
 
-        unsigned operator*() const
+    // writes the membership vector of element i to out (vector_words() words); one load per set in row_major
+    void membership(std::size_t i, word_type* out) const
+    {
+        if (m_layout == column_major)
         {
-            return (m_slot_index << unsigned_bits_log2) + m_bit_index;
+            std::copy(column(i), column(i) + m_vector_words, out);
+            return;
         }
-
-        iterator& operator++()
+        std::fill(out, out + m_vector_words, word_type(0));
+        const word_type* p = m_words.data() + i / word_bits;
+        for (std::size_t set = 0; set < m_set_count; set++, p += m_row_words)
         {
-            next();
-            return *this;
+            out[set / word_bits] |= ((*p >> (i % word_bits)) & 1) << (set % word_bits);
         }
+    }
 
-        iterator operator++(int)
-        {
-            iterator tmp(*this);
-            ++*this;
-            return tmp;
-        }
+    // the sets that contain at least one of the n elements
+    template <class Key>
+    void columns_or(const Key* elements, std::size_t n, word_type* out) const
+    {
+        combine_columns(elements, n, out, false);
+    }
 
-        bool operator==(const iterator& y)
-        {
-            return (m_slot_index == y.m_slot_index) && (m_bit_index == y.m_bit_index);
-        }
+    // the sets that contain all of the n elements (all the sets if n is 0)
+    template <class Key>
+    void columns_and(const Key* elements, std::size_t n, word_type* out) const
+    {
+        combine_columns(elements, n, out, true);
+    }
 
-        bool operator!=(const iterator& y)
-        {
-            return (m_slot_index != y.m_slot_index) || (m_bit_index != y.m_bit_index);
-        }
+    ///------------------------------------
+    /// Rows: the elements of a set
+    ///------------------------------------
 
-    private:
-        unsigned m_size;
-        std::size_t m_bit_array_size;
-        const base_type* m_bit_array;
-        std::size_t m_slot_index;
-        base_type m_current_slot;
-        unsigned m_bit_index;
-        unsigned m_last_bit;
-    };
+    // the words of a row: (size() + 63) / 64
+    std::size_t row_words() const
+    {
+        return m_row_words;
+    }
 
-    typedef iterator const_iterator;
+    // the bit array of a set, in row_major
+    const word_type* row(std::size_t set) const
+    {
+        return m_words.data() + set * m_row_words;
+    }
 
-    iterator begin() const
+    // the elements of a set in increasing order, in row_major
+    row_range elements(std::size_t set) const
     {
-        return iterator(m_size, m_bit_array);
+        return row_range(iterator(row(set), 0, m_size), iterator());
     }
 
-    iterator end() const
+    // calls f for the elements of a set in increasing order, in either layout (column_major tests every element)
+    template <class F>
+    void for_each(std::size_t set, F f) const
     {
-        return iterator();
+        if (m_layout == row_major)
+        {
+            for (auto i : elements(set))
+            {
+                f(i);
+            }
+            return;
+        }
+        const word_type* p = m_words.data() + set / word_bits;
+        for (std::size_t i = 0; i < m_size; i++, p += m_column_words)
+        {
+            if (((*p >> (set % word_bits)) & 1) != 0)
+                f(i);
+        }
     }
 
-    iterator find(unsigned i) const
+    // writes the bit array of a set to out (row_words() words)
+    void copy_row(std::size_t set, word_type* out) const
     {
-        if (test(i))
+        if (m_layout == row_major)
         {
-            return iterator(m_size, m_bit_array, i);
+            std::copy(row(set), row(set) + m_row_words, out);
+            return;
         }
-        return iterator();
+        std::fill(out, out + m_row_words, word_type(0));
+        for_each(set, [out](std::size_t i) { out[i / word_bits] |= word_type(1) << (i % word_bits); });
     }
 
-    iterator lower_bound(std::size_t i) const
+    // the union of n sets, as a bit array of row_words() words
+    void rows_or(const std::size_t* sets, std::size_t n, word_type* out) const
     {
-        return iterator(m_size, m_bit_array, i);        
+        combine_rows(sets, n, out, false);
     }
 
-    iterator upper_bound(std::size_t i) const
+    // the intersection of n sets (the whole universe if n is 0), as a bit array of row_words() words
+    void rows_and(const std::size_t* sets, std::size_t n, word_type* out) const
     {
-        if (i + 1 >= m_size)
-            return iterator();        
-        return iterator(m_size, m_bit_array, i+1);
+        combine_rows(sets, n, out, true);
     }
 
-    void erase(const iterator& it)
+    ///------------------------------------
+    /// Layout
+    ///------------------------------------
+
+    layout_type layout() const
     {
-        erase(*it);
+        return m_layout;
     }
 
-    bool empty() const
+    // converts to the other layout, 64 sets by 64 elements at a time
+    void transpose()
     {
-        for (auto x : m_bit_array)
+        layout_type target = m_layout == row_major ? column_major : row_major;
+        word_sequence words(storage_words(target), word_type(0), m_words.get_allocator());
+        word_type tile[word_bits];
+
+        for (std::size_t block = 0; block < m_vector_words; block++)
         {
-            if (x != 0)
-                return false;
+            std::size_t first_set = block * word_bits;
+            std::size_t sets = std::min<std::size_t>(word_bits, m_set_count - first_set);
+            for (std::size_t w = 0; w < m_row_words; w++)
+            {
+                if (m_layout == row_major)
+                {
+                    for (std::size_t r = 0; r < word_bits; r++)
+                    {
+                        tile[r] = r < sets ? m_words[(first_set + r) * m_row_words + w] : 0;
+                    }
+                    bits::transpose64(tile);
+                    for (std::size_t c = 0; c < word_bits; c++)
+                    {
+                        words[(w * word_bits + c) * m_column_words + block] = tile[c];
+                    }
+                }
+                else
+                {
+                    for (std::size_t c = 0; c < word_bits; c++)
+                    {
+                        tile[c] = m_words[(w * word_bits + c) * m_column_words + block];
+                    }
+                    bits::transpose64(tile);
+                    for (std::size_t r = 0; r < sets; r++)
+                    {
+                        words[(first_set + r) * m_row_words + w] = tile[r];
+                    }
+                }
+            }
         }
-        return true;
+
+        m_words.swap(words);
+        m_layout = target;
     }
 
-    void clear()
+    std::size_t memory_usage() const
     {
-        std::fill(m_bit_array.begin(), m_bit_array.end(), 0);
+        return m_words.capacity() * sizeof(word_type);
     }
 
-    std::size_t size() const
+private:
+    template <class Key>
+    void combine_columns(const Key* elements, std::size_t n, word_type* out, bool intersect) const
     {
-        return m_size;
+        std::fill(out, out + m_vector_words, intersect ? ~word_type(0) : word_type(0));
+        if (intersect && m_set_count % word_bits != 0)
+            out[m_vector_words - 1] = (word_type(1) << (m_set_count % word_bits)) - 1;
+
+        std::vector<word_type> vector(m_layout == row_major ? m_vector_words : 0);
+        for (std::size_t k = 0; k < n; k++)
+        {
+            const word_type* v = vector.data();
+            if (m_layout == row_major)
+            {
+                membership(static_cast<std::size_t>(elements[k]), vector.data());
+            }
+            else
+            {
+                if (k + bits::prefetch_distance < n)
+                    bits::prefetch(column(static_cast<std::size_t>(elements[k + bits::prefetch_distance])));
+                v = column(static_cast<std::size_t>(elements[k]));
+            }
+
+            if (intersect)
+                bits::and_words(out, v, m_vector_words);
+            else
+                bits::or_words(out, v, m_vector_words);
+        }
     }
 
-    std::size_t count() const
+    void combine_rows(const std::size_t* sets, std::size_t n, word_type* out, bool intersect) const
     {
-        std::size_t count = 0;
-        for (auto x : m_bit_array)
+        std::fill(out, out + m_row_words, intersect ? ~word_type(0) : word_type(0));
+        if (intersect && m_size % word_bits != 0)
+            out[m_row_words - 1] = (word_type(1) << (m_size % word_bits)) - 1;
+
+        std::vector<word_type> row_copy(m_layout == column_major ? m_row_words : 0);
+        for (std::size_t k = 0; k < n; k++)
         {
-            count += bits::count_bits(x);
+            const word_type* r = m_layout == row_major ? row(sets[k]) : row_copy.data();
+            if (m_layout == column_major)
+                copy_row(sets[k], row_copy.data());
+
+            if (intersect)
+                bits::and_words(out, r, m_row_words);
+            else
+                bits::or_words(out, r, m_row_words);
         }
-        return count;
     }
-}; // bounded set
+}; // set family
+
+typedef basic_set_family<> set_family;
@@ -0,0 +1,322 @@
+
+// <summary>Contains reproducible ID generators (uniform, Zipf, clustered, runs, monotonic) for the benchmarks</summary>
+
+#pragma once
+
+#include <cstdint>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <random>
+#include <algorithm>
+
+namespace benchmark
+{
+    ///------------------------------------
+    /// Random numbers: with the default seed, the same sequence as the one used by the original tests
+    ///------------------------------------
+
+    class random_source
+    {
+        std::default_random_engine m_generator;
+        std::uniform_int_distribution<unsigned> m_distribution;
+        unsigned m_seed;
+
+    public:
+        random_source(unsigned seed = 0x11111111) : m_generator(), m_distribution(0, 4294967295), m_seed(seed)
+        {
+            reset();
+        }
+
+        void reset()
+        {
+            m_distribution.reset();
+            m_generator.seed(m_seed);
+        }
+
+        unsigned operator()()
+        {
+            return m_distribution(m_generator);
+        }
+
+        // uniform in [0, 1)
+        double uniform()
+        {
+            return (*this)() / 4294967296.0;
+        }
+
+        // uniform in [0, n)
+        std::uint64_t below(std::uint64_t n)
+        {
+            std::uint64_t x = (static_cast<std::uint64_t>((*this)()) << 32) | (*this)();
+            return x % n;
+        }
+    };
+
+    ///
+    /// Zipf distribution over the ranks [1, n] with the given exponent, sampled in constant time by rejection-inversion
+    /// (W. Hormann, G. Derflinger, "Rejection-inversion to generate variates from monotone discrete distributions", 1996).
+    ///
+    class zipf_distribution
+    {
+        double m_exponent;
+        double m_n;
+        double m_h_integral_x1;
+        double m_h_integral_n;
+        double m_s;
+
+        static double helper1(double x) // log(1 + x) / x
+        {
+            return std::fabs(x) > 1e-8 ? std::log1p(x) / x : 1.0 - x * (1.0 / 2.0 - x * (1.0 / 3.0 - x * (1.0 / 4.0)));
+        }
+
+        static double helper2(double x) // (exp(x) - 1) / x
+        {
+            return std::fabs(x) > 1e-8 ? std::expm1(x) / x : 1.0 + x * (1.0 / 2.0) * (1.0 + x * (1.0 / 3.0) * (1.0 + x * (1.0 / 4.0)));
+        }
+
+        double h(double x) const
+        {
+            return std::exp(-m_exponent * std::log(x));
+        }
+
+        double h_integral(double x) const
+        {
+            double log_x = std::log(x);
+            return helper2((1.0 - m_exponent) * log_x) * log_x;
+        }
+
+        double h_integral_inverse(double x) const
+        {
+            double t = x * (1.0 - m_exponent);
+            if (t < -1.0)
+                t = -1.0;
+            return std::exp(helper1(t) * x);
+        }
+
+    public:
+        zipf_distribution(std::uint64_t n, double exponent) : m_exponent(exponent), m_n(static_cast<double>(n))
+        {
+            m_h_integral_x1 = h_integral(1.5) - 1.0;
+            m_h_integral_n = h_integral(m_n + 0.5);
+            m_s = 2.0 - h_integral_inverse(h_integral(2.5) - h(2.0));
+        }
+
+        std::uint64_t operator()(random_source& random)
+        {
+            for (;;)
+            {
+                double u = m_h_integral_n + random.uniform() * (m_h_integral_x1 - m_h_integral_n);
+                double x = h_integral_inverse(u);
+                double k = std::floor(x + 0.5);
+                if (k < 1)
+                    k = 1;
+                else if (k > m_n)
+                    k = m_n;
+                if (k - x <= m_s || u >= h_integral(k + 0.5) - h(k))
+                    return static_cast<std::uint64_t>(k);
+            }
+        }
+    };
+
+    enum distribution_type { uniform_ids, zipf_ids, clustered_ids, run_ids, monotonic_ids, distribution_count };
+
+    inline const char* distribution_name(int type)
+    {
+        static const char* names[] = { "uniform", "zipf", "clustered", "runs", "monotonic" };
+        return names[type];
+    }
+
+    inline bool parse_distribution(const std::string& name, distribution_type& type)
+    {
+        for (int d = 0; d < distribution_count; d++)
+        {
+            if (name == distribution_name(d))
+            {
+                type = static_cast<distribution_type>(d);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    struct distribution_parameters
+    {
+        double zipf_exponent;     // zipf: the skew of the hot keys
+        unsigned block_size;      // clustered: the width of a tenant range
+        unsigned mean_run;        // runs: the mean length of a run of consecutive IDs
+
+        distribution_parameters() : zipf_exponent(1.0), block_size(65536), mean_run(256)
+        {
+        }
+    };
+
+    ///
+    /// A reproducible stream of IDs in [0, length). The same type, length, selection and seed always give the same stream.
+    ///
+    ///   uniform    independent uniform IDs (with the default seed, the sequence of the original tests)
+    ///   zipf       hot keys: ranks drawn from a Zipf distribution, scattered over the interval by a fixed permutation
+    ///   clustered  tenant ranges: IDs uniform within a fixed random subset of blocks that can hold about 4 x selection IDs
+    ///   runs       time-ordered batches: runs of consecutive IDs of random length starting at random positions
+    ///   monotonic  sequential allocation with random gaps, the mean gap being length / selection; wraps around
+    ///
+    class id_generator
+    {
+        distribution_type m_type;
+        std::uint64_t m_length;
+        distribution_parameters m_parameters;
+        random_source m_random;
+        zipf_distribution m_zipf;
+        std::uint64_t m_multiplier;    // zipf: rank to ID permutation
+        std::uint64_t m_offset;
+        std::vector<unsigned> m_blocks; // clustered: the active blocks
+        std::uint64_t m_next;           // runs, monotonic: the next ID
+        std::uint64_t m_run_remaining;
+        double m_mean_gap;
+
+        static std::uint64_t gcd(std::uint64_t a, std::uint64_t b)
+        {
+            while (b != 0)
+            {
+                std::uint64_t t = a % b;
+                a = b;
+                b = t;
+            }
+            return a;
+        }
+
+    public:
+        id_generator(distribution_type type, unsigned length, unsigned selection, unsigned seed,
+            const distribution_parameters& parameters = distribution_parameters())
+            : m_type(type), m_length(length == 0 ? 1 : length), m_parameters(parameters), m_random(seed),
+            m_zipf(m_length, parameters.zipf_exponent), m_multiplier(1), m_offset(0), m_blocks(), m_next(0), m_run_remaining(0),
+            m_mean_gap(selection == 0 ? 1.0 : static_cast<double>(m_length) / selection)
+        {
+            switch (m_type)
+            {
+            case zipf_ids:
+                m_multiplier = 2654435761u % m_length;
+                while (m_multiplier == 0 || gcd(m_multiplier, m_length) != 1)
+                {
+                    m_multiplier++;
+                }
+                m_offset = m_random.below(m_length);
+                break;
+
+            case clustered_ids:
+            {
+                unsigned block_size = std::max(1u, parameters.block_size);
+                std::uint64_t block_count = (m_length + block_size - 1) / block_size;
+                std::uint64_t active = std::min<std::uint64_t>(block_count, (4ull * selection + block_size - 1) / block_size);
+                std::vector<unsigned> blocks(static_cast<std::size_t>(block_count));
+                for (std::size_t b = 0; b < blocks.size(); b++)
+                {
+                    blocks[b] = static_cast<unsigned>(b);
+                }
+                for (std::size_t b = 0; b < active; b++) // partial Fisher-Yates shuffle
+                {
+                    std::swap(blocks[b], blocks[b + static_cast<std::size_t>(m_random.below(block_count - b))]);
+                }
+                m_blocks.assign(blocks.begin(), blocks.begin() + static_cast<std::size_t>(std::max<std::uint64_t>(active, 1)));
+                break;
+            }
+
+            case run_ids:
+            case monotonic_ids:
+                m_next = m_random.below(m_length);
+                break;
+
+            default:
+                break;
+            }
+        }
+
+        distribution_type type() const
+        {
+            return m_type;
+        }
+
+        unsigned operator()()
+        {
+            switch (m_type)
+            {
+            case zipf_ids:
+                return static_cast<unsigned>(((m_zipf(m_random) - 1) * m_multiplier + m_offset) % m_length);
+
+            case clustered_ids:
+            {
+                std::uint64_t block = m_blocks[static_cast<std::size_t>(m_random.below(m_blocks.size()))];
+                std::uint64_t id = block * m_parameters.block_size + m_random.below(m_parameters.block_size);
+                return static_cast<unsigned>(id < m_length ? id : id % m_length);
+            }
+
+            case run_ids:
+                if (m_run_remaining == 0)
+                {
+                    m_next = m_random.below(m_length);
+                    m_run_remaining = 1 + m_random.below(2ull * m_parameters.mean_run);
+                }
+                m_run_remaining--;
+                m_next = (m_next + 1) % m_length;
+                return static_cast<unsigned>(m_next);
+
+            case monotonic_ids:
+            {
+                // geometric gaps with the mean gap
+                double u = m_random.uniform();
+                std::uint64_t gap = 1 + static_cast<std::uint64_t>(-std::log1p(-u) * (m_mean_gap - 1.0 > 0 ? m_mean_gap - 1.0 : 0.0));
+                m_next = (m_next + gap) % m_length;
+                return static_cast<unsigned>(m_next);
+            }
+
+            default:
+                return static_cast<unsigned>(m_random() % m_length);
+            }
+        }
+    };
+
+    ///
+    /// The first selection distinct IDs of the stream, in the order they were drawn. Skewed streams at high densities
+    /// repeat themselves a lot: after 16 x selection draws the remainder is topped up with uniform IDs.
+    ///
+    inline std::vector<unsigned> populate(id_generator& generator, unsigned length, unsigned selection)
+    {
+        std::vector<unsigned> values;
+        values.reserve(selection);
+        std::vector<bool> present(length);
+
+        std::uint64_t attempts = 16ull * selection + 1000;
+        while (values.size() < selection && attempts-- != 0)
+        {
+            unsigned k = generator();
+            if (!present[k])
+            {
+                present[k] = true;
+                values.push_back(k);
+            }
+        }
+
+        random_source top_up(0x22222222);
+        while (values.size() < selection)
+        {
+            unsigned k = top_up() % length;
+            if (!present[k])
+            {
+                present[k] = true;
+                values.push_back(k);
+            }
+        }
+        return values;
+    }
+
+    // a probe stream for the random access phase; the harness cycles through it
+    inline std::vector<unsigned> probe_stream(id_generator& generator, std::size_t count)
+    {
+        std::vector<unsigned> probes(count);
+        for (auto& k : probes)
+        {
+            k = generator();
+        }
+        return probes;
+    }
+} // benchmark